@@ -5,6 +5,7 @@
 #include "AudioEngine.h"
 #include "log.h"
 #include <stdlib.h>
+#include <pthread.h>
 
 #include <assert.h>
 
@@ -16,7 +17,17 @@
 /* Size of each PCM buffer in the queue */
 #define BUFFER_SIZE_IN_BYTES   (2*sizeof(short)*SAMPLES_PER_AAC_FRAME)
 
-void AudioEngine::createEngine() {
+// one engine and output mix for all the players of the process, created on first use and
+// kept, so that a player after the first one only has to create its buffer queue player
+static SLObjectItf sharedEngineObject = NULL;
+static SLEngineItf sharedEngineEngine = NULL;
+static SLObjectItf sharedOutputMixObject = NULL;
+static pthread_once_t sharedEngineOnce = PTHREAD_ONCE_INIT;
+
+static void createSharedEngine() {
+    SLObjectItf engineObject;
+    SLEngineItf engineEngine;
+    SLObjectItf outputMixObject;
     SLresult result;
 
     // create engine
@@ -45,6 +56,17 @@ void AudioEngine::createEngine() {
     result = (*outputMixObject)->Realize(outputMixObject, SL_BOOLEAN_FALSE);
     assert(SL_RESULT_SUCCESS == result);
     (void) result;
+
+    sharedEngineObject = engineObject;
+    sharedEngineEngine = engineEngine;
+    sharedOutputMixObject = outputMixObject;
+}
+
+void AudioEngine::createEngine() {
+    pthread_once(&sharedEngineOnce, createSharedEngine);
+    engineObject = sharedEngineObject;
+    engineEngine = sharedEngineEngine;
+    outputMixObject = sharedOutputMixObject;
 }
 
 // this callback handler is called every time a buffer finishes playing
@@ -73,9 +95,8 @@ void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context) {
 }
 
 void AudioEngine::createBufferQueueAudioPlayer(int sampleRate, unsigned int channels,
-                                               void *userData, void (*callback)(void *userdata,
-                                                                                uint8_t *stream,
-                                                                                int len)) {
+                                               void *userData,
+                                               ffplayer::AudioSinkCallback callback) {
     ALOGD("createBufferQueueAudioPlayer sampleRate=%d, channels=%d", sampleRate, channels);
     SLresult result;
     if (sampleRate >= 0) {
@@ -180,21 +201,15 @@ void AudioEngine::shutdown() {
         bqPlayerVolume = NULL;
     }
 
-    // destroy output mix object, and invalidate all associated interfaces
-    if (outputMixObject != NULL) {
-        (*outputMixObject)->Destroy(outputMixObject);
-        outputMixObject = NULL;
-    }
-
-    // destroy engine object, and invalidate all associated interfaces
-    if (engineObject != NULL) {
-        (*engineObject)->Destroy(engineObject);
-        engineObject = NULL;
-        engineEngine = NULL;
-    }
+    // the output mix and the engine are shared, the next player reuses them
+    outputMixObject = NULL;
+    engineObject = NULL;
+    engineEngine = NULL;
 
-    if (outputBuffer != NULL)
+    if (outputBuffer != NULL) {
         free(outputBuffer);
+        outputBuffer = NULL;
+    }
 
     mCallback = NULL;
     mUserData = NULL;
@@ -209,6 +224,20 @@ AudioEngine::AudioEngine() : engineObject(NULL), engineEngine(NULL), outputMixOb
 
 }
 
+void AudioEngine::open(int sampleRate, unsigned int channels, void *userData,
+                       ffplayer::AudioSinkCallback callback) {
+    createEngine();
+    createBufferQueueAudioPlayer(sampleRate, channels, userData, callback);
+}
+
+void AudioEngine::start() {
+    enqueueStartBuffer();
+}
+
+void AudioEngine::close() {
+    shutdown();
+}
+
 void AudioEngine::enqueueStartBuffer() {
     uint8_t *silent = (uint8_t *) malloc(sizeof(uint8_t) * outputBufferSize);
     memset(silent, 0, sizeof(uint8_t) * outputBufferSize);
@@ -13,7 +13,9 @@
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
 
-class AudioEngine {
+#include "Platform.h"
+
+class AudioEngine : public ffplayer::AudioSink {
 private:
     // engine interfaces
     SLObjectItf engineObject;
@@ -33,9 +35,7 @@ private:
     int outputBufferSize;
     uint8_t *outputBuffer;
     void *mUserData;
-    void (*mCallback)(void *userdata,
-                      uint8_t *stream,
-                      int len);
+    ffplayer::AudioSinkCallback mCallback;
 
 public:
     AudioEngine();
@@ -43,14 +43,19 @@ public:
     void createEngine();
 
     void createBufferQueueAudioPlayer(int sampleRate, unsigned int channels, void *userData,
-                                      void (*callback)(void *userdata,
-                                                       uint8_t *stream,
-                                                       int len));
+                                      ffplayer::AudioSinkCallback callback);
 
     void shutdown();
 
     void enqueueStartBuffer();
 
+    void open(int sampleRate, unsigned int channels, void *userData,
+              ffplayer::AudioSinkCallback callback);
+
+    void start();
+
+    void close();
+
     friend void bqPlayerCallback(SLAndroidSimpleBufferQueueItf bq, void *context);
 };
 
@@ -0,0 +1,326 @@
+#include "log.h"
+#include "AudioVisualizer.h"
+#include "Trace.h"
+
+extern "C" {
+#include "libavcodec/avfft.h"
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+}
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_VISUALIZER_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_VISUALIZER_SSE2 1
+#endif
+
+/* frames of a slice of the waveform */
+#define VISUALIZER_SLICE (VISUALIZER_FFT_SIZE / VISUALIZER_PEAKS)
+
+namespace ffplayer {
+
+struct AudioVisualizer {
+    int16_t ring[VISUALIZER_RING_SIZE];
+    uint32_t head;             // samples written so far, only by the audio callback
+    uint32_t reserve;          // head once the write in progress is done
+    int channels;
+
+    /* the thread's own */
+    uint32_t last_head;        // head of the last frame
+    int16_t snapshot[VISUALIZER_FFT_SIZE * VISUALIZER_MAX_CHANNELS];
+    DECLARE_ALIGNED(32, float, window)[VISUALIZER_FFT_SIZE];
+    DECLARE_ALIGNED(32, float, mono)[VISUALIZER_FFT_SIZE];
+    DECLARE_ALIGNED(32, FFTSample, data)[VISUALIZER_FFT_SIZE];
+    RDFTContext *rdft;
+    VisualizerFrame frame;
+
+    /* odd while published is written, a reader tries again when it changed */
+    uint32_t sequence;
+    VisualizerFrame published;
+
+    pthread_t tid;
+    int has_thread;
+    int rate;
+    int abort_request;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+void audio_visualizer_write(AudioVisualizer *v, const int16_t *samples, int nb_samples) {
+    uint32_t head = v->head;
+    int offset, len;
+
+    if (nb_samples > VISUALIZER_RING_SIZE) {
+        head += nb_samples - VISUALIZER_RING_SIZE;
+        samples += nb_samples - VISUALIZER_RING_SIZE;
+        nb_samples = VISUALIZER_RING_SIZE;
+    }
+    /* a snapshot of what is written over from here on is dropped */
+    __atomic_store_n(&v->reserve, head + nb_samples, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    offset = head % VISUALIZER_RING_SIZE;
+    len = FFMIN(nb_samples, VISUALIZER_RING_SIZE - offset);
+    memcpy(v->ring + offset, samples, len * sizeof(*samples));
+    memcpy(v->ring, samples + len, (nb_samples - len) * sizeof(*samples));
+    __atomic_store_n(&v->head, head + nb_samples, __ATOMIC_RELEASE);
+}
+
+/* copy the window of samples up to head, 0 if the callback wrote over it
+ * meanwhile. Before the ring is full the missing samples are silence. */
+static int ring_snapshot(AudioVisualizer *v, uint32_t head) {
+    int nb_samples = VISUALIZER_FFT_SIZE * v->channels;
+    uint32_t start = head - nb_samples;
+    int offset = start % VISUALIZER_RING_SIZE;
+    int len = FFMIN(nb_samples, VISUALIZER_RING_SIZE - offset);
+
+    memcpy(v->snapshot, v->ring + offset, len * sizeof(*v->snapshot));
+    memcpy(v->snapshot + len, v->ring, (nb_samples - len) * sizeof(*v->snapshot));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&v->reserve, __ATOMIC_RELAXED) - start <= VISUALIZER_RING_SIZE;
+}
+
+/* the channels averaged, -1 to 1 */
+static void mix_down(float *dst, const int16_t *src, int channels) {
+    float scale = 1.0f / (32768.0f * channels);
+    int i = 0, c, sum;
+
+#if HAVE_VISUALIZER_NEON
+    if (channels == 2) {
+        for (; i < VISUALIZER_FFT_SIZE; i += 4) {
+            int16x4x2_t lr = vld2_s16(src + 2 * i);
+            int32x4_t s = vaddl_s16(lr.val[0], lr.val[1]);
+            vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_s32(s), scale));
+        }
+    }
+#elif HAVE_VISUALIZER_SSE2
+    if (channels == 2) {
+        __m128i ones = _mm_set1_epi16(1);
+        __m128 s = _mm_set1_ps(scale);
+        for (; i < VISUALIZER_FFT_SIZE; i += 4) {
+            /* left + right of four frames, as 32 bits */
+            __m128i lr = _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (src + 2 * i)), ones);
+            _mm_store_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lr), s));
+        }
+    }
+#endif
+    for (; i < VISUALIZER_FFT_SIZE; i++) {
+        for (c = 0, sum = 0; c < channels; c++)
+            sum += src[i * channels + c];
+        dst[i] = sum * scale;
+    }
+}
+
+static void waveform_peaks(float *peaks, const float *mono) {
+    float lo, hi;
+    int i, j;
+
+    for (i = 0; i < VISUALIZER_PEAKS; i++) {
+        const float *slice = mono + i * VISUALIZER_SLICE;
+        lo = hi = slice[0];
+        for (j = 1; j < VISUALIZER_SLICE; j++) {
+            lo = FFMIN(lo, slice[j]);
+            hi = FFMAX(hi, slice[j]);
+        }
+        peaks[2 * i] = lo;
+        peaks[2 * i + 1] = hi;
+    }
+}
+
+static void apply_window(float *dst, const float *src, const float *window) {
+    int i = 0;
+
+#if HAVE_VISUALIZER_NEON
+    for (; i < VISUALIZER_FFT_SIZE; i += 4)
+        vst1q_f32(dst + i, vmulq_f32(vld1q_f32(src + i), vld1q_f32(window + i)));
+#elif HAVE_VISUALIZER_SSE2
+    for (; i < VISUALIZER_FFT_SIZE; i += 4)
+        _mm_store_ps(dst + i, _mm_mul_ps(_mm_load_ps(src + i), _mm_load_ps(window + i)));
+#endif
+    for (; i < VISUALIZER_FFT_SIZE; i++)
+        dst[i] = src[i] * window[i];
+}
+
+/* the power of each bin from the packed output of the real FFT: the DC and
+ * the Nyquist bins first, then re and im of the bins 1 to N/2 - 1 */
+static void spectrum_power(float *power, const float *data) {
+    /* a full scale sine through the Hann window peaks at N / 4 */
+    float norm = 16.0f / ((float) VISUALIZER_FFT_SIZE * VISUALIZER_FFT_SIZE);
+    int k = 0;
+
+#if HAVE_VISUALIZER_NEON
+    for (; k < VISUALIZER_BINS; k += 4) {
+        float32x4x2_t c = vld2q_f32(data + 2 * k);
+        float32x4_t p = vmlaq_f32(vmulq_f32(c.val[0], c.val[0]), c.val[1], c.val[1]);
+        vst1q_f32(power + k, vmulq_n_f32(p, norm));
+    }
+#elif HAVE_VISUALIZER_SSE2
+    __m128 n = _mm_set1_ps(norm);
+    for (; k < VISUALIZER_BINS; k += 4) {
+        __m128 a = _mm_load_ps(data + 2 * k), b = _mm_load_ps(data + 2 * k + 4);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 p = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+        _mm_storeu_ps(power + k, _mm_mul_ps(p, n));
+    }
+#endif
+    for (; k < VISUALIZER_BINS; k++)
+        power[k] = (data[2 * k] * data[2 * k] + data[2 * k + 1] * data[2 * k + 1]) * norm;
+    /* the pair of bin 0 is the DC and the Nyquist bins */
+    power[0] = data[0] * data[0] * norm;
+}
+
+static void frame_publish(AudioVisualizer *v) {
+    uint32_t sequence = v->sequence;
+
+    __atomic_store_n(&v->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&v->published, &v->frame, sizeof(v->frame));
+    __atomic_store_n(&v->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+int audio_visualizer_read(AudioVisualizer *v, VisualizerFrame *frame) {
+    uint32_t sequence;
+    int i;
+
+    /* the thread is niced, spinning could keep it from finishing the copy */
+    for (i = 0; i < VISUALIZER_READ_TRIES; i++) {
+        if (i)
+            sched_yield();
+        sequence = __atomic_load_n(&v->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+            continue;
+        memcpy(frame, &v->published, sizeof(*frame));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&v->sequence, __ATOMIC_RELAXED) == sequence)
+            return 1;
+    }
+    frame->count = 0;
+    return 0;
+}
+
+int audio_visualizer_update(AudioVisualizer *v) {
+    uint32_t head = __atomic_load_n(&v->head, __ATOMIC_ACQUIRE);
+    int64_t trace_time = trace_begin();
+    int k;
+
+    if (head == v->last_head || !ring_snapshot(v, head))
+        return 0;
+    v->last_head = head;
+
+    mix_down(v->mono, v->snapshot, v->channels);
+    waveform_peaks(v->frame.peaks, v->mono);
+    apply_window(v->data, v->mono, v->window);
+    av_rdft_calc(v->rdft, v->data);
+    spectrum_power(v->frame.spectrum, v->data);
+    for (k = 0; k < VISUALIZER_BINS; k++)
+        v->frame.spectrum[k] = FFMAX(10.0f * log10f(v->frame.spectrum[k]), VISUALIZER_MIN_DB);
+    v->frame.count++;
+    frame_publish(v);
+    trace_end("visualizer", trace_time);
+    return 1;
+}
+
+static void *visualizer_thread(void *arg) {
+    AudioVisualizer *v = (AudioVisualizer *) arg;
+    int64_t next = av_gettime_relative(), now;
+    struct timeval delta;
+    struct timespec abstime;
+
+    /* only for the eyes, it goes after the playback */
+    if (setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), VISUALIZER_NICE) < 0)
+        ALOGW("visualizer: could not lower the priority");
+
+    pthread_mutex_lock(&v->mutex);
+    while (!v->abort_request) {
+        now = av_gettime_relative();
+        if (now < next) {
+            gettimeofday(&delta, NULL);
+            abstime.tv_sec = delta.tv_sec + (next - now) / 1000000;
+            abstime.tv_nsec = (delta.tv_usec + (next - now) % 1000000) * 1000;
+            if (abstime.tv_nsec >= 1000000000) {
+                abstime.tv_sec += 1;
+                abstime.tv_nsec -= 1000000000;
+            }
+            /* woken up early for a new rate or to stop */
+            pthread_cond_timedwait(&v->cond, &v->mutex, &abstime);
+            continue;
+        }
+        pthread_mutex_unlock(&v->mutex);
+        audio_visualizer_update(v);
+        pthread_mutex_lock(&v->mutex);
+        /* a fixed rate, without catching up after a stall */
+        next = FFMAX(next + 1000000 / v->rate, now);
+    }
+    pthread_mutex_unlock(&v->mutex);
+    return NULL;
+}
+
+AudioVisualizer *audio_visualizer_create(int channels, int rate) {
+    AudioVisualizer *v;
+    int i;
+
+    if (channels < 1 || channels > VISUALIZER_MAX_CHANNELS)
+        return NULL;
+    if (!(v = (AudioVisualizer *) av_mallocz(sizeof(AudioVisualizer))))
+        return NULL;
+    if (!(v->rdft = av_rdft_init(VISUALIZER_FFT_BITS, DFT_R2C))) {
+        av_free(v);
+        return NULL;
+    }
+    v->channels = channels;
+    for (i = 0; i < VISUALIZER_FFT_SIZE; i++)
+        v->window[i] = 0.5f - 0.5f * cosf(2.0f * (float) M_PI * i / VISUALIZER_FFT_SIZE);
+    v->mutex = PTHREAD_MUTEX_INITIALIZER;
+    v->cond = PTHREAD_COND_INITIALIZER;
+    v->rate = rate;
+    if (rate > 0) {
+        if (pthread_create(&v->tid, NULL, visualizer_thread, v)) {
+            audio_visualizer_destroy(v);
+            return NULL;
+        }
+        pthread_setname_np(v->tid, "visualizer");
+        v->has_thread = 1;
+    }
+    return v;
+}
+
+void audio_visualizer_destroy(AudioVisualizer *v) {
+    if (v->has_thread) {
+        pthread_mutex_lock(&v->mutex);
+        v->abort_request = 1;
+        pthread_cond_signal(&v->cond);
+        pthread_mutex_unlock(&v->mutex);
+        pthread_join(v->tid, NULL);
+    }
+    av_rdft_end(v->rdft);
+    pthread_mutex_destroy(&v->mutex);
+    pthread_cond_destroy(&v->cond);
+    av_free(v);
+}
+
+void audio_visualizer_set_rate(AudioVisualizer *v, int rate) {
+    if (rate <= 0)
+        return;
+    pthread_mutex_lock(&v->mutex);
+    v->rate = rate;
+    pthread_cond_signal(&v->cond);
+    pthread_mutex_unlock(&v->mutex);
+}
+
+size_t audio_visualizer_size() {
+    return sizeof(AudioVisualizer);
+}
+
+}
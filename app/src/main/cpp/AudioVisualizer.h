@@ -0,0 +1,66 @@
+#ifndef MYPLAYER_AUDIOVISUALIZER_H
+#define MYPLAYER_AUDIOVISUALIZER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* the spectrum is of the last 2048 frames, 46 ms at 44.1 kHz */
+#define VISUALIZER_FFT_BITS 11
+#define VISUALIZER_FFT_SIZE (1 << VISUALIZER_FFT_BITS)
+#define VISUALIZER_BINS (VISUALIZER_FFT_SIZE / 2)
+/* the waveform of the same frames in this many slices */
+#define VISUALIZER_PEAKS 128
+#define VISUALIZER_MAX_CHANNELS 2
+/* interleaved samples, four windows so that the thread can be late */
+#define VISUALIZER_RING_SIZE (4 * VISUALIZER_FFT_SIZE * VISUALIZER_MAX_CHANNELS)
+/* updates per second when the app does not ask for a rate */
+#define VISUALIZER_DEFAULT_RATE 30
+/* the thread is niced below the audio and the decoders */
+#define VISUALIZER_NICE 10
+/* the spectrum floor, in dB */
+#define VISUALIZER_MIN_DB -120.0f
+/* copies a reader tries while the thread is publishing before giving up */
+#define VISUALIZER_READ_TRIES 4
+
+namespace ffplayer {
+
+typedef struct VisualizerFrame {
+    int64_t count;             // updates so far, 0 before the first one
+    int sample_rate;           // bin k is at k * sample_rate / VISUALIZER_FFT_SIZE Hz
+    float spectrum[VISUALIZER_BINS];   // dB of a full scale sine, the channels mixed down
+    float peaks[2 * VISUALIZER_PEAKS]; // min and max of each slice, -1 to 1, oldest first
+} VisualizerFrame;
+
+/* the recent samples of a player as the audio callback wrote them, and a
+ * thread turning them into a frame at a fixed rate. The audio callback only
+ * copies to a ring, the thread takes a snapshot of it without a lock and
+ * drops it if the callback wrote over it meanwhile. */
+typedef struct AudioVisualizer AudioVisualizer;
+
+/* with a thread updating rate times a second, none if rate is 0. NULL when
+ * out of memory. */
+AudioVisualizer *audio_visualizer_create(int channels, int rate);
+
+void audio_visualizer_destroy(AudioVisualizer *v);
+
+/* of a visualizer created with a thread */
+void audio_visualizer_set_rate(AudioVisualizer *v, int rate);
+
+/* the bytes a visualizer holds */
+size_t audio_visualizer_size();
+
+/* from the audio callback, nb_samples interleaved samples */
+void audio_visualizer_write(AudioVisualizer *v, const int16_t *samples, int nb_samples);
+
+/* what the thread does at each tick: compute a frame from the latest
+ * samples. Return 0 if none were written since the last one. */
+int audio_visualizer_update(AudioVisualizer *v);
+
+/* the latest frame, from any thread without waiting; sample_rate is left
+ * to the caller. Return 0 with a count of 0 if the thread kept publishing,
+ * then the caller keeps the frame it has. */
+int audio_visualizer_read(AudioVisualizer *v, VisualizerFrame *frame);
+
+}
+
+#endif //MYPLAYER_AUDIOVISUALIZER_H
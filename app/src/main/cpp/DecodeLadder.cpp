@@ -0,0 +1,153 @@
+#include "DecodeLadder.h"
+
+extern "C" {
+#include "libavutil/common.h"
+#include "libavutil/time.h"
+}
+
+#include <string.h>
+
+/* decoding takes this much of the frame duration: falling behind */
+#define LADDER_LOAD_HIGH 0.85
+/* and this much: clearly keeping up */
+#define LADDER_LOAD_LOW 0.5
+/* how long to be behind before going one level cheaper */
+#define LADDER_UP_DELAY 500000
+/* how long to be clearly ahead before trying one level better, doubled each
+ * time the better level does not hold */
+#define LADDER_DOWN_DELAY 5000000
+#define LADDER_DOWN_DELAY_MAX 60000000
+/* a level that did not hold for this long counts as a bounce */
+#define LADDER_BOUNCE_TIME 10000000
+#define LADDER_DECODE_TIME_WEIGHT 0.1
+
+namespace ffplayer {
+
+static const char *const level_names[DECODE_LEVEL_NB] = {
+        "full", "skip_loop_filter", "skip_nonref", "lowres", "keyframes"
+};
+
+const char *decode_level_name(int level) {
+    return level >= 0 && level < DECODE_LEVEL_NB ? level_names[level] : "unknown";
+}
+
+void decode_ladder_init(DecodeLadder *l, int max_lowres, double frame_duration) {
+    memset(l, 0, sizeof(*l));
+    l->max_lowres = FFMAX(max_lowres, 0);
+    l->frame_duration = frame_duration > 0 ? frame_duration : 1.0 / 25;
+    __atomic_store_n(&l->level_since, av_gettime_relative(), __ATOMIC_RELEASE);
+    l->down_delay = LADDER_DOWN_DELAY;
+}
+
+static int level_available(DecodeLadder *l, int level) {
+    return level != DECODE_LEVEL_LOWRES || l->max_lowres > 0;
+}
+
+static void decode_ladder_set_level(DecodeLadder *l, int level, int64_t now) {
+    l->stats.time_in_level[l->level] += now - l->level_since;
+    if (level > l->level) {
+        if (now - l->level_since < LADDER_BOUNCE_TIME)
+            l->down_delay = FFMIN(l->down_delay * 2, LADDER_DOWN_DELAY_MAX);
+        l->stats.nb_up++;
+    } else {
+        l->stats.nb_down++;
+    }
+    av_log(NULL, AV_LOG_INFO, "video decode level %s -> %s (load %.2f)\n",
+           decode_level_name(l->level), decode_level_name(level),
+           l->decode_time / l->frame_duration);
+    __atomic_store_n(&l->level, level, __ATOMIC_RELAXED);
+    __atomic_store_n(&l->level_since, now, __ATOMIC_RELAXED);
+    l->behind_since = 0;
+    l->ahead_since = 0;
+}
+
+int decode_ladder_update(DecodeLadder *l, double decode_time, int queued_frames, int drops) {
+    int64_t now = av_gettime_relative();
+    int new_drops = drops - l->last_drops;
+    double load;
+    int level;
+
+    l->last_drops = drops;
+    if (l->decode_time == 0)
+        l->decode_time = decode_time;
+    else
+        l->decode_time += (decode_time - l->decode_time) * LADDER_DECODE_TIME_WEIGHT;
+    load = l->decode_time / l->frame_duration;
+
+    if (load > LADDER_LOAD_HIGH || new_drops > 0) {
+        l->ahead_since = 0;
+        if (!l->behind_since)
+            l->behind_since = now;
+        if (now - l->behind_since >= LADDER_UP_DELAY
+            && now - l->level_since >= LADDER_UP_DELAY) {
+            for (level = l->level + 1; level < DECODE_LEVEL_NB; level++) {
+                if (level_available(l, level)) {
+                    decode_ladder_set_level(l, level, now);
+                    return 1;
+                }
+            }
+        }
+    } else if (load < LADDER_LOAD_LOW && queued_frames > 0) {
+        l->behind_since = 0;
+        if (!l->ahead_since)
+            l->ahead_since = now;
+        if (l->level > DECODE_LEVEL_FULL && now - l->ahead_since >= l->down_delay) {
+            for (level = l->level - 1; level > DECODE_LEVEL_FULL; level--)
+                if (level_available(l, level))
+                    break;
+            decode_ladder_set_level(l, level, now);
+            return 1;
+        }
+    } else {
+        l->behind_since = 0;
+        l->ahead_since = 0;
+    }
+
+    /* a level that holds earns back the short delay */
+    if (now - l->level_since >= LADDER_DOWN_DELAY_MAX)
+        l->down_delay = LADDER_DOWN_DELAY;
+    return 0;
+}
+
+int decode_ladder_level(DecodeLadder *l) {
+    return __atomic_load_n(&l->level, __ATOMIC_RELAXED);
+}
+
+int decode_ladder_lowres(DecodeLadder *l) {
+    return decode_ladder_level(l) >= DECODE_LEVEL_LOWRES ? FFMIN(l->max_lowres, 1) : 0;
+}
+
+static enum AVDiscard level_skip_frame(int level) {
+    if (level >= DECODE_LEVEL_KEYFRAMES)
+        return AVDISCARD_NONKEY;
+    if (level >= DECODE_LEVEL_SKIP_NONREF)
+        return AVDISCARD_NONREF;
+    return AVDISCARD_DEFAULT;
+}
+
+enum AVDiscard decode_ladder_skip_frame(DecodeLadder *l) {
+    return level_skip_frame(decode_ladder_level(l));
+}
+
+void decode_ladder_apply(DecodeLadder *l, AVCodecContext *avctx) {
+    int level = decode_ladder_level(l);
+
+    avctx->skip_loop_filter = level >= DECODE_LEVEL_SKIP_LOOP_FILTER ?
+                              AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    avctx->skip_frame = level_skip_frame(level);
+}
+
+void decode_ladder_get_stats(DecodeLadder *l, DecodeLadderStats *stats) {
+    int64_t level_since = __atomic_load_n(&l->level_since, __ATOMIC_ACQUIRE);
+    int level = decode_ladder_level(l);
+
+    memset(stats, 0, sizeof(*stats));
+    if (!level_since)
+        return;
+    *stats = l->stats;
+    stats->level = level;
+    stats->time_in_level[level] += FFMAX(av_gettime_relative() - level_since, 0);
+    stats->decode_load = l->decode_time / l->frame_duration;
+}
+
+}
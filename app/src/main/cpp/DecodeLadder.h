@@ -0,0 +1,65 @@
+#ifndef MYPLAYER_DECODELADDER_H
+#define MYPLAYER_DECODELADDER_H
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+}
+
+namespace ffplayer {
+
+/* cheaper and cheaper ways to decode the video, tried in this order */
+enum DecodeLevel {
+    DECODE_LEVEL_FULL = 0,
+    DECODE_LEVEL_SKIP_LOOP_FILTER,
+    DECODE_LEVEL_SKIP_NONREF,
+    DECODE_LEVEL_LOWRES,
+    DECODE_LEVEL_KEYFRAMES,
+    DECODE_LEVEL_NB
+};
+
+typedef struct DecodeLadderStats {
+    int level;
+    int nb_up;              // transitions to a cheaper level
+    int nb_down;            // transitions back to a better one
+    int64_t time_in_level[DECODE_LEVEL_NB]; // microseconds
+    double decode_load;     // decode time per frame / frame duration
+} DecodeLadderStats;
+
+/* watches how far the video decoding falls behind and picks the decode level */
+typedef struct DecodeLadder {
+    int level;              // written by the video thread only, read from any
+    int max_lowres;         // 0 if the codec cannot go any lower in resolution
+    double frame_duration;
+    double decode_time;     // moving average, seconds per frame
+    int last_drops;
+    int64_t behind_since;   // 0 while keeping up
+    int64_t ahead_since;    // 0 while not clearly ahead
+    int64_t level_since;    // 0 until the video thread initializes the ladder
+    int64_t down_delay;     // time clearly ahead before trying a better level
+    DecodeLadderStats stats;
+} DecodeLadder;
+
+void decode_ladder_init(DecodeLadder *l, int max_lowres, double frame_duration);
+
+/* feed one decoded frame. Return 1 if the level changed and has to be applied. */
+int decode_ladder_update(DecodeLadder *l, double decode_time, int queued_frames, int drops);
+
+/* the current level, from any thread */
+int decode_ladder_level(DecodeLadder *l);
+
+int decode_ladder_lowres(DecodeLadder *l);
+
+enum AVDiscard decode_ladder_skip_frame(DecodeLadder *l);
+
+/* set the skip options of the level on avctx, lowres is left to the caller
+ * since it needs the codec reopened */
+void decode_ladder_apply(DecodeLadder *l, AVCodecContext *avctx);
+
+/* all zero before the ladder is initialized, as for a file without video */
+void decode_ladder_get_stats(DecodeLadder *l, DecodeLadderStats *stats);
+
+const char *decode_level_name(int level);
+
+}
+
+#endif //MYPLAYER_DECODELADDER_H
@@ -0,0 +1,206 @@
+#include "Executor.h"
+
+extern "C" {
+#include "libavutil/common.h"
+#include "libavutil/cpu.h"
+}
+
+#include <string.h>
+
+namespace ffplayer {
+
+static Executor executor;
+static pthread_once_t executor_once = PTHREAD_ONCE_INIT;
+
+/* a goes before b */
+static inline int task_before(const ExecutorTask *a, const ExecutorTask *b) {
+    if (a->job->priority != b->job->priority)
+        return a->job->priority > b->job->priority;
+    return a->job->deadline < b->job->deadline;
+}
+
+/* the queue is kept with the best task last, ties in submission order */
+static int worker_push(ExecutorWorker *w, ExecutorJob *job, int index) {
+    ExecutorTask t = {job, index};
+    int i;
+
+    pthread_mutex_lock(&w->mutex);
+    if (w->nb_tasks == EXECUTOR_QUEUE_SIZE) {
+        pthread_mutex_unlock(&w->mutex);
+        return -1;
+    }
+    for (i = w->nb_tasks; i > 0 && !task_before(&t, &w->tasks[i - 1]); i--)
+        w->tasks[i] = w->tasks[i - 1];
+    w->tasks[i] = t;
+    w->nb_tasks++;
+    pthread_mutex_unlock(&w->mutex);
+    return 0;
+}
+
+static int worker_pop(ExecutorWorker *w, ExecutorTask *t) {
+    int ret = 0;
+
+    pthread_mutex_lock(&w->mutex);
+    if (w->nb_tasks > 0) {
+        *t = w->tasks[--w->nb_tasks];
+        ret = 1;
+    }
+    pthread_mutex_unlock(&w->mutex);
+    return ret;
+}
+
+/* the best task of worker self, or else of the next worker that has one */
+static int executor_take(Executor *e, int self, ExecutorTask *t) {
+    int i;
+
+    for (i = 0; i < e->nb_workers; i++) {
+        if (worker_pop(&e->workers[(self + i) % e->nb_workers], t)) {
+            pthread_mutex_lock(&e->mutex);
+            e->nb_queued--;
+            pthread_mutex_unlock(&e->mutex);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void job_done(ExecutorJob *job) {
+    pthread_mutex_lock(&job->mutex);
+    if (!--job->nb_pending)
+        pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+static void task_run(ExecutorTask *t) {
+    t->job->func(t->job->arg, t->index);
+    job_done(t->job);
+}
+
+static void *executor_worker(void *arg) {
+    ExecutorWorker *w = (ExecutorWorker *) arg;
+    Executor *e = &executor;
+    int self = (int) (w - e->workers);
+    ExecutorTask t;
+
+    for (;;) {
+        if (executor_take(e, self, &t)) {
+            task_run(&t);
+            continue;
+        }
+        pthread_mutex_lock(&e->mutex);
+        while (e->nb_queued <= 0)
+            pthread_cond_wait(&e->cond, &e->mutex);
+        pthread_mutex_unlock(&e->mutex);
+    }
+    return NULL;
+}
+
+static void executor_init() {
+    Executor *e = &executor;
+    int i;
+
+    memset(e, 0, sizeof(*e));
+    pthread_mutex_init(&e->mutex, NULL);
+    pthread_cond_init(&e->cond, NULL);
+    e->nb_workers = av_clip(av_cpu_count(), 1, EXECUTOR_MAX_WORKERS);
+    for (i = 0; i < e->nb_workers; i++) {
+        ExecutorWorker *w = &e->workers[i];
+        pthread_mutex_init(&w->mutex, NULL);
+        if (pthread_create(&w->tid, NULL, executor_worker, w))
+            break;
+        pthread_setname_np(w->tid, "executor");
+    }
+    e->nb_workers = FFMAX(i, 1);
+}
+
+Executor *executor_get() {
+    pthread_once(&executor_once, executor_init);
+    return &executor;
+}
+
+void executor_run(Executor *e, ExecutorFunc func, void *arg, int nb_tasks,
+                  int priority, int64_t deadline) {
+    ExecutorJob job;
+    int i, w;
+
+    if (nb_tasks <= 1) {
+        if (nb_tasks == 1)
+            func(arg, 0);
+        return;
+    }
+
+    job.func = func;
+    job.arg = arg;
+    job.priority = priority;
+    job.deadline = deadline;
+    job.nb_pending = nb_tasks;
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    for (i = 1; i < nb_tasks; i++) {
+        pthread_mutex_lock(&e->mutex);
+        w = e->next_worker;
+        e->next_worker = (e->next_worker + 1) % e->nb_workers;
+        pthread_mutex_unlock(&e->mutex);
+        if (worker_push(&e->workers[w], &job, i) < 0) {
+            /* all full, do it here */
+            func(arg, i);
+            job_done(&job);
+            continue;
+        }
+        pthread_mutex_lock(&e->mutex);
+        e->nb_queued++;
+        pthread_cond_signal(&e->cond);
+        pthread_mutex_unlock(&e->mutex);
+    }
+
+    /* the caller does its share instead of just waiting */
+    func(arg, 0);
+    job_done(&job);
+
+    pthread_mutex_lock(&job.mutex);
+    while (job.nb_pending)
+        pthread_cond_wait(&job.cond, &job.mutex);
+    pthread_mutex_unlock(&job.mutex);
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.mutex);
+}
+
+void executor_player_add(Executor *e, int focused) {
+    pthread_mutex_lock(&e->mutex);
+    e->nb_players++;
+    if (focused)
+        e->nb_focused++;
+    pthread_mutex_unlock(&e->mutex);
+}
+
+void executor_player_remove(Executor *e, int focused) {
+    pthread_mutex_lock(&e->mutex);
+    e->nb_players--;
+    if (focused)
+        e->nb_focused--;
+    pthread_mutex_unlock(&e->mutex);
+}
+
+void executor_player_focus(Executor *e, int was_focused, int focused) {
+    pthread_mutex_lock(&e->mutex);
+    e->nb_focused += !!focused - !!was_focused;
+    pthread_mutex_unlock(&e->mutex);
+}
+
+int executor_codec_threads(Executor *e, int focused) {
+    int nb_players, nb_focused;
+
+    pthread_mutex_lock(&e->mutex);
+    nb_players = FFMAX(e->nb_players, 1);
+    nb_focused = FFMAX(e->nb_focused, 1);
+    pthread_mutex_unlock(&e->mutex);
+
+    /* the focused players share the cores, the others get one thread each
+     * unless there are few of them */
+    if (focused)
+        return FFMAX(e->nb_workers / nb_focused, 1);
+    return FFMAX(e->nb_workers / nb_players, 1);
+}
+
+}
@@ -0,0 +1,77 @@
+#ifndef MYPLAYER_EXECUTOR_H
+#define MYPLAYER_EXECUTOR_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define EXECUTOR_MAX_WORKERS 16
+/* tasks waiting on one worker */
+#define EXECUTOR_QUEUE_SIZE 256
+
+/* the player on screen, its tasks go before the others */
+#define EXECUTOR_PRIORITY_FOCUSED 1
+#define EXECUTOR_PRIORITY_BACKGROUND 0
+
+namespace ffplayer {
+
+typedef void (*ExecutorFunc)(void *arg, int index);
+
+/* the tasks of one executor_run call, which waits for them all */
+typedef struct ExecutorJob {
+    ExecutorFunc func;
+    void *arg;
+    int priority;
+    int64_t deadline;       // av_gettime_relative() the result is needed by
+    int nb_pending;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} ExecutorJob;
+
+typedef struct ExecutorTask {
+    ExecutorJob *job;
+    int index;
+} ExecutorTask;
+
+/* tasks sorted by priority then deadline, the best first */
+typedef struct ExecutorWorker {
+    ExecutorTask tasks[EXECUTOR_QUEUE_SIZE];
+    int nb_tasks;
+    pthread_mutex_t mutex;
+    pthread_t tid;
+} ExecutorWorker;
+
+/* one pool of threads, one per core, for the CPU work of all the players. A
+ * worker runs the best task of its own queue, or steals the best one of
+ * another queue when its own is empty. */
+typedef struct Executor {
+    ExecutorWorker workers[EXECUTOR_MAX_WORKERS];
+    int nb_workers;
+    int next_worker;        // where the next task is queued
+    int nb_queued;          // over all the workers
+    int nb_players;
+    int nb_focused;
+    pthread_mutex_t mutex;  // nb_queued, nb_players, next_worker
+    pthread_cond_t cond;    // a task was queued
+} Executor;
+
+/* the executor of the process, started on first use */
+Executor *executor_get();
+
+/* run func(arg, 0) to func(arg, nb_tasks - 1) on the pool and return when they
+ * are all done. The calling thread runs tasks too while it waits. */
+void executor_run(Executor *e, ExecutorFunc func, void *arg, int nb_tasks,
+                  int priority, int64_t deadline);
+
+void executor_player_add(Executor *e, int focused);
+
+void executor_player_remove(Executor *e, int focused);
+
+void executor_player_focus(Executor *e, int was_focused, int focused);
+
+/* codec threads for a decoder of a player, so that all the players together
+ * do not start many more threads than there are cores */
+int executor_codec_threads(Executor *e, int focused);
+
+}
+
+#endif //MYPLAYER_EXECUTOR_H
@@ -3,6 +3,7 @@
 //
 #include "log.h"
 #include "FFPlayer.h"
+#include <sys/time.h>
 #include <unistd.h>
 
 #define ANDROID_AUDIO_CHANNELS 2
@@ -39,14 +40,20 @@
 
 /* polls for possible required screen refresh at least this often, should be less than 1/fps */
 #define REFRESH_RATE 0.01
-
-/* NOTE: the size must be big enough to compensate the hardware audio buffersize size */
-/* TODO: We assume that a decoded and resampled frame fits into this buffer */
-#define SAMPLE_ARRAY_SIZE (8 * 65536)
+/* until the first frame of a fast start is shown */
+#define FAST_START_REFRESH_RATE 0.002
+/* the longest the display holds virtual time back waiting for a picture, in us */
+#define DATA_WAIT_MAX 1000000
 
 #define CURSOR_HIDE_DELAY 1000000
 
-static unsigned sws_flags = SWS_BICUBIC;
+/* frames this much before an exact seek target are only decoded into the frame cache */
+#define FRAME_SEEK_MARGIN 0.001
+
+/* wall clock time each keyframe is shown for in trick-play */
+#define TRICK_PLAY_FRAME_DURATION 0.25
+/* keyframes read ahead in trick-play, few so that direction changes show at once */
+#define TRICK_PLAY_QUEUE_PACKETS 2
 
 using namespace ffplayer;
 
@@ -61,49 +68,147 @@ typedef struct SDL_Rect {
     int w, h;
 } SDL_Rect;
 
-/* options specified by the user */
-static AVInputFormat *file_iformat;
-static const char *input_filename;
-static const char *window_title;
-static int fs_screen_width;
-static int fs_screen_height;
-static int default_width = 640;
-static int default_height = 480;
-static int screen_width = 0;
-static int screen_height = 0;
-static int audio_disable;
-static int video_disable;
-static int subtitle_disable;
-static const char *wanted_stream_spec[AVMEDIA_TYPE_NB] = {0};
-static int seek_by_bytes = -1;
-static int display_disable;
-static int show_status = 1;
-static int av_sync_type = AV_SYNC_AUDIO_MASTER;
-static int64_t start_time = AV_NOPTS_VALUE;
-static int64_t duration = AV_NOPTS_VALUE;
-static int fast = 0;
-static int genpts = 0;
-static int lowres = 0;
-static int decoder_reorder_pts = -1;
-static int autoexit;
-static int loop = 1;
-static int framedrop = -1;
-static int infinite_buffer = -1;
-static enum VideoState::ShowMode show_mode = VideoState::SHOW_MODE_VIDEO;
-static const char *audio_codec_name;
-static const char *subtitle_codec_name;
-static const char *video_codec_name;
-static int autorotate = 1;
-
-/* current context */
-static int is_full_screen;
-static int64_t audio_callback_time;
+/* the defaults of the options specified by the user */
+static void player_options_init(PlayerOptions *o) {
+    memset(o, 0, sizeof(*o));
+    o->default_width = 640;
+    o->default_height = 480;
+    o->seek_by_bytes = -1;
+    o->show_status = 1;
+    o->av_sync_type = AV_SYNC_AUDIO_MASTER;
+    o->start_time = AV_NOPTS_VALUE;
+    o->duration = AV_NOPTS_VALUE;
+    o->auto_lowres = 1;
+    o->decoder_reorder_pts = -1;
+    o->loop = 1;
+    o->loop_a = AV_NOPTS_VALUE;
+    o->loop_b = AV_NOPTS_VALUE;
+    o->framedrop = -1;
+    o->infinite_buffer = -1;
+    o->back_buffer_size = 8 * 1024 * 1024;
+    o->back_buffer_duration = 15.0;
+    o->frame_cache_size = 32 * 1024 * 1024;
+    o->reverse_buffer_size = 64 * 1024 * 1024;
+    o->subtitle_index = 1;
+    o->focused = 1;
+    o->show_mode = VideoState::SHOW_MODE_VIDEO;
+    o->autorotate = 1;
+    o->sws_flags = SWS_BICUBIC;
+}
 
+/* shared by all the players, only written once by init_ffmpeg */
 static AVPacket flush_pkt;
 
 #define FF_ALLOC_EVENT   1
 #define FF_QUIT_EVENT   2
+#define FF_START_EVENT   3
+#define FF_PAUSE_EVENT   4
+#define FF_STEP_EVENT   5
+#define FF_STEP_BACK_EVENT   6
+#define FF_SUBTITLE_TRACK_EVENT   7
+#define FF_PROMOTE_EVENT   8
+#define FF_SHOW_MODE_EVENT   9
+#define FF_VISUALIZER_EVENT   10
+
+
+static int64_t packet_ts(const AVPacket *pkt) {
+    return pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+}
+
+/* the timestamp the demuxer indexes a packet by */
+static int64_t packet_index_ts(const AVPacket *pkt) {
+    return pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+}
+
+/* the bytes a queued packet holds */
+static int packet_list_size(MyAVPacketList *pkt1) {
+    return pkt1->pkt.size + (int) sizeof(*pkt1);
+}
+
+static void packet_history_resize(PacketHistory *h, int bytes) {
+    h->size += bytes;
+    memory_account_add(h->mem, MEMORY_BACK_BUFFER, bytes);
+}
+
+static void packet_queue_resize(PacketQueue *q, int bytes) {
+    q->size += bytes;
+    memory_account_add(q->mem, MEMORY_PACKETS, bytes);
+}
+
+static void packet_history_drop_first(PacketHistory *h) {
+    MyAVPacketList *pkt1 = h->first_pkt;
+
+    h->first_pkt = pkt1->next;
+    if (!h->first_pkt)
+        h->last_pkt = NULL;
+    h->nb_packets--;
+    packet_history_resize(h, -packet_list_size(pkt1));
+    av_packet_unref(&pkt1->pkt);
+    av_free(pkt1);
+}
+
+static double packet_history_duration(PacketHistory *h) {
+    int64_t first, last;
 
+    if (!h->first_pkt)
+        return 0.0;
+    first = packet_ts(&h->first_pkt->pkt);
+    last = packet_ts(&h->last_pkt->pkt);
+    if (first == AV_NOPTS_VALUE || last == AV_NOPTS_VALUE)
+        return 0.0;
+    return (last - first) * av_q2d(h->time_base);
+}
+
+static void packet_history_trim(PacketHistory *h) {
+    while (h->first_pkt
+           && (h->size > h->max_size
+               || packet_history_duration(h) > h->max_duration))
+        packet_history_drop_first(h);
+}
+
+/* keep a reference to a packet the decoder just took, return 0 if it was not kept */
+static int packet_history_append(PacketQueue *q, MyAVPacketList *pkt1) {
+    PacketHistory *h = &q->history;
+    AVPacket ref;
+
+    if (h->max_size <= 0 || !pkt1->pkt.data || pkt1->pkt.data == flush_pkt.data
+        || pkt1->serial != q->serial)
+        return 0;
+    if (av_packet_ref(&ref, &pkt1->pkt) < 0)
+        return 0;
+    /* the dts went back, as at a loop wrap where the frames before the loop
+     * start come again: what is kept does not lead up to this packet */
+    if (h->last_pkt && ref.dts != AV_NOPTS_VALUE && h->last_pkt->pkt.dts != AV_NOPTS_VALUE
+        && ref.dts < h->last_pkt->pkt.dts) {
+        while (h->first_pkt)
+            packet_history_drop_first(h);
+    }
+    pkt1->pkt = ref;
+    pkt1->next = NULL;
+    if (!h->last_pkt)
+        h->first_pkt = pkt1;
+    else
+        h->last_pkt->next = pkt1;
+    h->last_pkt = pkt1;
+    h->nb_packets++;
+    packet_history_resize(h, packet_list_size(pkt1));
+    packet_history_trim(h);
+    return 1;
+}
+
+/* return the last kept packet at or before ts, NULL if the history does not reach back that far */
+static MyAVPacketList *packet_history_find(PacketHistory *h, int64_t ts, int key_only) {
+    MyAVPacketList *pkt1, *found = NULL;
+
+    for (pkt1 = h->first_pkt; pkt1; pkt1 = pkt1->next) {
+        int64_t pkt_ts = packet_ts(&pkt1->pkt);
+        if (pkt_ts == AV_NOPTS_VALUE || pkt_ts > ts
+            || (key_only && !(pkt1->pkt.flags & AV_PKT_FLAG_KEY)))
+            continue;
+        found = pkt1;
+    }
+    return found;
+}
 
 static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt) {
     MyAVPacketList *pkt1;
@@ -126,7 +231,7 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt) {
         q->last_pkt->next = pkt1;
     q->last_pkt = pkt1;
     q->nb_packets++;
-    q->size += pkt1->pkt.size + sizeof(*pkt1);
+    packet_queue_resize(q, packet_list_size(pkt1));
     /* XXX: should duplicate packet data in DV case */
     pthread_cond_signal(&q->cond);
     return 0;
@@ -159,8 +264,26 @@ static int packet_queue_put_nullpacket(PacketQueue *q, int stream_index) {
 }
 
 /* packet queue handling */
-static void packet_queue_init(PacketQueue *q) {
+/* seconds from the first packet queued to the end of the last one */
+static double packet_queue_duration(PacketQueue *q, AVRational time_base) {
+    int64_t first, last;
+    double duration = 0;
+
+    pthread_mutex_lock(&q->mutex);
+    if (q->first_pkt && q->last_pkt) {
+        first = packet_ts(&q->first_pkt->pkt);
+        last = packet_ts(&q->last_pkt->pkt);
+        if (first != AV_NOPTS_VALUE && last != AV_NOPTS_VALUE && last >= first)
+            duration = (last - first + q->last_pkt->pkt.duration) * av_q2d(time_base);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return duration;
+}
+
+static void packet_queue_init(PacketQueue *q, MemoryAccount *mem) {
     memset(q, 0, sizeof(PacketQueue));
+    q->mem = mem;
+    q->history.mem = mem;
     q->mutex = PTHREAD_MUTEX_INITIALIZER;
     q->cond = PTHREAD_COND_INITIALIZER;
     q->abort_request = 1;
@@ -178,7 +301,9 @@ static void packet_queue_flush(PacketQueue *q) {
     q->last_pkt = NULL;
     q->first_pkt = NULL;
     q->nb_packets = 0;
-    q->size = 0;
+    packet_queue_resize(q, -q->size);
+    while (q->history.first_pkt)
+        packet_history_drop_first(&q->history);
     pthread_mutex_unlock(&q->mutex);
 }
 
@@ -225,11 +350,12 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block,
             if (!q->first_pkt)
                 q->last_pkt = NULL;
             q->nb_packets--;
-            q->size -= pkt1->pkt.size + sizeof(*pkt1);
+            packet_queue_resize(q, -packet_list_size(pkt1));
             *pkt = pkt1->pkt;
             if (serial)
                 *serial = pkt1->serial;
-            av_free(pkt1);
+            if (!packet_history_append(q, pkt1))
+                av_free(pkt1);
             ret = 1;
             break;
         } else if (!block) {
@@ -243,6 +369,45 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block,
     return ret;
 }
 
+/* put the kept packets from pkt onwards back in front of the pending ones, under a new serial.
+ * Must be called with the queue mutex held. */
+static int packet_queue_rewind_private(PacketQueue *q, MyAVPacketList *from) {
+    PacketHistory *h = &q->history;
+    MyAVPacketList *flush, *pkt1, *prev = NULL;
+
+    flush = (MyAVPacketList *) av_malloc(sizeof(MyAVPacketList));
+    if (!flush)
+        return -1;
+    for (pkt1 = h->first_pkt; pkt1 != from; pkt1 = pkt1->next)
+        prev = pkt1;
+    for (pkt1 = from; pkt1; pkt1 = pkt1->next) {
+        h->nb_packets--;
+        packet_history_resize(h, -packet_list_size(pkt1));
+        q->nb_packets++;
+        packet_queue_resize(q, packet_list_size(pkt1));
+    }
+
+    h->last_pkt->next = q->first_pkt;
+    if (!q->last_pkt)
+        q->last_pkt = h->last_pkt;
+    if (prev)
+        prev->next = NULL;
+    else
+        h->first_pkt = NULL;
+    h->last_pkt = prev;
+
+    flush->pkt = flush_pkt;
+    flush->next = from;
+    q->first_pkt = flush;
+    q->nb_packets++;
+    packet_queue_resize(q, packet_list_size(flush));
+    q->serial++;
+    for (pkt1 = flush; pkt1; pkt1 = pkt1->next)
+        pkt1->serial = q->serial;
+    pthread_cond_signal(&q->cond);
+    return 0;
+}
+
 static void decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue,
                          pthread_cond_t *empty_queue_cond) {
     memset(d, 0, sizeof(Decoder));
@@ -250,6 +415,7 @@ static void decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue,
     d->queue = queue;
     d->empty_queue_cond = *empty_queue_cond;
     d->start_pts = AV_NOPTS_VALUE;
+    d->reorder_pts = -1;
 }
 
 static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
@@ -281,14 +447,15 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
             d->packet_pending = 1;
         }
 
+        int64_t decode_start = av_gettime_relative(), decode_end;
         switch (d->avctx->codec_type) {
             case AVMEDIA_TYPE_VIDEO:
                 ret = avcodec_decode_video2(d->avctx, frame, &got_frame,
                                             &d->pkt_temp);
                 if (got_frame) {
-                    if (decoder_reorder_pts == -1) {
+                    if (d->reorder_pts == -1) {
                         frame->pts = av_frame_get_best_effort_timestamp(frame);
-                    } else if (decoder_reorder_pts) {
+                    } else if (d->reorder_pts) {
                         frame->pts = frame->pkt_pts;
                     } else {
                         frame->pts = frame->pkt_dts;
@@ -319,6 +486,11 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                                                &d->pkt_temp);
                 break;
         }
+        decode_end = av_gettime_relative();
+        d->decode_time += decode_end - decode_start;
+        trace_span(d->avctx->codec_type == AVMEDIA_TYPE_VIDEO ? "decode video"
+                   : d->avctx->codec_type == AVMEDIA_TYPE_AUDIO ? "decode audio"
+                   : "decode subtitle", decode_start, decode_end);
 
         if (ret < 0) {
             d->packet_pending = 0;
@@ -347,9 +519,11 @@ static void decoder_destroy(Decoder *d) {
     av_free_packet(&d->pkt);
 }
 
-static void frame_queue_unref_item(Frame *vp) {
+static void frame_queue_unref_item(FrameQueue *f, Frame *vp) {
     av_frame_unref(vp->frame);
     avsubtitle_free(&vp->sub);
+    memory_account_add(f->pktq->mem, MEMORY_SUBTITLES, -(int64_t) vp->overlay.size);
+    subtitle_overlay_free(&vp->overlay);
 }
 
 static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size,
@@ -368,7 +542,12 @@ static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size,
     return 0;
 }
 
-static void free_picture(Frame *vp) {
+static int rgba_picture_size(Frame *vp) {
+    return vp->pFrameRGBA && vp->pFrameRGBA->buf[0] ? vp->pFrameRGBA->buf[0]->size : 0;
+}
+
+static void free_picture(MemoryAccount *mem, Frame *vp) {
+    memory_account_add(mem, MEMORY_PICTURES, -rgba_picture_size(vp));
     av_frame_free(&vp->pFrameRGBA);
 }
 
@@ -376,9 +555,9 @@ static void frame_queue_destory(FrameQueue *f) {
     int i;
     for (i = 0; i < f->max_size; i++) {
         Frame *vp = &f->queue[i];
-        frame_queue_unref_item(vp);
+        frame_queue_unref_item(f, vp);
         av_frame_free(&vp->frame);
-        free_picture(vp);
+        free_picture(f->pktq->mem, vp);
     }
     pthread_mutex_destroy(&f->mutex);
     pthread_cond_destroy(&f->cond);
@@ -430,6 +609,22 @@ static Frame *frame_queue_peek_readable(FrameQueue *f) {
     return &f->queue[(f->rindex + f->rindex_shown) % f->max_size];
 }
 
+/* wait at most timeout seconds for a frame to be queued */
+static void frame_queue_wait(FrameQueue *f, double timeout) {
+    struct timeval now;
+    struct timespec abstime;
+    int64_t until;
+
+    gettimeofday(&now, NULL);
+    until = now.tv_sec * 1000000LL + now.tv_usec + (int64_t) (timeout * 1000000.0);
+    abstime.tv_sec = until / 1000000;
+    abstime.tv_nsec = until % 1000000 * 1000;
+    pthread_mutex_lock(&f->mutex);
+    if (f->size - f->rindex_shown <= 0 && !f->pktq->abort_request)
+        pthread_cond_timedwait(&f->cond, &f->mutex, &abstime);
+    pthread_mutex_unlock(&f->mutex);
+}
+
 static void frame_queue_push(FrameQueue *f) {
     if (++f->windex == f->max_size)
         f->windex = 0;
@@ -444,7 +639,7 @@ static void frame_queue_next(FrameQueue *f) {
         f->rindex_shown = 1;
         return;
     }
-    frame_queue_unref_item(&f->queue[f->rindex]);
+    frame_queue_unref_item(f, &f->queue[f->rindex]);
     if (++f->rindex == f->max_size)
         f->rindex = 0;
     pthread_mutex_lock(&f->mutex);
@@ -512,59 +707,170 @@ static void calculate_display_rect(SDL_Rect *rect, int scr_xleft, int scr_ytop,
     rect->h = FFMAX(height, 1);
 }
 
+static void display_picture(VideoState *is, Frame *vp);
+
+/* the subtitle shown over vp, if any */
+static Frame *subtitle_to_display(VideoState *is, Frame *vp) {
+    Frame *sp;
+
+    if (!is->subtitle_st || frame_queue_nb_remaining(&is->subpq) <= 0)
+        return NULL;
+    sp = frame_queue_peek(&is->subpq);
+    if (sp->serial != is->subtitleq.serial
+        || vp->pts < sp->pts + ((float) sp->sub.start_display_time / 1000)
+        || vp->pts > sp->pts + ((float) sp->sub.end_display_time / 1000))
+        return NULL;
+    return sp;
+}
+
 static void video_image_display(VideoState *is) {
     ALOGD("video_image_display");
+    TRACE_SCOPE("display");
     Frame *vp;
-    Frame *sp;
     SDL_Rect rect;
 
     vp = frame_queue_peek(&is->pictq);
-    if (is->subtitle_st) {
-        if (frame_queue_nb_remaining(&is->subpq) > 0) {
-            sp = frame_queue_peek(&is->subpq);
 
-            if (vp->pts
-                >= sp->pts
-                   + ((float) sp->sub.start_display_time / 1000)) {
-                // TODO draw subtitle
-            }
+    calculate_display_rect(&rect, is->xleft, is->ytop, is->width,
+                           is->height, vp->width, vp->height, vp->sar);
+
+    display_picture(is, vp);
+}
+
+static void build_overlay(VideoState *is, SubtitleOverlay *o, const AVSubtitle *sub,
+                          int sub_width, int sub_height, int width, int height) {
+    memory_account_add(&is->mem, MEMORY_SUBTITLES, -(int64_t) o->size);
+    subtitle_overlay_build(o, sub, sub_width, sub_height, width, height, &is->sub_scalers);
+    memory_account_add(&is->mem, MEMORY_SUBTITLES, o->size);
+}
+
+/* the overlay of an event is converted the first time it is shown and then
+ * reused until the event ends, or the picture size changes */
+static void draw_subtitle(VideoState *is, Frame *vp, uint8_t *dst, int dst_linesize) {
+    SubtitleTrack *track;
+    SubtitleEvent *ev;
+    Frame *sp;
+
+    /* the index has the cue of any time, even right after a seek or a track switch */
+    if (is->subtitle_stream >= 0 && !is->loop_offset
+        && (track = subtitle_index_track(&is->sub_index, is->subtitle_stream))) {
+        if (!(ev = subtitle_track_find(track, vp->pts)))
+            return;
+        if (ev != is->sub_index_event || is->sub_index_overlay.width != vp->width
+            || is->sub_index_overlay.height != vp->height) {
+            AVSubtitle sub;
+
+            /* an event that does not decode again shows nothing */
+            subtitle_track_decode(track, ev, &sub);
+            build_overlay(is, &is->sub_index_overlay, &sub,
+                          track->width ? track->width : is->video_full_width,
+                          track->height ? track->height : is->video_full_height,
+                          vp->width, vp->height);
+            avsubtitle_free(&sub);
+            is->sub_index_event = ev;
         }
+        subtitle_overlay_blend(&is->sub_index_overlay, dst, dst_linesize);
+        return;
     }
 
-    calculate_display_rect(&rect, is->xleft, is->ytop, is->width,
-                           is->height, vp->width, vp->height, vp->sar);
+    if (!(sp = subtitle_to_display(is, vp)))
+        return;
+    if (sp->overlay.width != vp->width || sp->overlay.height != vp->height) {
+        int sub_width = is->subdec.avctx->width ? is->subdec.avctx->width : is->video_full_width;
+        int sub_height = is->subdec.avctx->height ? is->subdec.avctx->height : is->video_full_height;
+        build_overlay(is, &sp->overlay, &sp->sub, sub_width, sub_height, vp->width, vp->height);
+    }
+    subtitle_overlay_blend(&sp->overlay, dst, dst_linesize);
+}
+
+static void startup_mark(VideoState *is, int phase) {
+    StartupReport *r = &is->startup;
+
+    if (!startup_report_mark(r, phase))
+        return;
+    /* report once the first picture and the first samples are out. They are
+     * marked on two threads: at least one sees both, and if both do the claim
+     * picks one */
+    if ((phase == STARTUP_FIRST_DISPLAY || phase == STARTUP_FIRST_AUDIO)
+        && (!is->video_st || startup_report_time(r, STARTUP_FIRST_DISPLAY))
+        && (!is->audio_st || startup_report_time(r, STARTUP_FIRST_AUDIO))
+        && startup_report_claim(r))
+        startup_report_log(r);
+}
+
+static void display_picture(VideoState *is, Frame *vp) {
+    VideoSinkBuffer windowBuffer;
+    int64_t trace_time;
+    int error;
 
-    ANativeWindow_Buffer windowBuffer;
-    int error = ANativeWindow_lock(is->window, &windowBuffer, NULL);
+    /* pictures decoded at a lower resolution are scaled up by the compositor */
+    if (vp->width != is->buffers_width || vp->height != is->buffers_height) {
+        is->video_sink->setBuffersGeometry(vp->width, vp->height);
+        is->buffers_width = vp->width;
+        is->buffers_height = vp->height;
+    }
+
+    trace_time = trace_begin();
+    error = is->video_sink->lock(&windowBuffer);
+    trace_end("window lock", trace_time);
     if (error != 0) {
-        ALOGE("ANativeWindow_lock error=%d", error);
+        ALOGE("video sink lock error=%d", error);
         return;
     }
 
     // 获取stride
-    uint8_t *dst = (uint8_t *) windowBuffer.bits;
-    int dstStride = windowBuffer.stride * 4;
+    uint8_t *dst = windowBuffer.bits;
+    int dstStride = windowBuffer.stride;
     uint8_t *src = (uint8_t *) (vp->pFrameRGBA->data[0]);
     int srcStride = vp->pFrameRGBA->linesize[0];
 
     // 由于window的stride和帧的stride不同,因此需要逐行复制
     int h;
-    for (h = 0; h < vp->height; h++) {
-        memcpy(dst + h * dstStride, src + h * srcStride, srcStride);
+    int height = FFMIN(vp->height, windowBuffer.height);
+    int lineSize = FFMIN(FFMIN(srcStride, dstStride), vp->width * 4);
+    for (h = 0; h < height; h++) {
+        memcpy(dst + h * dstStride, src + h * srcStride, lineSize);
     }
-
-    ANativeWindow_unlockAndPost(is->window);
-
+    if (windowBuffer.width >= vp->width && windowBuffer.height >= vp->height)
+        draw_subtitle(is, vp, dst, dstStride);
+
+    trace_time = trace_begin();
+    is->video_sink->unlockAndPost(vp->pts);
+    trace_end("window post", trace_time);
+    is->frames_displayed++;
+    startup_mark(is, STARTUP_FIRST_DISPLAY);
 }
 
 static inline int compute_mod(int a, int b) {
     return a < 0 ? a % b + b : a % b;
 }
 
+static void visualizer_free(VideoState *is) {
+    AudioVisualizer *visualizer;
+    uint32_t seq;
+
+    pthread_mutex_lock(&is->visualizer_mutex);
+    visualizer = __atomic_exchange_n(&is->visualizer, (AudioVisualizer *) NULL, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&is->visualizer_mutex);
+    if (!visualizer)
+        return;
+    /* an audio callback running now may still write to it */
+    seq = __atomic_load_n(&is->audio_callback_seq, __ATOMIC_SEQ_CST);
+    while ((seq & 1) && __atomic_load_n(&is->audio_callback_seq, __ATOMIC_SEQ_CST) == seq)
+        av_usleep(1000);
+    audio_visualizer_destroy(visualizer);
+    memory_account_add(&is->mem, MEMORY_AUDIO, -(int64_t) audio_visualizer_size());
+}
+
+static void loop_preroll_free(VideoState *is);
+
 static void stream_close(VideoState *is) {
+    int i;
+
     /* XXX: use a special url_shutdown call to abort parse cleanly */
     is->abort_request = 1;
     pthread_join(is->read_tid, NULL);
+    memory_account_log(&is->mem);
     packet_queue_destroy(&is->videoq);
     packet_queue_destroy(&is->audioq);
     packet_queue_destroy(&is->subtitleq);
@@ -575,23 +881,35 @@ static void stream_close(VideoState *is) {
     frame_queue_destory(&is->subpq);
     pthread_cond_destroy(&is->continue_read_thread);
     sws_freeContext(is->img_convert_ctx);
-    sws_freeContext(is->sub_convert_ctx);
+    for (i = 0; i < CONVERT_BANDS_MAX; i++)
+        sws_freeContext(is->band_convert_ctx[i]);
+    executor_player_remove(executor_get(), is->executor_focused);
+    subtitle_scalers_free(&is->sub_scalers);
+    sws_freeContext(is->step_convert_ctx);
+    subtitle_index_close(&is->sub_index);
+    subtitle_overlay_free(&is->sub_index_overlay);
+    av_free(is->window_title);
+    visualizer_free(is);
+    pthread_mutex_destroy(&is->visualizer_mutex);
+    loop_preroll_free(is);
+    av_free(is->loop_preroll);
+    frame_cache_destroy(&is->frame_cache);
+    av_frame_free(&is->step_frame.frame);
+    free_picture(&is->mem, &is->step_frame);
     delete (is->messageQueue);
     av_free(is);
 }
 
 static void do_exit(VideoState *is) {
     ALOGV("do_exit");
-    FFPlayer *player;
+    FFPlayer *player = NULL;
+    /* stream_close frees is, and the player owns the options it points at:
+     * take what is needed before */
     if (is) {
         player = is->player;
         stream_close(is);
     }
 
-    av_lockmgr_register(NULL);
-    avformat_network_deinit();
-    if (show_status)
-        printf("\n");
     av_log(NULL, AV_LOG_QUIET, "%s", "");
     delete (player);
 }
@@ -600,28 +918,28 @@ static void sigterm_handler(int sig) {
     exit(123);
 }
 
-static void set_default_window_size(int width, int height, AVRational sar) {
+static void set_default_window_size(VideoState *is, int width, int height, AVRational sar) {
     SDL_Rect rect;
     calculate_display_rect(&rect, 0, 0, INT_MAX, height, width, height, sar);
-    default_width = rect.w;
-    default_height = rect.h;
+    is->opts->default_width = rect.w;
+    is->opts->default_height = rect.h;
 }
 
 static int video_open(VideoState *is, int force_set_video_mode, Frame *vp) {
     int w, h;
 
     if (vp && vp->width)
-        set_default_window_size(vp->width, vp->height, vp->sar);
-
-    if (is_full_screen && fs_screen_width) {
-        w = fs_screen_width;
-        h = fs_screen_height;
-    } else if (!is_full_screen && screen_width) {
-        w = screen_width;
-        h = screen_height;
+        set_default_window_size(is, vp->width, vp->height, vp->sar);
+
+    if (is->is_full_screen && is->opts->fs_screen_width) {
+        w = is->opts->fs_screen_width;
+        h = is->opts->fs_screen_height;
+    } else if (!is->is_full_screen && is->opts->screen_width) {
+        w = is->opts->screen_width;
+        h = is->opts->screen_height;
     } else {
-        w = default_width;
-        h = default_height;
+        w = is->opts->default_width;
+        h = is->opts->default_height;
     }
     w = FFMIN(16383, w);
     is->width = w;
@@ -644,7 +962,7 @@ static double get_clock(Clock *c) {
     if (c->paused) {
         return c->pts;
     } else {
-        double time = av_gettime_relative() / 1000000.0;
+        double time = c->time_source->now() / 1000000.0;
         return c->pts_drift + time - (time - c->last_updated) * (1.0 - c->speed);
     }
 }
@@ -657,7 +975,7 @@ static void set_clock_at(Clock *c, double pts, int serial, double time) {
 }
 
 static void set_clock(Clock *c, double pts, int serial) {
-    double time = av_gettime_relative() / 1000000.0;
+    double time = c->time_source->now() / 1000000.0;
     set_clock_at(c, pts, serial, time);
 }
 
@@ -666,10 +984,11 @@ static void set_clock_speed(Clock *c, double speed) {
     c->speed = speed;
 }
 
-static void init_clock(Clock *c, int *queue_serial) {
+static void init_clock(Clock *c, int *queue_serial, TimeSource *time_source) {
     c->speed = 1.0;
     c->paused = 0;
     c->queue_serial = queue_serial;
+    c->time_source = time_source;
     set_clock(c, NAN, -1);
 }
 
@@ -682,6 +1001,9 @@ static void sync_clock_to_slave(Clock *c, Clock *slave) {
 }
 
 static int get_master_sync_type(VideoState *is) {
+    /* nothing but the video runs backwards */
+    if ((is->reverse_speed > 0 || is->trick_speed) && is->video_st)
+        return AV_SYNC_VIDEO_MASTER;
     if (is->av_sync_type == AV_SYNC_VIDEO_MASTER) {
         if (is->video_st)
             return AV_SYNC_VIDEO_MASTER;
@@ -749,6 +1071,7 @@ static void stream_seek(VideoState *is, int64_t pos, int64_t rel,
         if (seek_by_bytes)
             is->seek_flags |= AVSEEK_FLAG_BYTE;
         is->seek_req = 1;
+        trace_instant("seek request");
         pthread_cond_signal(&is->continue_read_thread);
     }
 }
@@ -756,7 +1079,7 @@ static void stream_seek(VideoState *is, int64_t pos, int64_t rel,
 /* pause or resume the video */
 static void stream_toggle_pause(VideoState *is) {
     if (is->paused) {
-        is->frame_timer += av_gettime_relative() / 1000000.0
+        is->frame_timer += is->time_source->now() / 1000000.0
                            - is->vidclk.last_updated;
         if (is->read_pause_return != AVERROR(ENOSYS)) {
             is->vidclk.paused = 0;
@@ -768,7 +1091,38 @@ static void stream_toggle_pause(VideoState *is) {
             !is->paused;
 }
 
+/* seek so that the first frame shown is the one at pts, the frames before it
+ * only go to the frame cache */
+static void stream_seek_exact(VideoState *is, double pts) {
+    if (is->seek_req)
+        return;
+    is->seek_exact = 1;
+    is->frame_seek_target = pts;
+    stream_seek(is, (int64_t) ((pts - FRAME_SEEK_MARGIN) * AV_TIME_BASE), 0, 0);
+}
+
+/* where avformat_seek_file may land for the seek request of is */
+static void seek_bounds(const VideoState *is, int64_t *seek_min, int64_t *seek_max) {
+    int64_t seek_target = is->seek_pos;
+
+    if (is->seek_exact) {
+        /* the keyframe at or before the frame, never one after it */
+        *seek_min = INT64_MIN;
+        *seek_max = seek_target + (int64_t) (2 * FRAME_SEEK_MARGIN * AV_TIME_BASE);
+        return;
+    }
+// FIXME the +-2 is due to rounding being not done in the correct direction in generation
+//      of the seek_pos/seek_rel variables
+    *seek_min = is->seek_rel > 0 ? seek_target - is->seek_rel + 2 : INT64_MIN;
+    *seek_max = is->seek_rel < 0 ? seek_target - is->seek_rel - 2 : INT64_MAX;
+}
+
 static void toggle_pause(VideoState *is) {
+    /* resume from the cached frame we stepped back to */
+    if (is->paused && !isnan(is->step_back_pts)) {
+        stream_seek_exact(is, is->step_back_pts);
+        is->step_back_pts = NAN;
+    }
     stream_toggle_pause(is);
     is->step = 0;
 }
@@ -780,6 +1134,85 @@ static void step_to_next_frame(VideoState *is) {
     is->step = 1;
 }
 
+static int scale_picture(MemoryAccount *mem, struct SwsContext **ctx, Frame *vp,
+                         AVFrame *src_frame, int flags);
+
+static void show_step_frame(VideoState *is, double pts) {
+    Frame *vp = &is->step_frame;
+
+    vp->width = vp->frame->width;
+    vp->height = vp->frame->height;
+    vp->sar = vp->frame->sample_aspect_ratio;
+    vp->pts = pts;
+    scale_picture(&is->mem, &is->step_convert_ctx, vp, vp->frame, is->opts->sws_flags);
+    is->step_back_pts = pts;
+    if (!is->opts->display_disable)
+        display_picture(is, vp);
+}
+
+/* whether the cached frame at pts is the one right next to cur, and not one
+ * across a gap of frames that were evicted or never cached */
+static int frame_cache_adjacent(VideoState *is, double cur, double pts) {
+    AVRational frame_rate = av_guess_frame_rate(is->ic, is->video_st, NULL);
+
+    if (!frame_rate.num || !frame_rate.den)
+        return 1;
+    return fabs(cur - pts) < 1.5 * av_q2d(av_inv_q(frame_rate));
+}
+
+static void step_to_prev_frame(VideoState *is) {
+    double cur, pts;
+    int hit;
+
+    if (!is->video_st)
+        return;
+    if (!is->paused)
+        stream_toggle_pause(is);
+    is->step = 0;
+
+    cur = isnan(is->step_back_pts) ? is->vidclk.pts : is->step_back_pts;
+    if (isnan(cur))
+        return;
+    hit = frame_cache_get(&is->frame_cache, cur, -1, is->step_frame.frame, &pts, NULL) > 0;
+    if (hit && frame_cache_adjacent(is, cur, pts)) {
+        is->step_back_pending = NAN;
+        show_step_frame(is, pts);
+    } else if (!isnan(is->step_back_pending) && fabs(is->step_back_pending - cur) < FRAME_SEEK_MARGIN) {
+        /* the GOP before cur was decoded, the cache has all there is before it */
+        is->step_back_pending = NAN;
+        if (hit)
+            show_step_frame(is, pts);
+    } else {
+        /* decode the GOP holding the previous frame into the cache, then retry */
+        is->step_back_pending = cur;
+        is->step_back_pts = NAN;
+        stream_seek_exact(is, cur);
+    }
+}
+
+static void step_forward(VideoState *is) {
+    double pts;
+
+    if (!isnan(is->step_back_pts)) {
+        if (frame_cache_get(&is->frame_cache, is->step_back_pts, 1, is->step_frame.frame,
+                            &pts, NULL) > 0 && pts < is->vidclk.pts - FRAME_SEEK_MARGIN) {
+            if (frame_cache_adjacent(is, is->step_back_pts, pts)) {
+                show_step_frame(is, pts);
+            } else {
+                /* decode up to the frame after the one shown */
+                stream_seek_exact(is, is->step_back_pts + 2 * FRAME_SEEK_MARGIN);
+                is->step_back_pts = NAN;
+            }
+            return;
+        }
+        /* caught up with the picture queue again */
+        is->step_back_pts = NAN;
+        is->force_refresh = 1;
+        return;
+    }
+    step_to_next_frame(is);
+}
+
 static double compute_target_delay(double delay, VideoState *is) {
     double sync_threshold, diff = 0;
 
@@ -813,6 +1246,10 @@ static double compute_target_delay(double delay, VideoState *is) {
 static double vp_duration(VideoState *is, Frame *vp, Frame *nextvp) {
     if (vp->serial == nextvp->serial) {
         double duration = nextvp->pts - vp->pts;
+        if (is->trick_speed)
+            return vp->duration;
+        if (is->reverse_speed > 0)
+            duration = -duration / is->reverse_speed;
         if (isnan(duration) || duration <= 0
             || duration > is->max_frame_duration)
             return vp->duration;
@@ -863,7 +1300,7 @@ static void video_refresh(void *opaque, double *remaining_time) {
             }
 
             if (lastvp->serial != vp->serial && !redisplay)
-                is->frame_timer = av_gettime_relative() / 1000000.0;
+                is->frame_timer = is->time_source->now() / 1000000.0;
 
             if (is->paused)
                 goto display;
@@ -875,7 +1312,7 @@ static void video_refresh(void *opaque, double *remaining_time) {
             else
                 delay = compute_target_delay(last_duration, is);
 
-            time = av_gettime_relative() / 1000000.0;
+            time = is->time_source->now() / 1000000.0;
             if (time < is->frame_timer + delay && !redisplay) {
                 *remaining_time = FFMIN(is->frame_timer + delay - time,
                                         *remaining_time);
@@ -895,8 +1332,8 @@ static void video_refresh(void *opaque, double *remaining_time) {
                 Frame *nextvp = frame_queue_peek_next(&is->pictq);
                 duration = vp_duration(is, vp, nextvp);
                 if (!is->step
-                    && (redisplay || framedrop > 0
-                        || (framedrop
+                    && (redisplay || is->opts->framedrop > 0
+                        || (is->opts->framedrop
                             && get_master_sync_type(is)
                                != AV_SYNC_VIDEO_MASTER))
                     && time > is->frame_timer + duration) {
@@ -936,7 +1373,7 @@ static void video_refresh(void *opaque, double *remaining_time) {
 
             display:
             /* display picture */
-            if (!display_disable
+            if (!is->opts->display_disable
                 && is->show_mode == VideoState::SHOW_MODE_VIDEO)
                 video_display(is);
 
@@ -947,76 +1384,109 @@ static void video_refresh(void *opaque, double *remaining_time) {
         }
     }
     is->force_refresh = 0;
-    if (show_status) {
-        static int64_t last_time;
-        int64_t cur_time;
-        int aqsize, vqsize, sqsize;
-        double av_diff;
-
-        cur_time = av_gettime_relative();
-        if (!last_time || (cur_time - last_time) >= 30000) {
-            aqsize = 0;
-            vqsize = 0;
-            sqsize = 0;
-            if (is->audio_st)
-                aqsize = is->audioq.size;
-            if (is->video_st)
-                vqsize = is->videoq.size;
-            if (is->subtitle_st)
-                sqsize = is->subtitleq.size;
-            av_diff = 0;
-            if (is->audio_st && is->video_st)
-                av_diff = get_clock(&is->audclk) - get_clock(&is->vidclk);
-            else if (is->video_st)
-                av_diff = get_master_clock(is) - get_clock(&is->vidclk);
-            else if (is->audio_st)
-                av_diff = get_master_clock(is) - get_clock(&is->audclk);
-            av_log(NULL, AV_LOG_INFO,
-                   "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB f=%"
-                           PRId64
-                           "/%"
-                           PRId64
-                           "   \r",
-                   get_master_clock(is),
-                   (is->audio_st && is->video_st) ?
-                   "A-V" :
-                   (is->video_st ?
-                    "M-V" : (is->audio_st ? "M-A" : "   ")),
-                   av_diff, is->frame_drops_early + is->frame_drops_late,
-                   aqsize / 1024, vqsize / 1024, sqsize,
-                   is->video_st ?
-                   is->video_st->codec->pts_correction_num_faulty_dts :
-                   0,
-                   is->video_st ?
-                   is->video_st->codec->pts_correction_num_faulty_pts :
-                   0);
-            fflush(stdout);
-            last_time = cur_time;
-        }
+}
+
+/* the RGBA buffer of a queue slot is reused as long as the size does not change */
+static AVFrame *rgba_picture_alloc(MemoryAccount *mem, Frame *vp) {
+    AVFrame *pict = vp->pFrameRGBA;
+
+    if (!pict || pict->width != vp->width || pict->height != vp->height) {
+        free_picture(mem, vp);
+        pict = av_frame_alloc();
+        pict->format = AV_PIX_FMT_RGBA;
+        pict->width = vp->width;
+        pict->height = vp->height;
+        av_frame_get_buffer(pict, 32);
+        vp->pFrameRGBA = pict;
+        memory_account_add(mem, MEMORY_PICTURES, rgba_picture_size(vp));
     }
+    return pict;
 }
 
-static int do_scale_picture(VideoState *is, Frame *vp, AVFrame *src_frame) {
-    AVFrame *pict = NULL;
-
-    pict = av_frame_alloc();
-    pict->format = AV_PIX_FMT_RGBA;
-    pict->width = vp->width;
-    pict->height = vp->height;
-    av_frame_get_buffer(pict, 32);
-
-    is->img_convert_ctx = sws_getCachedContext(is->img_convert_ctx, vp->width,
-                                               vp->height, AVPixelFormat(src_frame->format),
-                                               vp->width, vp->height,
-                                               AV_PIX_FMT_RGBA, sws_flags, NULL, NULL, NULL);
-    if (!is->img_convert_ctx) {
+/* src_frame is converted to RGBA at the size of vp */
+static int scale_picture(MemoryAccount *mem, struct SwsContext **ctx, Frame *vp,
+                         AVFrame *src_frame, int flags) {
+    AVFrame *pict = rgba_picture_alloc(mem, vp);
+
+    *ctx = sws_getCachedContext(*ctx, src_frame->width,
+                                src_frame->height, AVPixelFormat(src_frame->format),
+                                vp->width, vp->height,
+                                AV_PIX_FMT_RGBA, flags, NULL, NULL, NULL);
+    if (!*ctx) {
         av_log(NULL, AV_LOG_FATAL,
                "Cannot initialize the conversion context\n");
         exit(1);
     }
-    sws_scale(is->img_convert_ctx, (const uint8_t *const *) src_frame->data, src_frame->linesize, 0,
-              vp->height, pict->data, pict->linesize);
-    vp->pFrameRGBA = pict;
+    sws_scale(*ctx, (const uint8_t *const *) src_frame->data, src_frame->linesize, 0,
+              src_frame->height, pict->data, pict->linesize);
+    return 0;
+}
+
+/* the conversion of one frame split in bands of rows, run on the executor */
+typedef struct ConvertJob {
+    VideoState *is;
+    AVFrame *src;
+    AVFrame *dst;
+    int band_height;
+} ConvertJob;
+
+static void convert_band(void *arg, int index) {
+    TRACE_SCOPE("convert band");
+    ConvertJob *j = (ConvertJob *) arg;
+    AVFrame *src = j->src;
+    AVPixelFormat format = (AVPixelFormat) src->format;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    struct SwsContext **ctx = &j->is->band_convert_ctx[index];
+    int y = index * j->band_height;
+    int h = FFMIN(j->band_height, src->height - y);
+    const uint8_t *src_data[4] = {NULL};
+    uint8_t *dst_data[4] = {j->dst->data[0] + y * j->dst->linesize[0]};
+    int i;
+
+    /* each band is converted as a picture of its own */
+    for (i = 0; i < 4 && src->data[i]; i++) {
+        int shift = i == 1 || i == 2 ? desc->log2_chroma_h : 0;
+        src_data[i] = src->data[i] + (y >> shift) * src->linesize[i];
+    }
+    *ctx = sws_getCachedContext(*ctx, src->width, h, format, src->width, h,
+                                AV_PIX_FMT_RGBA, j->is->opts->sws_flags, NULL, NULL, NULL);
+    if (!*ctx) {
+        av_log(NULL, AV_LOG_ERROR, "Cannot initialize the band conversion context\n");
+        return;
+    }
+    sws_scale(*ctx, src_data, src->linesize, 0, h, dst_data, j->dst->linesize);
+}
+
+/* how many bands a frame converts in, 1 unless it is planar YUV at its own size */
+static int convert_bands(VideoState *is, Frame *vp, AVFrame *src_frame) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat) src_frame->format);
+    int nb_bands;
+
+    if (!desc || vp->width != src_frame->width || vp->height != src_frame->height
+        || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR)
+        || desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_RGB))
+        return 1;
+    nb_bands = FFMIN3(executor_get()->nb_workers, CONVERT_BANDS_MAX,
+                      src_frame->height / CONVERT_BAND_MIN_ROWS);
+    return FFMAX(nb_bands, 1);
+}
+
+static int do_scale_picture(VideoState *is, Frame *vp, AVFrame *src_frame) {
+    ConvertJob job;
+    int nb_bands = convert_bands(is, vp, src_frame);
+
+    if (nb_bands <= 1)
+        return scale_picture(&is->mem, &is->img_convert_ctx, vp, src_frame, is->opts->sws_flags);
+
+    job.is = is;
+    job.src = src_frame;
+    job.dst = rgba_picture_alloc(&is->mem, vp);
+    /* whole chroma rows in every band */
+    job.band_height = FFALIGN((src_frame->height + nb_bands - 1) / nb_bands, 16);
+    nb_bands = (src_frame->height + job.band_height - 1) / job.band_height;
+    executor_run(executor_get(), convert_band, &job, nb_bands,
+                 is->opts->focused ? EXECUTOR_PRIORITY_FOCUSED : EXECUTOR_PRIORITY_BACKGROUND,
+                 is->convert_deadline);
     return 0;
 }
 
@@ -1024,9 +1494,14 @@ static int do_scale_picture(VideoState *is, Frame *vp, AVFrame *src_frame) {
  potential locking problems */
 static void alloc_picture(VideoState *is, AVFrame *src) {
     Frame *vp;
+    int64_t convert_start, convert_end;
 
     vp = &is->pictq.queue[is->pictq.windex];
+    convert_start = av_gettime_relative();
     do_scale_picture(is, vp, src);
+    convert_end = av_gettime_relative();
+    latency_histogram_add(&is->convert_hist, convert_end - convert_start);
+    trace_span("convert", convert_start, convert_end);
     pthread_mutex_lock(&is->pictq.mutex);
     vp->allocated = 1;
     pthread_cond_signal(&is->pictq.cond);
@@ -1045,6 +1520,10 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts,
     if (!(vp = frame_queue_peek_writable(&is->pictq)))
         return -1;
 
+    /* due once the frames queued before it are shown */
+    is->convert_deadline = av_gettime_relative()
+                           + (int64_t) (frame_queue_nb_remaining(&is->pictq) * duration * 1000000);
+
     vp->sar = src_frame->sample_aspect_ratio;
 
     /* alloc or resize hardware picture buffer */
@@ -1079,6 +1558,22 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts,
     return 0;
 }
 
+/* the buffers of the video decoder are not seen from here, estimate them from
+ * the frames it holds for reference, for its threads and in the picture queue */
+static void update_decoder_memory(VideoState *is, AVFrame *frame) {
+    AVCodecContext *avctx = is->viddec.avctx;
+    int frame_size = av_image_get_buffer_size((AVPixelFormat) frame->format,
+                                              frame->width, frame->height, 32);
+    int64_t estimate;
+
+    if (frame_size < 0)
+        return;
+    estimate = (int64_t) frame_size * (FFMAX(avctx->refs, 1) + avctx->has_b_frames
+                                       + FFMAX(avctx->thread_count, 1) + VIDEO_PICTURE_QUEUE_SIZE);
+    memory_account_add(&is->mem, MEMORY_DECODERS, estimate - is->decoder_memory);
+    is->decoder_memory = estimate;
+}
+
 static int get_video_frame(VideoState *is, AVFrame *frame) {
     int got_picture;
 
@@ -1094,11 +1589,14 @@ static int get_video_frame(VideoState *is, AVFrame *frame) {
         frame->sample_aspect_ratio = av_guess_sample_aspect_ratio(is->ic,
                                                                   is->video_st, frame);
 
+        if (!is->decoder_memory || frame->width != is->viddec_width
+            || frame->height != is->viddec_height)
+            update_decoder_memory(is, frame);
         is->viddec_width = frame->width;
         is->viddec_height = frame->height;
 
-        if (framedrop > 0
-            || (framedrop
+        if (is->opts->framedrop > 0
+            || (is->opts->framedrop
                 && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) {
             if (frame->pts != AV_NOPTS_VALUE) {
                 double diff = dpts - get_master_clock(is);
@@ -1164,13 +1662,81 @@ static void decoder_start(Decoder *d, void *(*fn)(void *), void *arg) {
     pthread_setname_np(d->decoder_tid, "decoder");
 }
 
+/* lowres can only be changed on a closed decoder, which then restarts at the next keyframe */
+static int video_decoder_set_lowres(VideoState *is, int stream_lowres) {
+    AVCodecContext *avctx = is->viddec.avctx;
+    const AVCodec *codec = avctx->codec;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (av_codec_get_lowres(avctx) == stream_lowres)
+        return 0;
+    avcodec_close(avctx);
+    av_codec_set_lowres(avctx, stream_lowres);
+    av_dict_set_int(&opts, "threads", executor_codec_threads(executor_get(), is->opts->focused), 0);
+    av_dict_set(&opts, "refcounted_frames", "1", 0);
+    ret = avcodec_open2(avctx, codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        av_log(NULL, AV_LOG_ERROR, "Cannot reopen the video decoder with lowres %d\n",
+               stream_lowres);
+    is->ladder_wait_key = 1;
+    return ret;
+}
+
+/* the largest lowres at which the picture still covers the surface, never
+ * below the lowres option */
+static int surface_lowres(VideoState *is, const AVCodec *codec) {
+    int max_lowres = av_codec_get_max_lowres(codec);
+    int stream_lowres = FFMIN(is->opts->lowres, max_lowres);
+
+    if (!is->opts->auto_lowres || is->surface_width <= 0 || is->surface_height <= 0)
+        return stream_lowres;
+    while (stream_lowres < max_lowres
+           && is->video_full_width >> (stream_lowres + 1) >= is->surface_width
+           && is->video_full_height >> (stream_lowres + 1) >= is->surface_height)
+        stream_lowres++;
+    return stream_lowres;
+}
+
+/* a new surface size moves the lowres the decode ladder starts from */
+static void video_surface_changed(VideoState *is) {
+    const AVCodec *codec = is->viddec.avctx->codec;
+    int base;
+
+    is->surface_changed = 0;
+    base = surface_lowres(is, codec);
+    if (base == is->ladder_lowres_base)
+        return;
+    av_log(NULL, AV_LOG_INFO, "surface %dx%d, video lowres %d -> %d\n",
+           is->surface_width, is->surface_height, is->ladder_lowres_base, base);
+    is->ladder_lowres_base = base;
+    is->ladder.max_lowres = av_codec_get_max_lowres(codec) - base;
+    video_decoder_set_lowres(is, base + decode_ladder_lowres(&is->ladder));
+}
+
+/* move along the decode ladder after each decoded frame */
+static void video_decode_ladder_update(VideoState *is, int64_t decode_time) {
+    AVCodecContext *avctx = is->viddec.avctx;
+
+    if (is->trick_speed)
+        return;
+    if (decode_ladder_update(&is->ladder, decode_time / 1000000.0,
+                             frame_queue_nb_remaining(&is->pictq),
+                             is->frame_drops_early + is->frame_drops_late)) {
+        decode_ladder_apply(&is->ladder, avctx);
+        video_decoder_set_lowres(is, is->ladder_lowres_base + decode_ladder_lowres(&is->ladder));
+    }
+}
+
 static void *video_thread(void *arg) {
     ALOGV("myb video_thread");
     VideoState *is = (VideoState *) arg;
     AVFrame *frame = av_frame_alloc();
     double pts;
     double duration;
-    int ret;
+    int ret, serial;
+    int64_t decode_time = 0;
     AVRational tb = is->video_st->time_base;
     AVRational frame_rate = av_guess_frame_rate(is->ic, is->video_st, NULL);
 
@@ -1178,18 +1744,74 @@ static void *video_thread(void *arg) {
         return (void *) AVERROR(ENOMEM);
     }
 
+    is->ladder_lowres_base = av_codec_get_lowres(is->viddec.avctx);
+    decode_ladder_init(&is->ladder,
+                       av_codec_get_max_lowres(is->viddec.avctx->codec) - is->ladder_lowres_base,
+                       frame_rate.num && frame_rate.den ? av_q2d(av_inv_q(frame_rate)) : 0);
+
     for (; ;) {
+        if (is->reverse_speed > 0) {
+            if (reverse_decoder_get(&is->revdec, frame, &pts, &serial) <= 0) {
+                if (is->videoq.abort_request)
+                    goto the_end;
+                continue;
+            }
+            duration = (frame_rate.num && frame_rate.den ? av_q2d((AVRational) {
+                    frame_rate.den, frame_rate.num}) : 0) / is->reverse_speed;
+            frame->sample_aspect_ratio = av_guess_sample_aspect_ratio(is->ic, is->video_st, frame);
+            ret = queue_picture(is, frame, pts, duration, av_frame_get_pkt_pos(frame), serial);
+            av_frame_unref(frame);
+            if (ret < 0)
+                goto the_end;
+            continue;
+        }
+
         ALOGV("myb get_video_frame");
         ret = get_video_frame(is, frame);
         if (ret < 0)
             goto the_end;
         if (!ret)
             continue;
+        startup_mark(is, STARTUP_FIRST_DECODE);
+
+        latency_histogram_add(&is->decode_hist, is->viddec.decode_time - decode_time);
+        video_decode_ladder_update(is, is->viddec.decode_time - decode_time);
+        decode_time = is->viddec.decode_time;
+        if (is->surface_changed)
+            video_surface_changed(is);
+        if (is->ladder_wait_key) {
+            if (!frame->key_frame) {
+                av_frame_unref(frame);
+                continue;
+            }
+            is->ladder_wait_key = 0;
+        }
 
         duration = (frame_rate.num && frame_rate.den ? av_q2d((AVRational) {
                 frame_rate.den, frame_rate.num}) :
                     0);
         pts = (frame->pts == AV_NOPTS_VALUE) ? NAN : frame->pts * av_q2d(tb);
+        if (is->trick_speed)
+            duration = TRICK_PLAY_FRAME_DURATION;
+        else
+            frame_cache_put(&is->frame_cache, frame, pts, av_frame_get_pkt_pos(frame));
+        if (is->viddec.pkt_serial == is->frame_seek_serial) {
+            if (!isnan(pts) && pts < is->frame_seek_target - FRAME_SEEK_MARGIN) {
+                av_frame_unref(frame);
+                continue;
+            }
+            is->frame_seek_serial = -1;
+        }
+        /* after a loop the frames between the keyframe and the loop start come back
+         * with timestamps before the ones already shown */
+        if (is->loop_iteration > 0 && !isnan(pts)) {
+            if (is->viddec.pkt_serial == is->loop_last_serial && pts <= is->loop_last_pts) {
+                av_frame_unref(frame);
+                continue;
+            }
+            is->loop_last_pts = pts;
+            is->loop_last_serial = is->viddec.pkt_serial;
+        }
         ret = queue_picture(is, frame, pts, duration,
                             av_frame_get_pkt_pos(frame), is->viddec.pkt_serial);
         ALOGV("myb queue_picture");
@@ -1197,6 +1819,7 @@ static void *video_thread(void *arg) {
 
         if (ret < 0)
             goto the_end;
+        startup_mark(is, STARTUP_FIRST_CONVERT);
     }
     the_end:
     av_frame_free(&frame);
@@ -1208,7 +1831,6 @@ static void *subtitle_thread(void *arg) {
     Frame *sp;
     int got_subtitle;
     double pts;
-    int i;
 
     for (; ;) {
         if (!(sp = frame_queue_peek_writable(&is->subpq)))
@@ -1226,61 +1848,8 @@ static void *subtitle_thread(void *arg) {
             sp->pts = pts;
             sp->serial = is->subdec.pkt_serial;
 
-            for (i = 0; i < sp->sub.num_rects; i++) {
-                int in_w = sp->sub.rects[i]->w;
-                int in_h = sp->sub.rects[i]->h;
-                int subw =
-                        is->subdec.avctx->width ?
-                        is->subdec.avctx->width : is->viddec_width;
-                int subh =
-                        is->subdec.avctx->height ?
-                        is->subdec.avctx->height : is->viddec_height;
-                int out_w =
-                        is->viddec_width ?
-                        in_w * is->viddec_width / subw : in_w;
-                int out_h =
-                        is->viddec_height ?
-                        in_h * is->viddec_height / subh : in_h;
-                AVPicture newpic;
-
-                //can not use avpicture_alloc as it is not compatible with avsubtitle_free()
-                av_image_fill_linesizes(newpic.linesize, AV_PIX_FMT_YUVA420P,
-                                        out_w);
-                newpic.data[0] = (uint8_t *) av_malloc(
-                        newpic.linesize[0] * out_h);
-                newpic.data[3] = (uint8_t *) av_malloc(
-                        newpic.linesize[3] * out_h);
-                newpic.data[1] = (uint8_t *) av_malloc(
-                        newpic.linesize[1] * ((out_h + 1) / 2));
-                newpic.data[2] = (uint8_t *) av_malloc(
-                        newpic.linesize[2] * ((out_h + 1) / 2));
-
-                is->sub_convert_ctx = sws_getCachedContext(is->sub_convert_ctx,
-                                                           in_w, in_h, AV_PIX_FMT_PAL8, out_w,
-                                                           out_h,
-                                                           AV_PIX_FMT_YUVA420P, sws_flags, NULL,
-                                                           NULL, NULL);
-                if (!is->sub_convert_ctx || !newpic.data[0] || !newpic.data[3]
-                    || !newpic.data[1] || !newpic.data[2]) {
-                    av_log(NULL, AV_LOG_FATAL,
-                           "Cannot initialize the sub conversion context\n");
-                    exit(1);
-                }
-                sws_scale(is->sub_convert_ctx,
-                          (const uint8_t *const *) sp->sub.rects[i]->pict.data,
-                          sp->sub.rects[i]->pict.linesize, 0, in_h, newpic.data,
-                          newpic.linesize);
-
-                av_free(sp->sub.rects[i]->pict.data[0]);
-                av_free(sp->sub.rects[i]->pict.data[1]);
-                sp->sub.rects[i]->pict = newpic;
-                sp->sub.rects[i]->w = out_w;
-                sp->sub.rects[i]->h = out_h;
-                sp->sub.rects[i]->x = sp->sub.rects[i]->x * out_w / in_w;
-                sp->sub.rects[i]->y = sp->sub.rects[i]->y * out_h / in_h;
-            }
-
-            /* now we can update the picture count */
+            /* bitmap rects are kept as decoded, the display converts them
+             * once into an overlay. Now we can update the picture count */
             frame_queue_push(&is->subpq);
         } else if (got_subtitle) {
             avsubtitle_free(&sp->sub);
@@ -1289,24 +1858,46 @@ static void *subtitle_thread(void *arg) {
     return 0;
 }
 
-/* copy samples for viewing in editor window */
+/* played when no samples are decoded, shared by all the players */
+static uint8_t silence_buf[SDL_AUDIO_MIN_BUFFER_SIZE];
+
+static int show_mode_samples(int show_mode) {
+    return show_mode == VideoState::SHOW_MODE_WAVES || show_mode == VideoState::SHOW_MODE_RDFT;
+}
+
+/* the visualizer runs while the waves or the spectrum are shown or the app
+ * asked for it, at the rate the app asked for or else the default one.
+ * Called from the event thread, or before it runs. */
+static void update_visualizer(VideoState *is) {
+    AudioVisualizer *visualizer;
+    int rate = is->opts->visualization_rate;
+
+    if (!rate && show_mode_samples(is->show_mode))
+        rate = VISUALIZER_DEFAULT_RATE;
+    if (!rate) {
+        visualizer_free(is);
+    } else if (is->visualizer) {
+        audio_visualizer_set_rate(is->visualizer, rate);
+    } else if ((visualizer = audio_visualizer_create(ANDROID_AUDIO_CHANNELS, rate))) {
+        memory_account_add(&is->mem, MEMORY_AUDIO, audio_visualizer_size());
+        __atomic_store_n(&is->visualizer, visualizer, __ATOMIC_SEQ_CST);
+    } else {
+        ALOGE("no memory for the audio visualizer");
+    }
+}
+
+static void set_show_mode(VideoState *is, int show_mode) {
+    is->show_mode = (VideoState::ShowMode) show_mode;
+    update_visualizer(is);
+}
+
+/* copy samples for the visualizer, all it costs the audio callback */
 static void update_sample_display(VideoState *is, short *samples,
                                   int samples_size) {
-    int size, len;
+    AudioVisualizer *visualizer = __atomic_load_n(&is->visualizer, __ATOMIC_SEQ_CST);
 
-    size = samples_size / sizeof(short);
-    while (size > 0) {
-        len = SAMPLE_ARRAY_SIZE - is->sample_array_index;
-        if (len > size)
-            len = size;
-        memcpy(is->sample_array + is->sample_array_index, samples,
-               len * sizeof(short));
-        samples += len;
-        is->sample_array_index += len;
-        if (is->sample_array_index >= SAMPLE_ARRAY_SIZE)
-            is->sample_array_index = 0;
-        size -= len;
-    }
+    if (visualizer)
+        audio_visualizer_write(visualizer, samples, samples_size / sizeof(short));
 }
 
 /* return the wanted number of samples to get better sync if sync_type is video
@@ -1372,13 +1963,19 @@ static int audio_decode_frame(VideoState *is) {
     int wanted_nb_samples;
     Frame *af;
 
-    if (is->paused)
+    /* the audio is muted while playing backwards */
+    if (is->paused || is->reverse_speed > 0 || is->trick_speed)
         return -1;
+    /* silence after the end rather than holding the sink, and virtual time with it */
+    if (is->auddec.finished == is->audioq.serial && frame_queue_nb_remaining(&is->sampq) == 0)
+        return -1;
+    if (frame_queue_nb_remaining(&is->sampq) == 0)
+        __atomic_fetch_add(&is->audio_underruns, (int64_t) 1, __ATOMIC_RELAXED);
 
     do {
 #if defined(_WIN32)
         while (frame_queue_nb_remaining(&is->sampq) == 0) {
-            if ((av_gettime_relative() - audio_callback_time)
+            if ((av_gettime_relative() - is->audio_callback_time)
                     > 1000000LL * is->audio_hw_buf_size
                             / is->audio_tgt.bytes_per_sec / 2)
                 return -1;
@@ -1438,6 +2035,7 @@ static int audio_decode_frame(VideoState *is) {
                         / af->frame->sample_rate + 256;
         int out_size = av_samples_get_buffer_size(NULL, is->audio_tgt.channels,
                                                   out_count, is->audio_tgt.fmt, 0);
+        unsigned int buf1_size = is->audio_buf1_size;
         int len2;
         if (out_size < 0) {
             av_log(NULL, AV_LOG_ERROR, "av_samples_get_buffer_size() failed\n");
@@ -1454,6 +2052,7 @@ static int audio_decode_frame(VideoState *is) {
             }
         }
         av_fast_malloc(&is->audio_buf1, &is->audio_buf1_size, out_size);
+        memory_account_add(&is->mem, MEMORY_AUDIO, (int64_t) is->audio_buf1_size - buf1_size);
         if (!is->audio_buf1)
             return AVERROR(ENOMEM);
         len2 = swr_convert(is->swr_ctx, out, out_count, in,
@@ -1497,25 +2096,26 @@ static int audio_decode_frame(VideoState *is) {
 }
 
 /* prepare a new audio buffer */
-static void sdl_audio_callback(void *opaque, uint8_t *stream, int len) {
+static int sdl_audio_callback(void *opaque, uint8_t *stream, int len) {
     VideoState *is = (VideoState *) opaque;
-    int audio_size, len1;
+    TRACE_SCOPE("audio callback");
+    int audio_size, len1, filled = 0;
 
-    audio_callback_time = av_gettime_relative();
+    __atomic_add_fetch(&is->audio_callback_seq, 1, __ATOMIC_SEQ_CST);
+    is->audio_callback_time = is->time_source->now();
 
     while (len > 0) {
         if (is->audio_buf_index >= is->audio_buf_size) {
             audio_size = audio_decode_frame(is);
             if (audio_size < 0) {
                 /* if error, just output silence */
-                is->audio_buf = is->silence_buf;
-                is->audio_buf_size = sizeof(is->silence_buf)
+                is->audio_buf = silence_buf;
+                is->audio_buf_size = sizeof(silence_buf)
                                      / is->audio_tgt.frame_size * is->audio_tgt.frame_size;
             } else {
-                if (is->show_mode != VideoState::SHOW_MODE_VIDEO)
-                    update_sample_display(is, (int16_t *) is->audio_buf,
-                                          audio_size);
+                update_sample_display(is, (int16_t *) is->audio_buf, audio_size);
                 is->audio_buf_size = audio_size;
+                startup_mark(is, STARTUP_FIRST_AUDIO);
             }
             is->audio_buf_index = 0;
         }
@@ -1523,6 +2123,8 @@ static void sdl_audio_callback(void *opaque, uint8_t *stream, int len) {
         if (len1 > len)
             len1 = len;
         memcpy(stream, (uint8_t *) is->audio_buf + is->audio_buf_index, len1);
+        if (is->audio_buf != silence_buf)
+            filled += len1;
         len -= len1;
         stream += len1;
         is->audio_buf_index += len1;
@@ -1535,19 +2137,28 @@ static void sdl_audio_callback(void *opaque, uint8_t *stream, int len) {
                      - (double) (2 * is->audio_hw_buf_size
                                  + is->audio_write_buf_size)
                        / is->audio_tgt.bytes_per_sec,
-                     is->audio_clock_serial, audio_callback_time / 1000000.0);
+                     is->audio_clock_serial, is->audio_callback_time / 1000000.0);
         sync_clock_to_slave(&is->extclk, &is->audclk);
     }
+    __atomic_add_fetch(&is->audio_callback_seq, 1, __ATOMIC_SEQ_CST);
+    return filled;
+}
+
+/* create and start the audio player, it pulls the samples decoded so far */
+static void audio_device_open(VideoState *is) {
+    is->audio_sink->open(is->audio_tgt.freq, ANDROID_AUDIO_CHANNELS, is, sdl_audio_callback);
+    is->audio_sink->start();
+    startup_mark(is, STARTUP_AUDIO_DEVICE);
+}
+
+static void *audio_device_thread(void *arg) {
+    audio_device_open((VideoState *) arg);
+    return NULL;
 }
 
 static int audio_open(VideoState *videoState, int64_t wanted_channel_layout,
                       int wanted_nb_channels, int wanted_sample_rate,
                       struct AudioParams *audio_hw_params) {
-    videoState->audioEngine = new AudioEngine();
-    videoState->audioEngine->createEngine();
-    videoState->audioEngine->createBufferQueueAudioPlayer(wanted_sample_rate,
-                                                          ANDROID_AUDIO_CHANNELS, videoState,
-                                                          sdl_audio_callback);
     wanted_channel_layout = av_get_default_channel_layout(
             ANDROID_AUDIO_CHANNELS);
 
@@ -1581,7 +2192,7 @@ static int stream_component_open(VideoState *is, int stream_index) {
     int sample_rate, nb_channels;
     int64_t channel_layout;
     int ret = 0;
-    int stream_lowres = lowres;
+    int stream_lowres = is->opts->lowres;
 
     if (stream_index < 0 || stream_index >= ic->nb_streams)
         return -1;
@@ -1592,15 +2203,15 @@ static int stream_component_open(VideoState *is, int stream_index) {
     switch (avctx->codec_type) {
         case AVMEDIA_TYPE_AUDIO:
             is->last_audio_stream = stream_index;
-            forced_codec_name = audio_codec_name;
+            forced_codec_name = is->opts->audio_codec_name;
             break;
         case AVMEDIA_TYPE_SUBTITLE:
             is->last_subtitle_stream = stream_index;
-            forced_codec_name = subtitle_codec_name;
+            forced_codec_name = is->opts->subtitle_codec_name;
             break;
         case AVMEDIA_TYPE_VIDEO:
             is->last_video_stream = stream_index;
-            forced_codec_name = video_codec_name;
+            forced_codec_name = is->opts->video_codec_name;
             break;
     }
     if (forced_codec_name)
@@ -1623,20 +2234,27 @@ static int stream_component_open(VideoState *is, int stream_index) {
                av_codec_get_max_lowres(codec));
         stream_lowres = av_codec_get_max_lowres(codec);
     }
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+        is->video_full_width = avctx->width;
+        is->video_full_height = avctx->height;
+        stream_lowres = surface_lowres(is, codec);
+        is->surface_changed = 0;
+    }
     av_codec_set_lowres(avctx, stream_lowres);
 
 #if FF_API_EMU_EDGE
     if (stream_lowres)
         avctx->flags |= CODEC_FLAG_EMU_EDGE;
 #endif
-    if (fast)
+    if (is->opts->fast)
         avctx->flags2 |= AV_CODEC_FLAG2_FAST;
 #if FF_API_EMU_EDGE
     if (codec->capabilities & AV_CODEC_CAP_DR1)
         avctx->flags |= CODEC_FLAG_EMU_EDGE;
 #endif
 
-    av_dict_set(&opts, "threads", "auto", 0);
+    /* the codec threads of all the players together stay near the number of cores */
+    av_dict_set_int(&opts, "threads", executor_codec_threads(executor_get(), is->opts->focused), 0);
     if (avctx->codec_type == AVMEDIA_TYPE_VIDEO
         || avctx->codec_type == AVMEDIA_TYPE_AUDIO)
         av_dict_set(&opts, "refcounted_frames", "1", 0);
@@ -1651,6 +2269,21 @@ static int stream_component_open(VideoState *is, int stream_index) {
 
     is->eof = 0;
     ic->streams[stream_index]->discard = AVDISCARD_DEFAULT;
+    switch (avctx->codec_type) {
+        case AVMEDIA_TYPE_AUDIO:
+        case AVMEDIA_TYPE_VIDEO:
+        case AVMEDIA_TYPE_SUBTITLE: {
+            PacketQueue *q = avctx->codec_type == AVMEDIA_TYPE_AUDIO ? &is->audioq :
+                             avctx->codec_type == AVMEDIA_TYPE_VIDEO ? &is->videoq :
+                             &is->subtitleq;
+            q->history.max_size = is->opts->back_buffer_size;
+            q->history.max_duration = is->opts->back_buffer_duration;
+            q->history.time_base = ic->streams[stream_index]->time_base;
+            break;
+        }
+        default:
+            break;
+    }
     switch (avctx->codec_type) {
         case AVMEDIA_TYPE_AUDIO:
             sample_rate = avctx->sample_rate;
@@ -1685,8 +2318,16 @@ static int stream_component_open(VideoState *is, int stream_index) {
                 is->auddec.start_pts_tb = is->audio_st->time_base;
             }
             decoder_start(&is->auddec, audio_thread, is);
-            // TODO push data
-            is->audioEngine->enqueueStartBuffer();
+            /* creating the player takes long, a fast start decodes meanwhile */
+            if (is->preload) {
+                is->audio_device_deferred = 1;
+            } else if (is->opts->fast_start
+                && !pthread_create(&is->audio_device_tid, NULL, audio_device_thread, is)) {
+                pthread_setname_np(is->audio_device_tid, "audio_device");
+                is->audio_device_pending = 1;
+            } else {
+                audio_device_open(is);
+            }
             break;
         case AVMEDIA_TYPE_VIDEO:
             is->video_stream = stream_index;
@@ -1696,6 +2337,7 @@ static int stream_component_open(VideoState *is, int stream_index) {
             is->viddec_height = avctx->height;
 
             decoder_init(&is->viddec, avctx, &is->videoq, &is->continue_read_thread);
+            is->viddec.reorder_pts = is->opts->decoder_reorder_pts;
             decoder_start(&is->viddec, video_thread, is);
             is->queue_attachments_req = 1;
             break;
@@ -1725,17 +2367,30 @@ static void stream_component_close(VideoState *is, int stream_index) {
 
     switch (avctx->codec_type) {
         case AVMEDIA_TYPE_AUDIO:
+            if (is->audio_device_pending) {
+                pthread_join(is->audio_device_tid, NULL);
+                is->audio_device_pending = 0;
+            }
             decoder_abort(&is->auddec, &is->sampq);
-            is->audioEngine->shutdown();
+            is->audio_sink->close();
             decoder_destroy(&is->auddec);
             swr_free(&is->swr_ctx);
+            memory_account_add(&is->mem, MEMORY_AUDIO, -(int64_t) is->audio_buf1_size);
             av_freep(&is->audio_buf1);
             is->audio_buf1_size = 0;
             is->audio_buf = NULL;
             break;
         case AVMEDIA_TYPE_VIDEO:
+            /* wake up the video thread if it waits for reversed frames */
+            packet_queue_abort(&is->videoq);
+            reverse_decoder_stop(&is->revdec);
             decoder_abort(&is->viddec, &is->pictq);
             decoder_destroy(&is->viddec);
+            reverse_decoder_close(&is->revdec);
+            is->reverse_speed = 0;
+            frame_cache_flush(&is->frame_cache);
+            memory_account_add(&is->mem, MEMORY_DECODERS, -is->decoder_memory);
+            is->decoder_memory = 0;
             break;
         case AVMEDIA_TYPE_SUBTITLE:
             decoder_abort(&is->subdec, &is->subpq);
@@ -1791,32 +2446,528 @@ static void print_error(const char *filename, int err) {
     av_log(NULL, AV_LOG_ERROR, "%s: %s\n", filename, errbuf_ptr);
 }
 
-/* this thread gets the stream from the disk or the network */
-static void *read_thread(void *arg) {
-    ALOGI("read_thread");
-    VideoState *is = (VideoState *) arg;
-    AVFormatContext *ic = NULL;
-    int err, i, ret;
-    int st_index[AVMEDIA_TYPE_NB];
-    AVPacket pkt1, *pkt = &pkt1;
-    int64_t stream_start_time;
-    int pkt_in_play_range = 0;
-    AVDictionaryEntry *t;
-    int orig_nb_streams;
-    pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
-    int64_t pkt_ts;
+/* what the reverse decoder may hold: its option, within what the others leave */
+static int reverse_buffer_size(VideoState *is) {
+    int64_t room = memory_account_room(&is->mem);
 
-    memset(st_index, -1, sizeof(st_index));
-    is->last_video_stream = is->video_stream = -1;
-    is->last_audio_stream = is->audio_stream = -1;
-    is->last_subtitle_stream = is->subtitle_stream = -1;
-    is->eof = 0;
+    if (room == INT64_MAX)
+        return is->opts->reverse_buffer_size;
+    return (int) av_clip64(__atomic_load_n(&is->mem.live[MEMORY_REVERSE], __ATOMIC_RELAXED)
+                           + room, 0, is->opts->reverse_buffer_size);
+}
 
-    ic = avformat_alloc_context();
-    if (!ic) {
-        av_log(NULL, AV_LOG_FATAL, "Could not allocate context.\n");
-        ret = AVERROR(ENOMEM);
-        goto fail;
+/* the buffering shrinks to stay under the memory budget: the frame cache first,
+ * it only saves decoding, then the packet queues, down to MEMORY_MIN_QUEUE_SIZE.
+ * Return the bytes the packet queues and their back-buffers may hold. */
+static int memory_budget_apply(VideoState *is) {
+    int64_t room = memory_account_room(&is->mem), packets;
+    int cache_size = is->opts->frame_cache_size;
+
+    if (room != INT64_MAX)
+        cache_size = (int) av_clip64(__atomic_load_n(&is->mem.live[MEMORY_FRAME_CACHE], __ATOMIC_RELAXED)
+                                     + room, 0, cache_size);
+    /* only this thread changes it once playing */
+    if (cache_size != is->frame_cache.max_size) {
+        frame_cache_set_max_size(&is->frame_cache, cache_size);
+        room = memory_account_room(&is->mem);
+    }
+    /* the subtitle index only counts against the room, its packets are all
+     * needed; the reverse decoder drops frames of its next chunks instead */
+    if (is->revdec.ic)
+        reverse_decoder_set_max_size(&is->revdec, reverse_buffer_size(is));
+    if (room == INT64_MAX)
+        return MAX_QUEUE_SIZE;
+    packets = __atomic_load_n(&is->mem.live[MEMORY_PACKETS], __ATOMIC_RELAXED)
+              + __atomic_load_n(&is->mem.live[MEMORY_BACK_BUFFER], __ATOMIC_RELAXED) + room;
+    return (int) av_clip64(packets, MEMORY_MIN_QUEUE_SIZE, MAX_QUEUE_SIZE);
+}
+
+/* the back-buffers only get what the forward buffers leave of max_size */
+static void back_buffer_trim(VideoState *is, int max_size) {
+    PacketQueue *queues[] = {&is->videoq, &is->audioq, &is->subtitleq};
+    int i, size, forward = 0, history = 0;
+
+    for (i = 0; i < 3; i++) {
+        forward += queues[i]->size;
+        history += queues[i]->history.size;
+    }
+    while (history > 0 && forward + history > max_size) {
+        PacketQueue *q = queues[0];
+        for (i = 1; i < 3; i++)
+            if (queues[i]->history.size > q->history.size)
+                q = queues[i];
+        pthread_mutex_lock(&q->mutex);
+        if (!q->history.first_pkt) {
+            pthread_mutex_unlock(&q->mutex);
+            break;
+        }
+        size = q->history.size;
+        packet_history_drop_first(&q->history);
+        history -= size - q->history.size;
+        pthread_mutex_unlock(&q->mutex);
+    }
+}
+
+/* replay a backward seek from the back-buffers, starting at a video keyframe.
+ * Return 1 if the kept packets covered the target, 0 if a real seek is needed. */
+static int back_buffer_rewind(VideoState *is, int64_t target) {
+    PacketQueue *queues[] = {&is->videoq, &is->audioq, &is->subtitleq};
+    MyAVPacketList *from[] = {NULL, NULL, NULL};
+    PacketHistory *h;
+    int64_t start = target;
+    int i, ret = 0;
+
+    for (i = 0; i < 3; i++)
+        pthread_mutex_lock(&queues[i]->mutex);
+
+    if (is->video_st && !(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        h = &is->videoq.history;
+        int64_t ts = av_rescale_q(target, AV_TIME_BASE_Q, h->time_base);
+        if (!h->last_pkt || ts > packet_ts(&h->last_pkt->pkt))
+            goto out;
+        if (!(from[0] = packet_history_find(h, ts, 1)))
+            goto out;
+        start = av_rescale_q(packet_ts(&from[0]->pkt), h->time_base, AV_TIME_BASE_Q);
+    }
+    if (is->audio_st) {
+        h = &is->audioq.history;
+        int64_t ts = av_rescale_q(start, AV_TIME_BASE_Q, h->time_base);
+        if (!from[0] && (!h->last_pkt || ts > packet_ts(&h->last_pkt->pkt)))
+            goto out;
+        if (!(from[1] = packet_history_find(h, ts, 0)))
+            goto out;
+    }
+    if (!from[0] && !from[1])
+        goto out;
+    if (is->subtitle_st) {
+        h = &is->subtitleq.history;
+        from[2] = packet_history_find(h, av_rescale_q(start, AV_TIME_BASE_Q, h->time_base), 0);
+        if (!from[2])
+            from[2] = h->first_pkt;
+    }
+
+    for (i = 0; i < 3; i++)
+        if (from[i])
+            packet_queue_rewind_private(queues[i], from[i]);
+    ret = 1;
+    out:
+    for (i = 2; i >= 0; i--)
+        pthread_mutex_unlock(&queues[i]->mutex);
+    return ret;
+}
+
+static void flush_packet_queues(VideoState *is) {
+    if (is->audio_stream >= 0) {
+        packet_queue_flush(&is->audioq);
+        packet_queue_put(&is->audioq, &flush_pkt);
+    }
+    if (is->subtitle_stream >= 0) {
+        packet_queue_flush(&is->subtitleq);
+        packet_queue_put(&is->subtitleq, &flush_pkt);
+    }
+    if (is->video_stream >= 0) {
+        packet_queue_flush(&is->videoq);
+        packet_queue_put(&is->videoq, &flush_pkt);
+    }
+}
+
+/* drop what was read forward, the video thread then drains its decoder and
+ * turns to the reverse decoder */
+static void flush_for_reverse(VideoState *is) {
+    flush_packet_queues(is);
+    packet_queue_put_nullpacket(&is->videoq, is->video_stream);
+}
+
+/* switch between forward and backward playback at the current picture */
+static void reverse_playback(VideoState *is) {
+    double speed = is->reverse_req_speed;
+    double pts = get_clock(&is->vidclk);
+
+    is->reverse_req = 0;
+    if (!is->video_st || (is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        return;
+    if (isnan(pts))
+        pts = is->vidclk.pts;
+
+    if (speed > 0) {
+        if (!is->reverse_speed) {
+            if (isnan(pts))
+                return;
+            if (!is->revdec.ic
+                && reverse_decoder_open(&is->revdec, is->filename, is->video_stream,
+                                        is->video_st->codec, reverse_buffer_size(is),
+                                        &is->mem) < 0) {
+                av_log(NULL, AV_LOG_ERROR, "%s: cannot play backwards\n", is->filename);
+                return;
+            }
+            /* the null packet wakes the video thread up, only once it would
+             * take its frames from a started reverse decoder: before, it
+             * would wait on videoq, which the read thread no longer feeds */
+            flush_packet_queues(is);
+            reverse_decoder_start(&is->revdec, pts, is->videoq.serial);
+            is->reverse_speed = speed;
+            packet_queue_put_nullpacket(&is->videoq, is->video_stream);
+            is->eof = 0;
+        } else {
+            is->reverse_speed = speed;
+        }
+        set_clock_speed(&is->vidclk, -speed);
+    } else if (is->reverse_speed > 0) {
+        /* go on forward from the picture shown last */
+        is->reverse_speed = 0;
+        reverse_decoder_stop(&is->revdec);
+        set_clock_speed(&is->vidclk, 1.0);
+        if (!isnan(pts)) {
+            is->seek_req = 0;
+            stream_seek_exact(is, pts);
+        }
+    }
+}
+
+/* in trick-play the demuxer drops what it can and the decoder does keyframes only */
+static void trick_play_discard(VideoState *is, int enable) {
+    if (is->audio_st)
+        is->audio_st->discard = enable ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    if (is->subtitle_st)
+        is->subtitle_st->discard = enable ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    is->video_st->discard = enable ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    is->video_st->codec->skip_frame = enable ? AVDISCARD_NONKEY
+                                             : decode_ladder_skip_frame(&is->ladder);
+}
+
+/* start, change or stop keyframe-only fast forward and rewind */
+static void trick_play(VideoState *is) {
+    int speed = is->trick_req_speed;
+    double pts = get_clock(&is->vidclk);
+
+    is->trick_req = 0;
+    if (!is->video_st || (is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC))
+        return;
+    if (isnan(pts))
+        pts = is->vidclk.pts;
+
+    if (speed && !is->reverse_speed) {
+        if (!is->trick_speed) {
+            if (isnan(pts))
+                return;
+            is->trick_pos = pts;
+            is->trick_last_ts = AV_NOPTS_VALUE;
+            trick_play_discard(is, 1);
+            flush_packet_queues(is);
+            is->eof = 0;
+        }
+        is->trick_speed = speed;
+        set_clock_speed(&is->vidclk, speed);
+    } else if (is->trick_speed) {
+        is->trick_speed = 0;
+        trick_play_discard(is, 0);
+        set_clock_speed(&is->vidclk, 1.0);
+        /* the back-buffers only hold keyframes now, do not rewind into them */
+        flush_packet_queues(is);
+        if (!isnan(pts)) {
+            is->seek_req = 0;
+            stream_seek_exact(is, pts);
+        }
+    }
+}
+
+/* queue the next keyframe in the trick-play direction, found in the index if
+ * there is one or by a seek otherwise. Return 0 if the caller should go on,
+ * > 0 if there is nothing to read for now. */
+static int trick_play_read(VideoState *is) {
+    AVFormatContext *ic = is->ic;
+    AVStream *st = is->video_st;
+    AVPacket pkt;
+    double target, start = 0, end = NAN;
+    int64_t ts;
+    int idx;
+
+    if (is->videoq.nb_packets >= TRICK_PLAY_QUEUE_PACKETS)
+        return 1;
+
+    if (ic->start_time != AV_NOPTS_VALUE)
+        start = ic->start_time / (double) AV_TIME_BASE;
+    if (ic->duration != AV_NOPTS_VALUE)
+        end = start + ic->duration / (double) AV_TIME_BASE;
+    target = is->trick_pos + is->trick_speed * TRICK_PLAY_FRAME_DURATION;
+    if (target < start || target > end)
+        return 1;
+    is->trick_pos = target;
+    ts = (int64_t) (target / av_q2d(st->time_base));
+
+    if (st->nb_index_entries > 0) {
+        idx = av_index_search_timestamp(st, ts, is->trick_speed < 0 ? AVSEEK_FLAG_BACKWARD : 0);
+        if (idx < 0)
+            return 1;
+        ts = st->index_entries[idx].timestamp;
+        if (ts == is->trick_last_ts)
+            return 0;
+    }
+    if (av_seek_frame(ic, is->video_stream, ts, AVSEEK_FLAG_BACKWARD) < 0)
+        return 1;
+
+    for (; ;) {
+        if (av_read_frame(ic, &pkt) < 0)
+            return 1;
+        if (pkt.stream_index == is->video_stream && (pkt.flags & AV_PKT_FLAG_KEY))
+            break;
+        av_free_packet(&pkt);
+    }
+    /* keyframes further apart than a step are found again, skip them */
+    if (packet_index_ts(&pkt) == is->trick_last_ts) {
+        av_free_packet(&pkt);
+        return 0;
+    }
+    is->trick_last_ts = packet_index_ts(&pkt);
+    packet_queue_put(&is->videoq, &pkt);
+    return 0;
+}
+
+static int64_t loop_start(VideoState *is) {
+    int64_t start = is->ic->start_time != AV_NOPTS_VALUE ? is->ic->start_time : 0;
+    if (is->loop_a != AV_NOPTS_VALUE)
+        return start + is->loop_a;
+    return is->opts->start_time != AV_NOPTS_VALUE ? start + is->opts->start_time : start;
+}
+
+static int loop_again(VideoState *is) {
+    if (is->loop_b != AV_NOPTS_VALUE)
+        return 1;
+    return is->opts->loop != 1 && (!is->opts->loop || --is->opts->loop);
+}
+
+/* the index of the skip dts of a stream, -1 if it is not played */
+static int loop_slot(VideoState *is, int stream_index) {
+    if (stream_index == is->video_stream)
+        return 0;
+    if (stream_index == is->audio_stream)
+        return 1;
+    if (stream_index == is->subtitle_stream)
+        return 2;
+    return -1;
+}
+
+static void loop_preroll_free(VideoState *is) {
+    int i;
+
+    for (i = 0; i < is->nb_loop_preroll; i++) {
+        memory_account_add(&is->mem, MEMORY_PACKETS, -(int64_t) is->loop_preroll[i].size);
+        av_packet_unref(&is->loop_preroll[i]);
+    }
+    is->nb_loop_preroll = 0;
+    is->loop_preroll_recording = 0;
+}
+
+/* keep a reference to the packets read first after the loop start, as the
+ * demuxer gives them */
+static void loop_preroll_record(VideoState *is, const AVPacket *pkt) {
+    AVStream *st = is->ic->streams[pkt->stream_index];
+    int64_t ts = packet_ts(pkt);
+    AVPacket *ref;
+
+    if (!is->loop_preroll_recording || loop_slot(is, pkt->stream_index) < 0)
+        return;
+    if (!is->loop_preroll
+        && !(is->loop_preroll = (AVPacket *) av_mallocz_array(LOOP_PREROLL_PACKETS,
+                                                              sizeof(AVPacket)))) {
+        is->loop_preroll_recording = 0;
+        return;
+    }
+    if (is->nb_loop_preroll >= LOOP_PREROLL_PACKETS
+        || (ts != AV_NOPTS_VALUE && av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q)
+                                    - is->loop_preroll_start >= LOOP_PREROLL_DURATION)) {
+        is->loop_preroll_recording = 0;
+        return;
+    }
+    ref = &is->loop_preroll[is->nb_loop_preroll];
+    if (av_packet_ref(ref, pkt) < 0) {
+        is->loop_preroll_recording = 0;
+        return;
+    }
+    is->nb_loop_preroll++;
+    memory_account_add(&is->mem, MEMORY_PACKETS, ref->size);
+}
+
+static void queue_read_packet(VideoState *is, AVPacket *pkt);
+
+/* queue the packets kept from the loop start at once, the demuxer then drops
+ * them again as it catches up behind */
+static void loop_preroll_queue(VideoState *is) {
+    AVPacket pkt;
+    int i, slot;
+
+    for (i = 0; i < is->nb_loop_preroll; i++) {
+        if ((slot = loop_slot(is, is->loop_preroll[i].stream_index)) < 0)
+            continue;
+        if (av_packet_ref(&pkt, &is->loop_preroll[i]) < 0)
+            break;
+        is->loop_skip_dts[slot] = packet_index_ts(&pkt);
+        queue_read_packet(is, &pkt);
+    }
+}
+
+/* whether a packet just read was queued already from the preroll */
+static int loop_preroll_skip(VideoState *is, const AVPacket *pkt) {
+    int slot = loop_slot(is, pkt->stream_index);
+    int64_t ts = packet_index_ts(pkt);
+
+    if (slot < 0 || is->loop_skip_dts[slot] == AV_NOPTS_VALUE)
+        return 0;
+    if (ts != AV_NOPTS_VALUE && ts <= is->loop_skip_dts[slot])
+        return 1;
+    is->loop_skip_dts[slot] = AV_NOPTS_VALUE;
+    return 0;
+}
+
+static void loop_skip_reset(VideoState *is) {
+    int i;
+
+    for (i = 0; i < (int) FF_ARRAY_ELEMS(is->loop_skip_dts); i++)
+        is->loop_skip_dts[i] = AV_NOPTS_VALUE;
+}
+
+/* go on reading from the loop start. Nothing is flushed, the timestamps of the
+ * next iteration just continue where this one ends. The first wrap records
+ * the packets read from the loop start, the next ones queue them before the
+ * demuxer has even seeked, so the decoders never wait at the wrap. */
+static int loop_wrap(VideoState *is) {
+    int64_t start = loop_start(is);
+    int64_t end = is->loop_end;
+    int ret;
+
+    if (is->loop_b != AV_NOPTS_VALUE)
+        end = FFMIN(end, start - is->loop_a + is->loop_b);
+    if ((ret = avformat_seek_file(is->ic, -1, INT64_MIN, start, start, 0)) < 0) {
+        av_log(NULL, AV_LOG_ERROR, "%s: cannot seek to the loop start\n", is->filename);
+        return ret;
+    }
+    is->loop_offset += end - start;
+    is->loop_end = start;
+    is->loop_iteration++;
+
+    loop_skip_reset(is);
+    /* kept for another loop, or the loop ended before it was all kept: it
+     * must not reach B, or queueing it would wrap again */
+    if (is->loop_preroll_start != start || is->loop_preroll_b != is->loop_b
+        || is->loop_preroll_recording)
+        loop_preroll_free(is);
+    if (is->nb_loop_preroll) {
+        loop_preroll_queue(is);
+    } else {
+        is->loop_preroll_start = start;
+        is->loop_preroll_b = is->loop_b;
+        is->loop_preroll_recording = 1;
+    }
+    return 0;
+}
+
+/* apply the looping to a packet just read. Return 1 if it is to be dropped. */
+static int loop_packet(VideoState *is, AVPacket *pkt) {
+    AVStream *st = is->ic->streams[pkt->stream_index];
+    int main_stream = is->video_stream >= 0
+                      && !(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC) ?
+                      is->video_stream : is->audio_stream;
+    int64_t ts = packet_ts(pkt), t, end, offset;
+
+    if (ts == AV_NOPTS_VALUE)
+        return 0;
+    t = av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q);
+    end = t + av_rescale_q(pkt->duration, st->time_base, AV_TIME_BASE_Q);
+
+    if (is->loop_b != AV_NOPTS_VALUE) {
+        int64_t b = loop_start(is) - is->loop_a + is->loop_b;
+        /* video is cut on dts so that every frame before B can still be decoded */
+        int64_t cut = pkt->stream_index == is->video_stream && pkt->dts != AV_NOPTS_VALUE ?
+                      av_rescale_q(pkt->dts, st->time_base, AV_TIME_BASE_Q) : t;
+        if (cut >= b) {
+            if (pkt->stream_index == main_stream)
+                loop_wrap(is);
+            return 1;
+        }
+    }
+    /* the demuxer went back to the keyframe before A, only video needs what is before A */
+    if (is->loop_iteration > 0 && pkt->stream_index != is->video_stream && end <= loop_start(is))
+        return 1;
+
+    is->loop_end = FFMAX(is->loop_end, end);
+    offset = av_rescale_q(is->loop_offset, AV_TIME_BASE_Q, st->time_base);
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts += offset;
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts += offset;
+    return 0;
+}
+
+/* queue a packet read from the demuxer, or drop it */
+static void queue_read_packet(VideoState *is, AVPacket *pkt) {
+    AVFormatContext *ic = is->ic;
+    int64_t stream_start_time, pkt_ts;
+    int pkt_in_play_range;
+
+    /* check if packet is in play range specified by user, then queue, otherwise discard */
+    stream_start_time = ic->streams[pkt->stream_index]->start_time;
+    pkt_ts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    pkt_in_play_range = is->opts->duration == AV_NOPTS_VALUE
+                        || (pkt_ts
+                            - (stream_start_time != AV_NOPTS_VALUE ?
+                               stream_start_time : 0))
+                           * av_q2d(ic->streams[pkt->stream_index]->time_base)
+                           - (double) (
+            is->opts->start_time != AV_NOPTS_VALUE ? is->opts->start_time : 0)
+                             / 1000000 <= ((double) is->opts->duration / 1000000);
+    if (pkt_in_play_range && loop_packet(is, pkt)) {
+        av_free_packet(pkt);
+        return;
+    }
+    if (pkt->stream_index == is->audio_stream && pkt_in_play_range) {
+        packet_queue_put(&is->audioq, pkt);
+    } else if (pkt->stream_index == is->video_stream && pkt_in_play_range
+               && !(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+        packet_queue_put(&is->videoq, pkt);
+    } else if (pkt->stream_index == is->subtitle_stream
+               && pkt_in_play_range) {
+        packet_queue_put(&is->subtitleq, pkt);
+    } else {
+        av_free_packet(pkt);
+    }
+}
+
+/* a preloaded player stops reading once its first frame is decoded, or its
+ * queues hold its share of the pool budget */
+static int preload_done(VideoState *is) {
+    if (!is->preload)
+        return 0;
+    if (is->video_stream >= 0 ? startup_report_time(&is->startup, STARTUP_FIRST_DECODE) != 0
+                              : frame_queue_nb_remaining(&is->sampq) > 0)
+        return 1;
+    return is->audioq.size + is->videoq.size + is->subtitleq.size >= is->preload_budget;
+}
+
+/* this thread gets the stream from the disk or the network */
+static void *read_thread(void *arg) {
+    ALOGI("read_thread");
+    VideoState *is = (VideoState *) arg;
+    AVFormatContext *ic = NULL;
+    int err, i, ret, queue_size;
+    int st_index[AVMEDIA_TYPE_NB];
+    AVPacket pkt1, *pkt = &pkt1;
+    AVDictionaryEntry *t;
+    int orig_nb_streams;
+    pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
+    int64_t trace_time;
+
+    startup_mark(is, STARTUP_READ_THREAD);
+    memset(st_index, -1, sizeof(st_index));
+    is->last_video_stream = is->video_stream = -1;
+    is->last_audio_stream = is->audio_stream = -1;
+    is->last_subtitle_stream = is->subtitle_stream = -1;
+    is->eof = 0;
+
+    ic = avformat_alloc_context();
+    if (!ic) {
+        av_log(NULL, AV_LOG_FATAL, "Could not allocate context.\n");
+        ret = AVERROR(ENOMEM);
+        goto fail;
     }
     ic->interrupt_callback.callback = decode_interrupt_cb;
     ic->interrupt_callback.opaque = is;
@@ -1828,15 +2979,27 @@ static void *read_thread(void *arg) {
     }
 
     is->ic = ic;
+    startup_mark(is, STARTUP_OPEN);
 
-    if (genpts)
+    if (is->opts->genpts)
         ic->flags |= AVFMT_FLAG_GENPTS;
 
     av_format_inject_global_side_data(ic);
 
     orig_nb_streams = ic->nb_streams;
 
-    err = avformat_find_stream_info(ic, NULL);
+    /* a local file opened before does not need to be probed again */
+    if (is->opts->stream_info_cache_dir && ic->pb && !strstr(is->filename, "://"))
+        is->startup.stream_info_cached = stream_info_cache_load(is->opts->stream_info_cache_dir,
+                                                                is->filename, ic);
+    if (is->startup.stream_info_cached) {
+        err = 0;
+    } else {
+        err = avformat_find_stream_info(ic, NULL);
+        if (err >= 0 && is->opts->stream_info_cache_dir && ic->pb && !strstr(is->filename, "://"))
+            stream_info_cache_save(is->opts->stream_info_cache_dir, is->filename, ic);
+    }
+    startup_mark(is, STARTUP_PROBE);
 
 //	for (i = 0; i < orig_nb_streams; i++)
 //		av_dict_free (&opts[i]);
@@ -1851,21 +3014,21 @@ static void *read_thread(void *arg) {
     if (ic->pb)
         ic->pb->eof_reached = 0; // FIXME hack, ffplay maybe should not use avio_feof() to test for the end
 
-    if (seek_by_bytes < 0)
-        seek_by_bytes = !!(ic->iformat->flags & AVFMT_TS_DISCONT)
+    if (is->opts->seek_by_bytes < 0)
+        is->opts->seek_by_bytes = !!(ic->iformat->flags & AVFMT_TS_DISCONT)
                         && strcmp("ogg", ic->iformat->name);
 
     is->max_frame_duration =
             (ic->iformat->flags & AVFMT_TS_DISCONT) ? 10.0 : 3600.0;
 
-    if (!window_title && (t = av_dict_get(ic->metadata, "title", NULL, 0)))
-        window_title = av_asprintf("%s - %s", t->value, input_filename);
+    if (!is->window_title && (t = av_dict_get(ic->metadata, "title", NULL, 0)))
+        is->window_title = av_asprintf("%s - %s", t->value, is->filename);
 
     /* if seeking requested, we execute it */
-    if (start_time != AV_NOPTS_VALUE) {
+    if (is->opts->start_time != AV_NOPTS_VALUE) {
         int64_t timestamp;
 
-        timestamp = start_time;
+        timestamp = is->opts->start_time;
         /* add the stream start time */
         if (ic->start_time != AV_NOPTS_VALUE)
             timestamp += ic->start_time;
@@ -1879,39 +3042,39 @@ static void *read_thread(void *arg) {
 
     is->realtime = is_realtime(ic);
 
-    if (show_status)
+    if (is->opts->show_status)
         av_dump_format(ic, 0, is->filename, 0);
 
     for (i = 0; i < ic->nb_streams; i++) {
         AVStream *st = ic->streams[i];
         enum AVMediaType type = st->codec->codec_type;
         st->discard = AVDISCARD_ALL;
-        if (wanted_stream_spec[type] && st_index[type] == -1) if (
+        if (is->opts->wanted_stream_spec[type] && st_index[type] == -1) if (
                 avformat_match_stream_specifier(ic, st,
-                                                wanted_stream_spec[type]) > 0)
+                                                is->opts->wanted_stream_spec[type]) > 0)
             st_index[type] = i;
     }
     for (i = 0; i < AVMEDIA_TYPE_NB; i++) {
-        if (wanted_stream_spec[i] && st_index[i] == -1) {
+        if (is->opts->wanted_stream_spec[i] && st_index[i] == -1) {
             av_log(NULL, AV_LOG_ERROR,
                    "Stream specifier %s does not match any %s stream\n",
-                   wanted_stream_spec[i],
+                   is->opts->wanted_stream_spec[i],
                    av_get_media_type_string(AVMediaType(i)));
             st_index[i] = INT_MAX;
         }
     }
 
-    if (!video_disable)
+    if (!is->opts->video_disable)
         st_index[AVMEDIA_TYPE_VIDEO] = av_find_best_stream(ic,
                                                            AVMEDIA_TYPE_VIDEO,
                                                            st_index[AVMEDIA_TYPE_VIDEO], -1, NULL,
                                                            0);
-    if (!audio_disable)
+    if (!is->opts->audio_disable && is->audio_sink)
         st_index[AVMEDIA_TYPE_AUDIO] = av_find_best_stream(ic,
                                                            AVMEDIA_TYPE_AUDIO,
                                                            st_index[AVMEDIA_TYPE_AUDIO],
                                                            st_index[AVMEDIA_TYPE_VIDEO], NULL, 0);
-    if (!video_disable && !subtitle_disable)
+    if (!is->opts->video_disable && !is->opts->subtitle_disable)
         st_index[AVMEDIA_TYPE_SUBTITLE] = av_find_best_stream(ic,
                                                               AVMEDIA_TYPE_SUBTITLE,
                                                               st_index[AVMEDIA_TYPE_SUBTITLE],
@@ -1920,31 +3083,43 @@ static void *read_thread(void *arg) {
                                                                st_index[AVMEDIA_TYPE_VIDEO]), NULL,
                                                               0);
 
-    is->show_mode = show_mode;
     if (st_index[AVMEDIA_TYPE_VIDEO] >= 0) {
         AVStream *st = ic->streams[st_index[AVMEDIA_TYPE_VIDEO]];
         AVCodecContext *avctx = st->codec;
         AVRational sar = av_guess_sample_aspect_ratio(ic, st, NULL);
         if (avctx->width)
-            set_default_window_size(avctx->width, avctx->height, sar);
+            set_default_window_size(is, avctx->width, avctx->height, sar);
+
+        /* a preloaded player gets its window when promoted */
+        if (is->video_sink) {
+            is->video_sink->setBuffersGeometry(avctx->width, avctx->height);
+            is->buffers_width = avctx->width;
+            is->buffers_height = avctx->height;
+        }
+    }
 
-        ANativeWindow_setBuffersGeometry(is->window, avctx->width, avctx->height,
-                                         WINDOW_FORMAT_RGBA_8888);
+    /* open the streams, for a fast start the video first so that it is
+     * decoding while the audio player is created */
+    ret = -1;
+    if (is->opts->fast_start && st_index[AVMEDIA_TYPE_VIDEO] >= 0) {
+        ret = stream_component_open(is, st_index[AVMEDIA_TYPE_VIDEO]);
     }
 
-    /* open the streams */
     if (st_index[AVMEDIA_TYPE_AUDIO] >= 0) {
         stream_component_open(is, st_index[AVMEDIA_TYPE_AUDIO]);
     }
 
-    ret = -1;
-    if (st_index[AVMEDIA_TYPE_VIDEO] >= 0) {
+    if (!is->opts->fast_start && st_index[AVMEDIA_TYPE_VIDEO] >= 0) {
         ret = stream_component_open(is, st_index[AVMEDIA_TYPE_VIDEO]);
     }
 
     if (st_index[AVMEDIA_TYPE_SUBTITLE] >= 0) {
         stream_component_open(is, st_index[AVMEDIA_TYPE_SUBTITLE]);
+        /* local files are cheap to read twice, index all their subtitle tracks */
+        if (is->opts->subtitle_index && !is->realtime && ic->pb && !strstr(is->filename, "://"))
+            subtitle_index_open(&is->sub_index, is->filename, &is->mem);
     }
+    startup_mark(is, STARTUP_CODEC_OPEN);
 
     if (is->video_stream < 0 && is->audio_stream < 0) {
         av_log(NULL, AV_LOG_FATAL,
@@ -1954,8 +3129,8 @@ static void *read_thread(void *arg) {
         goto fail;
     }
 
-    if (infinite_buffer < 0 && is->realtime)
-        infinite_buffer = 1;
+    if (is->opts->infinite_buffer < 0 && is->realtime)
+        is->opts->infinite_buffer = 1;
 
     for (; ;) {
         if (is->abort_request)
@@ -1970,47 +3145,80 @@ static void *read_thread(void *arg) {
 #if CONFIG_RTSP_DEMUXER || CONFIG_MMSH_PROTOCOL
         if (is->paused &&
                 (!strcmp(ic->iformat->name, "rtsp") ||
-                        (ic->pb && !strncmp(input_filename, "mmsh:", 5)))) {
+                        (ic->pb && !strncmp(is->opts->input_filename, "mmsh:", 5)))) {
             /* wait 10 ms to avoid trying to get another packet */
             /* XXX: horrible */
             SDL_Delay(10);
             continue;
         }
 #endif
+        if (is->reverse_req)
+            reverse_playback(is);
+        if (is->trick_req)
+            trick_play(is);
+        if (is->seek_req && is->trick_speed) {
+            /* go on stepping from the seek target */
+            flush_packet_queues(is);
+            is->trick_pos = is->seek_pos / (double) AV_TIME_BASE;
+            is->trick_last_ts = AV_NOPTS_VALUE;
+            is->seek_req = 0;
+        }
+        if (is->seek_req && is->reverse_speed > 0) {
+            /* restart going backwards from the seek target */
+            flush_for_reverse(is);
+            reverse_decoder_start(&is->revdec, is->seek_pos / (double) AV_TIME_BASE,
+                                  is->videoq.serial);
+            is->seek_req = 0;
+            if (is->paused)
+                step_to_next_frame(is);
+        }
         if (is->seek_req) {
+            TRACE_SCOPE("seek");
             int64_t seek_target = is->seek_pos;
-            int64_t seek_min =
-                    is->seek_rel > 0 ?
-                    seek_target - is->seek_rel + 2 : INT64_MIN;
-            int64_t seek_max =
-                    is->seek_rel < 0 ?
-                    seek_target - is->seek_rel - 2 : INT64_MAX;
-// FIXME the +-2 is due to rounding being not done in the correct direction in generation
-//      of the seek_pos/seek_rel variables
+            int64_t seek_min, seek_max;
+
+            seek_bounds(is, &seek_min, &seek_max);
+            /* both the rewind and the real seek start a new video serial */
+            is->frame_seek_serial = is->seek_exact ? is->videoq.serial + 1 : -1;
+            is->seek_exact = 0;
 
-            ret = avformat_seek_file(is->ic, -1, seek_min, seek_target,
-                                     seek_max, is->seek_flags);
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "%s: error while seeking\n",
+            if (!(is->seek_flags & AVSEEK_FLAG_BYTE)
+                && back_buffer_rewind(is, seek_target)) {
+                av_log(NULL, AV_LOG_VERBOSE, "%s: seek replayed from the back-buffer\n",
                        is->ic->filename);
+                set_clock(&is->extclk, seek_target / (double) AV_TIME_BASE, 0);
             } else {
-                if (is->audio_stream >= 0) {
-                    packet_queue_flush(&is->audioq);
-                    packet_queue_put(&is->audioq, &flush_pkt);
-                }
-                if (is->subtitle_stream >= 0) {
-                    packet_queue_flush(&is->subtitleq);
-                    packet_queue_put(&is->subtitleq, &flush_pkt);
-                }
-                if (is->video_stream >= 0) {
-                    packet_queue_flush(&is->videoq);
-                    packet_queue_put(&is->videoq, &flush_pkt);
-                }
-                if (is->seek_flags & AVSEEK_FLAG_BYTE) {
-                    set_clock(&is->extclk, NAN, 0);
+                ret = avformat_seek_file(is->ic, -1, seek_min, seek_target,
+                                         seek_max, is->seek_flags);
+                if (ret < 0) {
+                    av_log(NULL, AV_LOG_ERROR, "%s: error while seeking\n",
+                           is->ic->filename);
+                    /* no new serial is coming to end the exact seek */
+                    is->frame_seek_serial = -1;
                 } else {
-                    set_clock(&is->extclk, seek_target / (double) AV_TIME_BASE,
-                              0);
+                    /* the back-buffers hold the shifted timestamps, a real seek starts over */
+                    is->loop_offset = 0;
+                    is->loop_end = 0;
+                    is->loop_iteration = 0;
+                    loop_skip_reset(is);
+                    if (is->audio_stream >= 0) {
+                        packet_queue_flush(&is->audioq);
+                        packet_queue_put(&is->audioq, &flush_pkt);
+                    }
+                    if (is->subtitle_stream >= 0) {
+                        packet_queue_flush(&is->subtitleq);
+                        packet_queue_put(&is->subtitleq, &flush_pkt);
+                    }
+                    if (is->video_stream >= 0) {
+                        packet_queue_flush(&is->videoq);
+                        packet_queue_put(&is->videoq, &flush_pkt);
+                    }
+                    if (is->seek_flags & AVSEEK_FLAG_BYTE) {
+                        set_clock(&is->extclk, NAN, 0);
+                    } else {
+                        set_clock(&is->extclk, seek_target / (double) AV_TIME_BASE,
+                                  0);
+                    }
                 }
             }
             is->seek_req = 0;
@@ -2032,10 +3240,17 @@ static void *read_thread(void *arg) {
             is->queue_attachments_req = 0;
         }
 
+        queue_size = memory_budget_apply(is);
+        back_buffer_trim(is, queue_size);
+
+        if (is->trick_speed && !trick_play_read(is))
+            continue;
+
         /* if the queue are full, no need to read more */
-        if (infinite_buffer < 1
+        if (is->reverse_speed > 0 || is->trick_speed || preload_done(is)
+            || (is->opts->infinite_buffer < 1
             && (is->audioq.size + is->videoq.size + is->subtitleq.size
-                > MAX_QUEUE_SIZE
+                > queue_size
                 || ((is->audioq.nb_packets > MIN_FRAMES
                      || is->audio_stream < 0
                      || is->audioq.abort_request)
@@ -2046,7 +3261,7 @@ static void *read_thread(void *arg) {
                             & AV_DISPOSITION_ATTACHED_PIC))
                     && (is->subtitleq.nb_packets > MIN_FRAMES
                         || is->subtitle_stream < 0
-                        || is->subtitleq.abort_request)))) {
+                        || is->subtitleq.abort_request))))) {
             /* wait 10 ms */
             struct timeval delta;
             struct timespec abstime;
@@ -2069,18 +3284,19 @@ static void *read_thread(void *arg) {
             && (!is->video_st
                 || (is->viddec.finished == is->videoq.serial
                     && frame_queue_nb_remaining(&is->pictq) == 0))) {
-            if (loop != 1 && (!loop || --loop)) {
-                stream_seek(is, start_time != AV_NOPTS_VALUE ? start_time : 0,
-                            0, 0);
-            } else if (autoexit) {
+            if (is->opts->autoexit) {
                 ret = AVERROR_EOF;
                 goto fail;
             }
         }
+        trace_time = trace_begin();
         ret = av_read_frame(ic, pkt);
+        trace_end("demux", trace_time);
 
         if (ret < 0) {
             if ((ret == AVERROR_EOF || avio_feof(ic->pb)) && !is->eof) {
+                if (loop_again(is) && loop_wrap(is) >= 0)
+                    continue;
                 if (is->video_stream >= 0)
                     packet_queue_put_nullpacket(&is->videoq, is->video_stream);
                 if (is->audio_stream >= 0)
@@ -2108,29 +3324,14 @@ static void *read_thread(void *arg) {
             continue;
         } else {
             is->eof = 0;
+            __atomic_fetch_add(&is->bytes_read, (int64_t) pkt->size, __ATOMIC_RELAXED);
         }
-        /* check if packet is in play range specified by user, then queue, otherwise discard */
-        stream_start_time = ic->streams[pkt->stream_index]->start_time;
-        pkt_ts = pkt->pts == AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
-        pkt_in_play_range = duration == AV_NOPTS_VALUE
-                            || (pkt_ts
-                                - (stream_start_time != AV_NOPTS_VALUE ?
-                                   stream_start_time : 0))
-                               * av_q2d(ic->streams[pkt->stream_index]->time_base)
-                               - (double) (
-                start_time != AV_NOPTS_VALUE ? start_time : 0)
-                                 / 1000000 <= ((double) duration / 1000000);
-        if (pkt->stream_index == is->audio_stream && pkt_in_play_range) {
-            packet_queue_put(&is->audioq, pkt);
-        } else if (pkt->stream_index == is->video_stream && pkt_in_play_range
-                   && !(is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
-            packet_queue_put(&is->videoq, pkt);
-        } else if (pkt->stream_index == is->subtitle_stream
-                   && pkt_in_play_range) {
-            packet_queue_put(&is->subtitleq, pkt);
-        } else {
+        if (loop_preroll_skip(is, pkt)) {
             av_free_packet(pkt);
+            continue;
         }
+        loop_preroll_record(is, pkt);
+        queue_read_packet(is, pkt);
     }
     /* wait until the end */
     while (!is->abort_request) {
@@ -2162,7 +3363,9 @@ static void *read_thread(void *arg) {
     return 0;
 }
 
-static VideoState *stream_open(const char *filename, FFPlayer *pPlayer) {
+static VideoState *stream_open(const char *filename, FFPlayer *pPlayer, PlayerOptions *opts,
+                               TimeSource *time_source,
+                               int64_t prepare_time) {
     ALOGI("stream_open");
     VideoState *is;
 
@@ -2171,9 +3374,19 @@ static VideoState *stream_open(const char *filename, FFPlayer *pPlayer) {
         return NULL;
     av_strlcpy(is->filename, filename, sizeof(is->filename));
     is->player = pPlayer;
+    is->opts = opts;
+    is->time_source = time_source;
+    is->executor_focused = opts->focused;
+    executor_player_add(executor_get(), is->executor_focused);
+    startup_report_init(&is->startup, prepare_time);
+    is->startup.fast_start = is->opts->fast_start;
     is->ytop = 0;
     is->xleft = 0;
     is->messageQueue = new MessageQueue();
+    is->visualizer_mutex = PTHREAD_MUTEX_INITIALIZER;
+    is->mem.budget = opts->memory_budget;
+    memory_account_add(&is->mem, MEMORY_PLAYER, sizeof(VideoState));
+    set_show_mode(is, opts->show_mode);
 
     /* start video display */
     if (frame_queue_init(&is->pictq, &is->videoq, VIDEO_PICTURE_QUEUE_SIZE, 1)
@@ -2182,20 +3395,32 @@ static VideoState *stream_open(const char *filename, FFPlayer *pPlayer) {
     if (frame_queue_init(&is->subpq, &is->subtitleq, SUBPICTURE_QUEUE_SIZE, 0)
         < 0)
         goto fail;
+    subtitle_scalers_init(&is->sub_scalers, is->opts->sws_flags);
     if (frame_queue_init(&is->sampq, &is->audioq, SAMPLE_QUEUE_SIZE, 1) < 0)
         goto fail;
 
-    packet_queue_init(&is->videoq);
-    packet_queue_init(&is->audioq);
-    packet_queue_init(&is->subtitleq);
+    packet_queue_init(&is->videoq, &is->mem);
+    packet_queue_init(&is->audioq, &is->mem);
+    packet_queue_init(&is->subtitleq, &is->mem);
 
     is->continue_read_thread = PTHREAD_COND_INITIALIZER;
 
-    init_clock(&is->vidclk, &is->videoq.serial);
-    init_clock(&is->audclk, &is->audioq.serial);
-    init_clock(&is->extclk, &is->extclk.serial);
+    frame_cache_init(&is->frame_cache, is->opts->frame_cache_size, &is->mem);
+    if (!(is->step_frame.frame = av_frame_alloc()))
+        goto fail;
+    is->step_back_pts = NAN;
+    is->step_back_pending = NAN;
+    is->frame_seek_serial = -1;
+    is->loop_a = opts->loop_a;
+    is->loop_b = opts->loop_b;
+    is->loop_preroll_start = AV_NOPTS_VALUE;
+    loop_skip_reset(is);
+
+    init_clock(&is->vidclk, &is->videoq.serial, is->time_source);
+    init_clock(&is->audclk, &is->audioq.serial, is->time_source);
+    init_clock(&is->extclk, &is->extclk.serial, is->time_source);
     is->audio_clock_serial = -1;
-    is->av_sync_type = av_sync_type;
+    is->av_sync_type = is->opts->av_sync_type;
 
     pthread_create(&is->read_tid, NULL, read_thread, is);
     pthread_setname_np(is->read_tid, "read_thread");
@@ -2288,16 +3513,148 @@ static void toggle_full_screen(VideoState *is) {
 static void toggle_audio_display(VideoState *is) {
 }
 
+/* waiting for the next picture to be decoded rather than to be due, which
+ * holds a virtual time source back */
+static int refresh_waits_for_data(VideoState *is) {
+    int64_t now;
+
+    if (is->paused
+        || (startup_report_time(&is->startup, STARTUP_CODEC_OPEN)
+            && (!is->video_st || frame_queue_nb_remaining(&is->pictq) > 0
+                || is->viddec.finished == is->videoq.serial))) {
+        is->data_wait_start = 0;
+        return 0;
+    }
+    /* not for ever, the demuxer may wait for the audio to drain, which waits for time */
+    now = av_gettime_relative();
+    if (!is->data_wait_start)
+        is->data_wait_start = now;
+    return now - is->data_wait_start < DATA_WAIT_MAX;
+}
+
+/* publish the stats for the app, at most every STATS_UPDATE_INTERVAL */
+static void update_stats(VideoState *is) {
+    int64_t now = is->time_source->now();
+    StatsWindow *base = &is->stats_window[0], *last = &is->stats_window[1];
+    LatencyHistogram decode, convert;
+    int64_t bytes_read;
+    PlayerStats s;
+
+    if (is->stats_time && now - is->stats_time < STATS_UPDATE_INTERVAL)
+        return;
+    is->stats_time = now;
+
+    latency_histogram_copy(&decode, &is->decode_hist);
+    latency_histogram_copy(&convert, &is->convert_hist);
+    bytes_read = __atomic_load_n(&is->bytes_read, __ATOMIC_RELAXED);
+    /* the percentiles and the bitrate are over what happened since the
+     * window before the current one started */
+    if (!last->start || now - last->start >= STATS_WINDOW) {
+        *base = last->start ? *last : (StatsWindow) {now, decode, convert, bytes_read};
+        last->start = now;
+        last->decode = decode;
+        last->convert = convert;
+        last->bytes_read = bytes_read;
+    }
+
+    memset(&s, 0, sizeof(s));
+    s.time = now;
+    s.master_clock = get_master_clock(is);
+    if (is->audio_st && is->video_st)
+        s.av_diff = get_clock(&is->audclk) - get_clock(&is->vidclk);
+    else if (is->video_st)
+        s.av_diff = get_master_clock(is) - get_clock(&is->vidclk);
+    else if (is->audio_st)
+        s.av_diff = get_master_clock(is) - get_clock(&is->audclk);
+    if (isnan(s.av_diff))
+        s.av_diff = 0;
+    else if (!is->paused && (is->audio_st || is->video_st))
+        is->stats_drift[stats_drift_bucket(s.av_diff)]++;
+    if (is->audio_st) {
+        s.audioq_bytes = is->audioq.size;
+        s.audioq_seconds = packet_queue_duration(&is->audioq, is->audio_st->time_base);
+        s.sampq_frames = frame_queue_nb_remaining(&is->sampq);
+    }
+    if (is->video_st) {
+        s.videoq_bytes = is->videoq.size;
+        s.videoq_seconds = packet_queue_duration(&is->videoq, is->video_st->time_base);
+        s.pictq_frames = frame_queue_nb_remaining(&is->pictq);
+        s.faulty_dts = is->video_st->codec->pts_correction_num_faulty_dts;
+        s.faulty_pts = is->video_st->codec->pts_correction_num_faulty_pts;
+    }
+    if (is->subtitle_st)
+        s.subtitleq_bytes = is->subtitleq.size;
+    s.decode_p50 = latency_histogram_percentile(&decode, &base->decode, 0.50);
+    s.decode_p90 = latency_histogram_percentile(&decode, &base->decode, 0.90);
+    s.decode_p99 = latency_histogram_percentile(&decode, &base->decode, 0.99);
+    s.convert_p50 = latency_histogram_percentile(&convert, &base->convert, 0.50);
+    s.convert_p90 = latency_histogram_percentile(&convert, &base->convert, 0.90);
+    s.convert_p99 = latency_histogram_percentile(&convert, &base->convert, 0.99);
+    s.frames_displayed = is->frames_displayed;
+    s.drops_early = is->frame_drops_early;
+    s.drops_late = is->frame_drops_late;
+    s.audio_underruns = __atomic_load_n(&is->audio_underruns, __ATOMIC_RELAXED);
+    if (now > base->start)
+        s.bitrate = (bytes_read - base->bytes_read) * 8 * 1000000 / (now - base->start);
+    memcpy(s.drift, is->stats_drift, sizeof(s.drift));
+    stats_snapshot_publish(&is->stats, &s);
+}
+
 static void refresh_loop_wait_event(VideoState *is, Message &msg) {
     double remaining_time = 0.0;
     while (!is->messageQueue->popMessage(msg)) {
-        if (remaining_time > 0.0)
-            av_usleep((int64_t) (remaining_time * 1000000.0));
+        if (remaining_time > 0.0) {
+            if (!refresh_waits_for_data(is))
+                is->time_source->sleepUntil(is->time_source->now()
+                                            + (int64_t) (remaining_time * 1000000.0));
+            else if (is->video_st)
+                frame_queue_wait(&is->pictq, remaining_time);
+            else
+                av_usleep((int64_t) (remaining_time * 1000000.0));
+        }
         remaining_time = REFRESH_RATE;
-        if (is->show_mode != VideoState::SHOW_MODE_NONE
+        if (is->startup.fast_start
+            && !startup_report_time(&is->startup, STARTUP_FIRST_DISPLAY))
+            remaining_time = FAST_START_REFRESH_RATE;
+        if (is->show_mode != VideoState::SHOW_MODE_NONE && is->video_sink
             && (!is->paused || is->force_refresh))
             video_refresh(is, &remaining_time);
+        update_stats(is);
+        /* the exact seek of a step back has shown its first frame, step back from it */
+        if (!isnan(is->step_back_pending) && is->paused && !is->seek_req
+            && is->frame_seek_serial < 0 && is->vidclk.serial == is->videoq.serial)
+            step_to_prev_frame(is);
+    }
+}
+
+/* show a preloaded player on its window and play it, the first frame is
+ * already decoded */
+static void stream_promote(VideoState *is) {
+    VideoSink *sink = is->promote_sink;
+    int width = sink->getWidth();
+    int height = sink->getHeight();
+
+    /* the player owns its sink, the one replaced is not used anymore */
+    delete is->video_sink;
+    is->video_sink = sink;
+    if (width != is->surface_width || height != is->surface_height) {
+        is->surface_width = width;
+        is->surface_height = height;
+        is->surface_changed = 1;
+    }
+    is->preload = 0;
+    if (is->audio_device_deferred) {
+        is->audio_device_deferred = 0;
+        if (!pthread_create(&is->audio_device_tid, NULL, audio_device_thread, is)) {
+            pthread_setname_np(is->audio_device_tid, "audio_device");
+            is->audio_device_pending = 1;
+        } else {
+            audio_device_open(is);
+        }
     }
+    if (is->paused)
+        toggle_pause(is);
+    pthread_cond_signal(&is->continue_read_thread);
 }
 
 static void seek_chapter(VideoState *is, int incr) {
@@ -2499,8 +3856,35 @@ static void *event_loop(void *arg) {
 //                    stream_seek(cur_stream, ts, 0, 0);
 //                }
 //                break;
+            case FF_START_EVENT:
+                if (cur_stream->paused)
+                    toggle_pause(cur_stream);
+                break;
+            case FF_PAUSE_EVENT:
+                if (!cur_stream->paused)
+                    toggle_pause(cur_stream);
+                break;
+            case FF_STEP_EVENT:
+                step_forward(cur_stream);
+                break;
+            case FF_STEP_BACK_EVENT:
+                step_to_prev_frame(cur_stream);
+                break;
+            case FF_SUBTITLE_TRACK_EVENT:
+                stream_cycle_channel(cur_stream, AVMEDIA_TYPE_SUBTITLE);
+                break;
+            case FF_PROMOTE_EVENT:
+                stream_promote(cur_stream);
+                break;
+            case FF_SHOW_MODE_EVENT:
+                set_show_mode(cur_stream, cur_stream->opts->show_mode);
+                break;
+            case FF_VISUALIZER_EVENT:
+                update_visualizer(cur_stream);
+                break;
             case FF_QUIT_EVENT:
                 ALOGD("FF_QUIT_EVENT");
+                cur_stream->time_source->leave();
                 do_exit(cur_stream);
                 goto out;
                 break;
@@ -2513,8 +3897,9 @@ static void *event_loop(void *arg) {
 }
 
 static int opt_format(void *optctx, const char *opt, const char *arg) {
-    file_iformat = av_find_input_format(arg);
-    if (!file_iformat) {
+    PlayerOptions *o = (PlayerOptions *) optctx;
+    o->file_iformat = av_find_input_format(arg);
+    if (!o->file_iformat) {
         av_log(NULL, AV_LOG_FATAL, "Unknown input format: %s\n", arg);
         return AVERROR(EINVAL);
     }
@@ -2522,12 +3907,13 @@ static int opt_format(void *optctx, const char *opt, const char *arg) {
 }
 
 static int opt_sync(void *optctx, const char *opt, const char *arg) {
+    PlayerOptions *o = (PlayerOptions *) optctx;
     if (!strcmp(arg, "audio"))
-        av_sync_type = AV_SYNC_AUDIO_MASTER;
+        o->av_sync_type = AV_SYNC_AUDIO_MASTER;
     else if (!strcmp(arg, "video"))
-        av_sync_type = AV_SYNC_VIDEO_MASTER;
+        o->av_sync_type = AV_SYNC_VIDEO_MASTER;
     else if (!strcmp(arg, "ext"))
-        av_sync_type = AV_SYNC_EXTERNAL_CLOCK;
+        o->av_sync_type = AV_SYNC_EXTERNAL_CLOCK;
     else {
         av_log(NULL, AV_LOG_ERROR, "Unknown value for %s: %s\n", opt, arg);
         exit(1);
@@ -2536,18 +3922,20 @@ static int opt_sync(void *optctx, const char *opt, const char *arg) {
 }
 
 static void opt_input_file(void *optctx, const char *filename) {
-    if (input_filename) {
+    PlayerOptions *o = (PlayerOptions *) optctx;
+    if (o->input_filename) {
         av_log(NULL, AV_LOG_FATAL,
                "Argument '%s' provided as input filename, but '%s' was already specified.\n",
-               filename, input_filename);
+               filename, o->input_filename);
         exit(1);
     }
     if (!strcmp(filename, "-"))
         filename = "pipe:";
-    input_filename = filename;
+    o->input_filename = filename;
 }
 
 static int dummy;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
 
 static int lockmgr(void **mutex, enum AVLockOp op) {
     int ret = 0;
@@ -2574,20 +3962,42 @@ static int lockmgr(void **mutex, enum AVLockOp op) {
 
 using namespace ffplayer;
 
-FFPlayer::FFPlayer() {
+FFPlayer::FFPlayer() : is(NULL), mVideoSink(NULL), mAudioSink(NULL),
+                       mTimeSource(time_source_system()), mOnExit(NULL),
+                       mOnExitOpaque(NULL), mSurfaceWidth(0), mSurfaceHeight(0),
+                       mPreloadBudget(0) {
     ALOGI("FFPlayer()");
+    player_options_init(&mOptions);
 }
 
 FFPlayer::~FFPlayer() {
     ALOGI("~FFPlayer()");
+    /* the VideoState is gone, promote() left the sink it shows on here */
+    delete mVideoSink;
+    delete mAudioSink;
+    av_freep(&mOptions.stream_info_cache_dir);
+    if (mOnExit)
+        mOnExit(mOnExitOpaque);
+}
+
+void FFPlayer::sendMessage(uint8_t messageCode) {
+    Message event;
+
+    event.messageCode = messageCode;
+    event.p_message = is;
+    is->messageQueue->sendMessage(event);
 }
 
 void FFPlayer::start() {
     ALOGI("start");
+    if (is)
+        sendMessage(FF_START_EVENT);
 }
 
 void FFPlayer::pause() {
     ALOGI("pause");
+    if (is)
+        sendMessage(FF_PAUSE_EVENT);
 }
 
 void FFPlayer::setDataSource(const char *path) {
@@ -2609,34 +4019,51 @@ void ffmpeg_log_callback(void *avcl, int level, const char *fmt, va_list vl) {
         prio = ANDROID_LOG_VERBOSE;
     else if (level <= AV_LOG_TRACE)
         prio = ANDROID_LOG_DEBUG;
-    // TODO use log.h
-    __android_log_vprint(prio, "ffmpeg", fmt, vl);
+    platform_log_vprint(prio, "ffmpeg", fmt, vl);
 }
 
-
-void FFPlayer::prepare() {
-    ALOGI("prepare");
+/* shared by all the players of the process, which may be several at a time */
+static void init_ffmpeg() {
     av_log_set_flags(AV_LOG_SKIP_REPEATED);
     av_log_set_callback(ffmpeg_log_callback);
 
     av_register_all();
     avformat_network_init();
 
-    if (av_lockmgr_register(lockmgr)) {
+    if (av_lockmgr_register(lockmgr))
         av_log(NULL, AV_LOG_FATAL, "Could not initialize lock manager!\n");
-        do_exit(NULL);
-    }
 
     av_init_packet(&flush_pkt);
     flush_pkt.data = (uint8_t *) &flush_pkt;
+}
+
+void ffplayer::ffmpeg_init() {
+    pthread_once(&init_once, init_ffmpeg);
+}
+
+void FFPlayer::prepare() {
+    ALOGI("prepare");
+    int64_t prepare_time = av_gettime_relative();
+    ffmpeg_init();
 
-    is = stream_open(mPath.c_str(), this);
+    /* for the event loop, before the read thread can start the audio sink */
+    mTimeSource->join();
+    is = stream_open(mPath.c_str(), this, &mOptions, mTimeSource, prepare_time);
     if (!is) {
         av_log(NULL, AV_LOG_FATAL, "Failed to initialize VideoState!\n");
+        mTimeSource->leave();
         do_exit(NULL);
     }
 
-    is->window = mWindow;
+    is->video_sink = mVideoSink;
+    is->audio_sink = mAudioSink;
+    is->surface_width = mSurfaceWidth;
+    is->surface_height = mSurfaceHeight;
+    if (mPreloadBudget > 0 && !mVideoSink) {
+        is->preload = 1;
+        is->preload_budget = mPreloadBudget;
+        is->paused = is->audclk.paused = is->vidclk.paused = is->extclk.paused = 1;
+    }
     pthread_t event_tid;
     pthread_create(&event_tid, NULL, event_loop, is);
     pthread_setname_np(event_tid, "event_thread");
@@ -2652,28 +4079,247 @@ void FFPlayer::release() {
 }
 
 void FFPlayer::seekTo(int64_t seekTimeUs) {
-    // TODO use seekTimeUs
-    double incr = 60;
-    double pos = get_master_clock(is);
-    if (isnan(pos))
-        pos = (double) is->seek_pos / AV_TIME_BASE;
-    pos += incr;
-    if (is->ic->start_time != AV_NOPTS_VALUE
-        && pos
-           < is->ic->start_time
-             / (double) AV_TIME_BASE)
-        pos =
-                is->ic->start_time
-                / (double) AV_TIME_BASE;
+    double cur = get_master_clock(is);
+    if (isnan(cur))
+        cur = (double) is->seek_pos / AV_TIME_BASE;
+    double pos = seekTimeUs / (double) AV_TIME_BASE;
+    if (is->ic->start_time != AV_NOPTS_VALUE)
+        pos += is->ic->start_time / (double) AV_TIME_BASE;
+    double incr = pos - cur;
     stream_seek(is, (int64_t) (pos * AV_TIME_BASE),
                 (int64_t) (incr * AV_TIME_BASE), 0);
 }
 
-void FFPlayer::setWindow(ANativeWindow *window) {
-    ALOGI("setWindow");
-    mWindow = window;
+void FFPlayer::setVideoSink(VideoSink *sink) {
+    ALOGI("setVideoSink");
+    if (is) {
+        ALOGW("setVideoSink after prepare is ignored");
+        delete sink;
+        return;
+    }
+    delete mVideoSink;
+    mVideoSink = sink;
+    /* until the buffer geometry is set the buffers have the size of the surface */
+    mSurfaceWidth = sink->getWidth();
+    mSurfaceHeight = sink->getHeight();
+}
+
+void FFPlayer::setAudioSink(AudioSink *sink) {
+    ALOGI("setAudioSink");
+    if (is) {
+        ALOGW("setAudioSink after prepare is ignored");
+        delete sink;
+        return;
+    }
+    delete mAudioSink;
+    mAudioSink = sink;
+}
+
+void FFPlayer::cycleSubtitleTrack() {
+    ALOGI("cycleSubtitleTrack");
+    if (is)
+        sendMessage(FF_SUBTITLE_TRACK_EVENT);
+}
+
+void FFPlayer::setStreamInfoCacheDir(const char *dir) {
+    ALOGI("setStreamInfoCacheDir %s", dir ? dir : "(null)");
+    av_freep(&mOptions.stream_info_cache_dir);
+    if (dir)
+        mOptions.stream_info_cache_dir = av_strdup(dir);
+}
+
+void FFPlayer::setPreloadBudget(int sizeBytes) {
+    ALOGI("setPreloadBudget %d", sizeBytes);
+    mPreloadBudget = sizeBytes;
+    if (is) {
+        is->preload_budget = sizeBytes;
+        pthread_cond_signal(&is->continue_read_thread);
+    }
+}
+
+void FFPlayer::setShowMode(int mode) {
+    ALOGI("setShowMode %d", mode);
+    if (mode < VideoState::SHOW_MODE_NONE || mode >= VideoState::SHOW_MODE_NB)
+        return;
+    mOptions.show_mode = mode;
+    if (is)
+        sendMessage(FF_SHOW_MODE_EVENT);
+}
+
+void FFPlayer::setMemoryBudget(int64_t bytes) {
+    ALOGI("setMemoryBudget %lld", (long long) bytes);
+    mOptions.memory_budget = bytes;
+    if (is) {
+        __atomic_store_n(&is->mem.budget, bytes, __ATOMIC_RELAXED);
+        pthread_cond_signal(&is->continue_read_thread);
+    }
+}
+
+void FFPlayer::getMemoryReport(MemoryAccount *report) {
+    if (!is) {
+        memset(report, 0, sizeof(*report));
+        report->budget = mOptions.memory_budget;
+        return;
+    }
+    memory_account_copy(report, &is->mem);
+}
+
+void FFPlayer::setVisualizationRate(int rate) {
+    ALOGI("setVisualizationRate %d", rate);
+    if (rate < 0)
+        return;
+    mOptions.visualization_rate = rate;
+    if (is)
+        sendMessage(FF_VISUALIZER_EVENT);
+}
+
+void FFPlayer::getVisualization(VisualizerFrame *frame) {
+    if (!is) {
+        memset(frame, 0, sizeof(*frame));
+        return;
+    }
+    pthread_mutex_lock(&is->visualizer_mutex);
+    /* without a frame when busy, the app keeps the one it has */
+    if (is->visualizer) {
+        audio_visualizer_read(is->visualizer, frame);
+        frame->sample_rate = is->audio_tgt.freq;
+    } else {
+        memset(frame, 0, sizeof(*frame));
+    }
+    pthread_mutex_unlock(&is->visualizer_mutex);
+}
+
+void FFPlayer::promote(VideoSink *sink) {
+    ALOGI("promote");
+    mVideoSink = sink;
+    is->promote_sink = sink;
+    sendMessage(FF_PROMOTE_EVENT);
+}
+
+void FFPlayer::setAutoExit(bool autoExit) {
+    mOptions.autoexit = autoExit ? 1 : 0;
+}
+
+void FFPlayer::setTimeSource(TimeSource *timeSource) {
+    mTimeSource = timeSource;
+}
+
+void FFPlayer::setOnExit(void (*callback)(void *opaque), void *opaque) {
+    mOnExit = callback;
+    mOnExitOpaque = opaque;
+}
+
+void FFPlayer::setFocused(bool focused) {
+    ALOGI("setFocused %d", focused);
+    mOptions.focused = focused ? 1 : 0;
+    if (is) {
+        executor_player_focus(executor_get(), is->executor_focused, mOptions.focused);
+        is->executor_focused = mOptions.focused;
+    }
+}
+
+void FFPlayer::setFastStart(bool fastStart) {
+    mOptions.fast_start = fastStart ? 1 : 0;
+}
+
+void FFPlayer::getStartupReport(StartupReport *report) {
+    if (!is) {
+        memset(report, 0, sizeof(*report));
+        return;
+    }
+    startup_report_copy(report, &is->startup);
+}
+
+void FFPlayer::getStats(PlayerStats *stats) {
+    if (!is) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    stats_snapshot_read(&is->stats, stats);
+}
+
+void FFPlayer::setSurfaceSize(int width, int height) {
+    ALOGI("setSurfaceSize %dx%d", width, height);
+    mSurfaceWidth = width;
+    mSurfaceHeight = height;
+    if (is) {
+        is->surface_width = width;
+        is->surface_height = height;
+        is->surface_changed = 1;
+    }
 }
 
 void FFPlayer::getDuration(int64_t *timeUs) {
+    /* known once the read thread has opened the file */
+    if (!is || !is->ic || is->ic->duration == AV_NOPTS_VALUE) {
+        *timeUs = -1;
+        return;
+    }
+    *timeUs = is->ic->duration;
+}
+
+void FFPlayer::setBackBuffer(int64_t durationUs, int sizeBytes) {
+    mOptions.back_buffer_duration = durationUs / 1000000.0;
+    mOptions.back_buffer_size = sizeBytes;
+}
+
+void FFPlayer::setFrameCacheSize(int sizeBytes) {
+    mOptions.frame_cache_size = sizeBytes;
+}
+
+void FFPlayer::stepForward() {
+    ALOGI("stepForward");
+    if (is)
+        sendMessage(FF_STEP_EVENT);
+}
 
+void FFPlayer::stepBackward() {
+    ALOGI("stepBackward");
+    if (is)
+        sendMessage(FF_STEP_BACK_EVENT);
+}
+
+void FFPlayer::setLooping(bool looping) {
+    mOptions.loop = looping ? 0 : 1;
+}
+
+void FFPlayer::setLoopRange(int64_t startUs, int64_t endUs) {
+    ALOGI("setLoopRange %lld-%lld", (long long) startUs, (long long) endUs);
+    if (endUs <= startUs) {
+        startUs = AV_NOPTS_VALUE;
+        endUs = AV_NOPTS_VALUE;
+    }
+    /* kept for the VideoState of prepare, or given to the running one */
+    mOptions.loop_a = startUs;
+    mOptions.loop_b = endUs;
+    if (is) {
+        is->loop_b = endUs;
+        is->loop_a = startUs;
+    }
+}
+
+void FFPlayer::getDecodeLadderStats(DecodeLadderStats *stats) {
+    if (!is) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    decode_ladder_get_stats(&is->ladder, stats);
+}
+
+void FFPlayer::setTrickPlay(int speed) {
+    ALOGI("setTrickPlay %d", speed);
+    if (!is)
+        return;
+    is->trick_req_speed = speed;
+    is->trick_req = 1;
+    pthread_cond_signal(&is->continue_read_thread);
+}
+
+void FFPlayer::setReversePlayback(float speed) {
+    ALOGI("setReversePlayback %f", speed);
+    if (!is)
+        return;
+    is->reverse_req_speed = speed;
+    is->reverse_req = 1;
+    pthread_cond_signal(&is->continue_read_thread);
 }
@@ -6,8 +6,6 @@
 #define MYPLAYER_FFPLAYER_H
 
 extern "C" {
-#include <android/log.h>
-#include <android/looper.h>
 #include "libavutil/mathematics.h"
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
@@ -31,14 +29,25 @@ extern "C" {
 #include "libavutil/opt.h"
 #include "libavcodec/avfft.h"
 #include "libswresample/swresample.h"
-#include <android/native_window.h>
-#include <android/native_window_jni.h>
 }
 
 
 #include <string>
-#include "AudioEngine.h"
+#include "AudioVisualizer.h"
+#include "DecodeLadder.h"
+#include "Executor.h"
+#include "FrameCache.h"
+#include "MemoryAccount.h"
 #include "MessageQueue.h"
+#include "Platform.h"
+#include "PlayerStats.h"
+#include "ReverseDecoder.h"
+#include "StartupReport.h"
+#include "StreamInfoCache.h"
+#include "SubtitleIndex.h"
+#include "SubtitleOverlay.h"
+#include "TimeSource.h"
+#include "Trace.h"
 
 /* Minimum SDL audio buffer size, in samples. */
 #define SDL_AUDIO_MIN_BUFFER_SIZE 512
@@ -68,14 +77,74 @@ extern "C" {
 /* polls for possible required screen refresh at least this often, should be less than 1/fps */
 #define REFRESH_RATE 0.01
 
-/* NOTE: the size must be big enough to compensate the hardware audio buffersize size */
-/* TODO: We assume that a decoded and resampled frame fits into this buffer */
-#define SAMPLE_ARRAY_SIZE (8 * 65536)
+/* the packets read first after the loop start, queued at once at the next
+ * wraps while the demuxer seeks back */
+#define LOOP_PREROLL_PACKETS 128
+/* of at most this many microseconds from the loop start */
+#define LOOP_PREROLL_DURATION 1000000
+
+/* a frame is converted to RGBA in up to this many bands in parallel */
+#define CONVERT_BANDS_MAX 8
+/* of at least this many rows */
+#define CONVERT_BAND_MIN_ROWS 64
 
 namespace ffplayer {
 struct VideoState;
 class FFPlayer;
 
+/* what ffplay takes on its command line, one set per player so that several
+ * players can run at the same time with their own settings */
+typedef struct PlayerOptions {
+    AVInputFormat *file_iformat;
+    const char *input_filename;
+    int fs_screen_width;
+    int fs_screen_height;
+    int default_width;
+    int default_height;
+    int screen_width;
+    int screen_height;
+    int audio_disable;
+    int video_disable;
+    int subtitle_disable;
+    const char *wanted_stream_spec[AVMEDIA_TYPE_NB];
+    int seek_by_bytes;         // -1 until the read thread picks it for the format
+    int display_disable;
+    int show_status;           // dump the format of the input once opened
+    int av_sync_type;
+    int64_t start_time;
+    int64_t duration;
+    int fast;
+    int genpts;
+    int lowres;
+    int auto_lowres;
+    int decoder_reorder_pts;
+    int autoexit;
+    int loop;                  // 循环次数, 0表示一直循环, 每轮减一
+    int64_t loop_a, loop_b;    // prepare前设置的A-B循环点, 未设置时为AV_NOPTS_VALUE
+    int framedrop;
+    int infinite_buffer;
+    int back_buffer_size;
+    double back_buffer_duration;
+    int frame_cache_size;
+    int64_t memory_budget;     // 0表示不限制
+    int reverse_buffer_size;
+    int subtitle_index;
+    char *stream_info_cache_dir;
+    int fast_start;
+    int focused;               // 在屏幕上的播放器, 优先使用executor和解码线程
+    int show_mode;             // VideoState::ShowMode
+    int visualization_rate;    // 应用要求的波形和频谱每秒更新次数, 0表示只在显示时更新
+    const char *audio_codec_name;
+    const char *subtitle_codec_name;
+    const char *video_codec_name;
+    int autorotate;
+    unsigned sws_flags;
+} PlayerOptions;
+
+/* set FFmpeg up for the process, its lock manager included, the first time
+ * it is called: by a player, the media scanner or a thumbnail extractor,
+ * which can all open codecs at the same time on their own threads */
+void ffmpeg_init();
 
     class FFPlayer {
     public:
@@ -97,13 +166,90 @@ class FFPlayer;
 
         void seekTo(int64_t seekTimeUs);
 
-        void setWindow(ANativeWindow *window);
+        /* takes ownership of the sink, call before prepare() */
+        void setVideoSink(VideoSink *sink);
+
+        /* takes ownership of the sink, call before prepare(). Without one
+         * the audio is not decoded. */
+        void setAudioSink(AudioSink *sink);
 
         void getDuration(int64_t *timeUs);
 
+        void setBackBuffer(int64_t durationUs, int sizeBytes);
+
+        void setFrameCacheSize(int sizeBytes);
+
+        void stepForward();
+
+        void stepBackward();
+
+        void setReversePlayback(float speed);
+
+        void setTrickPlay(int speed);
+
+        void setLooping(bool looping);
+
+        void setLoopRange(int64_t startUs, int64_t endUs);
+
+        void getDecodeLadderStats(DecodeLadderStats *stats);
+
+        void setSurfaceSize(int width, int height);
+
+        void cycleSubtitleTrack();
+
+        void setStreamInfoCacheDir(const char *dir);
+
+        void setFastStart(bool fastStart);
+
+        void setFocused(bool focused);
+
+        void getStartupReport(StartupReport *report);
+
+        /* the latest stats, readable from any thread without blocking the player */
+        void getStats(PlayerStats *stats);
+
+        void setPreloadBudget(int sizeBytes);
+
+        /* a VideoState::ShowMode, the samples for the waves and the spectrum
+         * are only kept while one of them is shown */
+        void setShowMode(int mode);
+
+        /* the most the player should hold, the buffering shrinks to stay
+         * under it. 0 for no limit. */
+        void setMemoryBudget(int64_t bytes);
+
+        void getMemoryReport(MemoryAccount *report);
+
+        /* the spectrum and the waveform updated rate times a second, 0 to
+         * only update them while the waves or the spectrum are shown */
+        void setVisualizationRate(int rate);
+
+        /* the latest of them, count is 0 when there is none */
+        void getVisualization(VisualizerFrame *frame);
+
+        void promote(VideoSink *sink);
+
+        void setAutoExit(bool autoExit);
+
+        /* not owned, it must outlive the player. The system time by default. */
+        void setTimeSource(TimeSource *timeSource);
+
+        /* called once the player released or done playing is gone */
+        void setOnExit(void (*callback)(void *opaque), void *opaque);
+
     private:
+        void sendMessage(uint8_t messageCode);
+
         std::string mPath;
-        ANativeWindow *mWindow;
+        VideoSink *mVideoSink;
+        AudioSink *mAudioSink;
+        TimeSource *mTimeSource;
+        void (*mOnExit)(void *opaque);
+        void *mOnExitOpaque;
+        int mSurfaceWidth;
+        int mSurfaceHeight;
+        int mPreloadBudget;
+        PlayerOptions mOptions;
     };
 
 
@@ -113,6 +259,17 @@ typedef struct MyAVPacketList {
     int serial; // 创建时赋值为PacketQueue的serial
 } MyAVPacketList;
 
+/* packets already handed to the decoder, kept for instant short rewinds */
+typedef struct PacketHistory {
+    MyAVPacketList *first_pkt, *last_pkt;
+    int nb_packets;
+    int size;
+    int max_size;        // 0表示不保留已消费的packet
+    double max_duration; // 保留的最长时间, 秒
+    AVRational time_base;
+    MemoryAccount *mem;
+} PacketHistory;
+
 typedef struct PacketQueue {
     MyAVPacketList *first_pkt, *last_pkt;
     int nb_packets;
@@ -121,6 +278,8 @@ typedef struct PacketQueue {
     int serial; // put flush_pkt会增加
     pthread_mutex_t mutex;
     pthread_cond_t cond;
+    PacketHistory history;
+    MemoryAccount *mem;
 } PacketQueue;
 
 #define VIDEO_PICTURE_QUEUE_SIZE 3
@@ -148,6 +307,7 @@ typedef struct Clock {
     /* clock is based on a packet with this serial */
     int paused;
     int *queue_serial;    /* pointer to the current packet queue serial, used for obsolete clock detection */
+    TimeSource *time_source;
 } Clock;
 
 /* Common struct for handling all types of decoded data and allocated render buffers. */
@@ -167,6 +327,7 @@ typedef struct Frame {
     int height;
     AVRational sar;
     AVFrame *pFrameRGBA;
+    SubtitleOverlay overlay; // 字幕转换成的RGBA,在字幕显示期间复用
 } Frame;
 
 typedef struct FrameQueue {
@@ -195,6 +356,8 @@ typedef struct Decoder {
     AVRational start_pts_tb;
     int64_t next_pts;
     AVRational next_pts_tb;
+    int64_t decode_time; // 解码累计耗时(微秒)
+    int reorder_pts;     // -1自动, 1用pkt_pts, 0用pkt_dts
     pthread_t decoder_tid;
 } Decoder;
 
@@ -242,7 +405,6 @@ struct VideoState {
     AVStream *audio_st;
     PacketQueue audioq;
     int audio_hw_buf_size;
-    uint8_t silence_buf[SDL_AUDIO_MIN_BUFFER_SIZE];
     uint8_t *audio_buf;
     uint8_t *audio_buf1;
     unsigned int audio_buf_size;
@@ -259,12 +421,23 @@ struct VideoState {
     struct SwrContext *swr_ctx;
     int frame_drops_early;
     int frame_drops_late;
+    int64_t frames_displayed;
+    int64_t audio_underruns;   // 音频回调等待解码的次数, 音频回调原子地累加
+    int64_t bytes_read;        // 从输入读到的字节数, 读线程原子地累加
+    LatencyHistogram decode_hist;  // 每帧视频的解码耗时
+    LatencyHistogram convert_hist; // 每帧视频转换RGBA的耗时
+    int64_t stats_drift[STATS_DRIFT_BUCKETS];
+    StatsWindow stats_window[2];   // 上一个和当前统计窗口开始时的计数
+    StatsSnapshot stats;       // 给应用读的统计快照, 只由事件线程更新
+    MemoryAccount mem;         // 按用途统计的内存和预算
+    int64_t decoder_memory;    // 估计的视频解码器占用的内存
 
     enum ShowMode {
         SHOW_MODE_NONE = -1, SHOW_MODE_VIDEO = 0, SHOW_MODE_WAVES, SHOW_MODE_RDFT, SHOW_MODE_NB
     } show_mode;
-    int16_t sample_array[SAMPLE_ARRAY_SIZE];
-    int sample_array_index;
+    AudioVisualizer *visualizer;   // 波形和频谱, 显示或应用要求时才创建, 由音频回调写
+    pthread_mutex_t visualizer_mutex; // 应用读取时不被销毁
+    uint32_t audio_callback_seq; // 音频回调开始和结束时各加一, 回调中为奇数
 
     int subtitle_stream;
     AVStream *subtitle_st;
@@ -280,7 +453,13 @@ struct VideoState {
 #if !CONFIG_AVFILTER
     struct SwsContext *img_convert_ctx;
 #endif
-    struct SwsContext *sub_convert_ctx;
+    struct SwsContext *band_convert_ctx[CONVERT_BANDS_MAX];
+    int64_t convert_deadline;  // 正在转换的帧最晚要在这个时间转换好
+    int executor_focused;      // 在executor中登记的focused
+    SubtitleScalers sub_scalers;
+    SubtitleIndex sub_index;   // 本地文件预先解码的所有字幕
+    SubtitleEvent *sub_index_event;
+    SubtitleOverlay sub_index_overlay;
 //    SDL_Rect last_display_rect;
     int eof;
 
@@ -299,10 +478,72 @@ AVFilterGraph *agraph;              // audio filter graph
 
     int last_video_stream, last_audio_stream, last_subtitle_stream;
 
+    FrameCache frame_cache;
+    Frame step_frame;          // 后退单帧时显示的缓存帧
+    struct SwsContext *step_convert_ctx;
+    double step_back_pts;      // step_frame的pts, NAN表示显示的是pictq中的帧
+    double step_back_pending;  // 等GOP解码进缓存后从这个pts继续后退
+    int seek_exact;
+    int frame_seek_serial;     // 这个serial中pts小于frame_seek_target的帧只进缓存不显示
+    double frame_seek_target;
+
+    ReverseDecoder revdec;
+    double reverse_speed;      // 倒放速度, 0表示正向播放
+    double reverse_req_speed;
+    int reverse_req;
+
+    int trick_speed;           // 只播关键帧的快进(>0)/快退(<0)倍速, 0表示关闭
+    int trick_req_speed;
+    int trick_req;
+    double trick_pos;          // 下一个关键帧从这个位置往后(前)找
+    int64_t trick_last_ts;     // 上一个关键帧的dts, 和索引的时间戳一样
+
+    int64_t loop_a, loop_b;    // A-B循环点(AV_TIME_BASE), 未设置时为AV_NOPTS_VALUE
+    int64_t loop_offset;       // 加到本轮读到的packet时间戳上, 使循环时时间戳连续
+    int64_t loop_end;          // 本轮读到的packet的最大结束时间
+    int loop_iteration;
+    double loop_last_pts;      // 循环后丢掉时间戳回退的视频帧
+    int loop_last_serial;
+    AVPacket *loop_preroll;    // 循环开始处读到的packet, 回绕时直接入队
+    int nb_loop_preroll;
+    int loop_preroll_recording;
+    int64_t loop_preroll_start; // 记录时的循环起点和B点, 变了就作废
+    int64_t loop_preroll_b;
+    int64_t loop_skip_dts[3];  // 视频, 音频, 字幕: 回绕后预读已入队, 读到这个dts之前的丢掉
+
+    DecodeLadder ladder;       // 视频解码跟不上时逐级降低解码质量
+    int ladder_lowres_base;    // 用户设置的lowres
+    int ladder_wait_key;       // 重新打开解码器后等关键帧
+
+    int surface_width;         // 显示窗口的大小,用来选择lowres
+    int surface_height;
+    int surface_changed;
+    int video_full_width;      // lowres为0时的视频大小
+    int video_full_height;
+    int buffers_width;         // window buffer的大小,和图像不同时由合成器缩放
+    int buffers_height;
+
+    StartupReport startup;     // 从prepare到首帧各阶段的时间
+    pthread_t audio_device_tid; // 快速启动时在这个线程里创建音频播放器
+    int audio_device_pending;
+    int audio_device_deferred; // 预加载时不创建音频播放器, 等promote
+
+    int preload;               // 预加载: 暂停, 没有window, 只读到第一帧视频解码出来
+    int preload_budget;        // 预加载时packet队列最多占用的字节数
+    VideoSink *promote_sink;
+
+    PlayerOptions *opts;       // 所属FFPlayer的选项
+    char *window_title;
+    int is_full_screen;
+    int64_t audio_callback_time;
+    int64_t stats_time;        // 上次更新统计快照的时间
+
     pthread_cond_t continue_read_thread;
 
-    ANativeWindow *window;
-    AudioEngine *audioEngine;
+    VideoSink *video_sink;
+    AudioSink *audio_sink;
+    TimeSource *time_source;   // 同步和显示用的时间, 可以是虚拟时间
+    int64_t data_wait_start;   // 开始等待解码出下一帧的真实时间
 
     MessageQueue *messageQueue;
     FFPlayer *player;
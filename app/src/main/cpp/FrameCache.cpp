@@ -0,0 +1,151 @@
+#include "FrameCache.h"
+
+#include <math.h>
+#include <string.h>
+
+/* pts closer than this are the same frame */
+#define FRAME_CACHE_PTS_EPSILON 0.0001
+
+namespace ffplayer {
+
+static int frame_size(const AVFrame *frame) {
+    int i, size = 0;
+    for (i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+        size += frame->buf[i]->size;
+    return size;
+}
+
+/* index of the first entry whose pts is not below pts - epsilon */
+static int frame_cache_lower_bound(FrameCache *c, double pts) {
+    int lo = 0, hi = c->nb_entries;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (c->entries[mid].pts < pts - FRAME_CACHE_PTS_EPSILON)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int frame_cache_match(FrameCache *c, int i, double pts) {
+    return i < c->nb_entries && fabs(c->entries[i].pts - pts) < FRAME_CACHE_PTS_EPSILON;
+}
+
+static void frame_cache_remove(FrameCache *c, int i) {
+    FrameCacheEntry *e = &c->entries[i];
+    c->size -= e->size;
+    memory_account_add(c->mem, MEMORY_FRAME_CACHE, -e->size);
+    av_frame_free(&e->frame);
+    memmove(e, e + 1, (c->nb_entries - i - 1) * sizeof(*e));
+    c->nb_entries--;
+}
+
+static void frame_cache_evict(FrameCache *c) {
+    int i, lru = 0;
+    for (i = 1; i < c->nb_entries; i++)
+        if (c->entries[i].last_used < c->entries[lru].last_used)
+            lru = i;
+    frame_cache_remove(c, lru);
+}
+
+void frame_cache_init(FrameCache *c, int max_size, MemoryAccount *mem) {
+    memset(c, 0, sizeof(FrameCache));
+    c->mutex = PTHREAD_MUTEX_INITIALIZER;
+    c->max_size = max_size;
+    c->mem = mem;
+}
+
+void frame_cache_set_max_size(FrameCache *c, int max_size) {
+    pthread_mutex_lock(&c->mutex);
+    c->max_size = max_size;
+    while (c->nb_entries > 0 && c->size > c->max_size)
+        frame_cache_evict(c);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+void frame_cache_flush(FrameCache *c) {
+    pthread_mutex_lock(&c->mutex);
+    while (c->nb_entries > 0)
+        frame_cache_remove(c, c->nb_entries - 1);
+    pthread_mutex_unlock(&c->mutex);
+}
+
+void frame_cache_destroy(FrameCache *c) {
+    frame_cache_flush(c);
+    pthread_mutex_destroy(&c->mutex);
+}
+
+int frame_cache_put(FrameCache *c, AVFrame *frame, double pts, int64_t pos) {
+    FrameCacheEntry *e;
+    AVFrame *ref;
+    int i, size;
+
+    if (c->max_size <= 0 || isnan(pts))
+        return 0;
+    size = frame_size(frame);
+    if (size > c->max_size)
+        return 0;
+    if (!(ref = av_frame_clone(frame)))
+        return AVERROR(ENOMEM);
+
+    pthread_mutex_lock(&c->mutex);
+    /* the budget of the player may have shrunk the cache meanwhile */
+    if (size > c->max_size) {
+        pthread_mutex_unlock(&c->mutex);
+        av_frame_free(&ref);
+        return 0;
+    }
+    i = frame_cache_lower_bound(c, pts);
+    if (frame_cache_match(c, i, pts))
+        frame_cache_remove(c, i);
+    while (c->nb_entries > 0
+           && (c->size + size > c->max_size || c->nb_entries >= FRAME_CACHE_MAX_ENTRIES))
+        frame_cache_evict(c);
+
+    i = frame_cache_lower_bound(c, pts);
+    e = &c->entries[i];
+    memmove(e + 1, e, (c->nb_entries - i) * sizeof(*e));
+    e->frame = ref;
+    e->pts = pts;
+    e->pos = pos;
+    e->size = size;
+    e->last_used = ++c->use_counter;
+    c->nb_entries++;
+    c->size += size;
+    memory_account_add(c->mem, MEMORY_FRAME_CACHE, size);
+    pthread_mutex_unlock(&c->mutex);
+    return 0;
+}
+
+int frame_cache_get(FrameCache *c, double pts, int direction, AVFrame *dst,
+                    double *out_pts, int64_t *out_pos) {
+    FrameCacheEntry *e;
+    int i, ret = 0;
+
+    pthread_mutex_lock(&c->mutex);
+    i = frame_cache_lower_bound(c, pts);
+    if (direction < 0)
+        i--;
+    else if (direction > 0 && frame_cache_match(c, i, pts))
+        i++;
+    else if (direction == 0 && !frame_cache_match(c, i, pts))
+        i = -1;
+
+    if (i >= 0 && i < c->nb_entries) {
+        e = &c->entries[i];
+        av_frame_unref(dst);
+        if (av_frame_ref(dst, e->frame) >= 0) {
+            e->last_used = ++c->use_counter;
+            if (out_pts)
+                *out_pts = e->pts;
+            if (out_pos)
+                *out_pos = e->pos;
+            ret = 1;
+        }
+    }
+    pthread_mutex_unlock(&c->mutex);
+    return ret;
+}
+
+}
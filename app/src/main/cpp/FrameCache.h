@@ -0,0 +1,54 @@
+#ifndef MYPLAYER_FRAMECACHE_H
+#define MYPLAYER_FRAMECACHE_H
+
+extern "C" {
+#include "libavutil/frame.h"
+}
+
+#include <pthread.h>
+
+#include "MemoryAccount.h"
+
+/* upper bound on cached frames whatever the memory budget */
+#define FRAME_CACHE_MAX_ENTRIES 256
+
+namespace ffplayer {
+
+typedef struct FrameCacheEntry {
+    AVFrame *frame; // refcounted, shares the decoder buffers
+    double pts;
+    int64_t pos;
+    int size;
+    int64_t last_used;
+} FrameCacheEntry;
+
+/* decoded video frames indexed by pts, evicted least recently used first */
+typedef struct FrameCache {
+    FrameCacheEntry entries[FRAME_CACHE_MAX_ENTRIES]; // sorted by pts
+    int nb_entries;
+    int size;
+    int max_size; // 0表示不缓存
+    int64_t use_counter;
+    pthread_mutex_t mutex;
+    MemoryAccount *mem;
+} FrameCache;
+
+void frame_cache_init(FrameCache *c, int max_size, MemoryAccount *mem);
+
+/* evict the least recently used frames down to max_size at once */
+void frame_cache_set_max_size(FrameCache *c, int max_size);
+
+void frame_cache_destroy(FrameCache *c);
+
+void frame_cache_flush(FrameCache *c);
+
+int frame_cache_put(FrameCache *c, AVFrame *frame, double pts, int64_t pos);
+
+/* look up the cached frame at pts (direction 0), the one just before it (< 0)
+ * or just after it (> 0). On a hit dst gets a new reference and 1 is returned. */
+int frame_cache_get(FrameCache *c, double pts, int direction, AVFrame *dst,
+                    double *out_pts, int64_t *out_pos);
+
+}
+
+#endif //MYPLAYER_FRAMECACHE_H
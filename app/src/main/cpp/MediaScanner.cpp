@@ -0,0 +1,354 @@
+#include "MediaScanner.h"
+#include "FFPlayer.h"
+
+extern "C" {
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+#include "libavutil/time.h"
+}
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* just enough data to find the streams of ordinary files */
+#define MEDIA_PROBE_SIZE "131072"
+#define MEDIA_ANALYZE_DURATION "1000000"
+/* the poster is the keyframe at 10% of the duration, at most this far in */
+#define MEDIA_POSTER_MAX_TIME (10 * AV_TIME_BASE)
+#define MEDIA_POSTER_MAX_PACKETS 200
+
+namespace ffplayer {
+
+static uint64_t media_path_hash(const char *path) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (; *path; path++)
+        h = (h ^ (uint8_t) *path) * 0x100000001b3ULL;
+    return h;
+}
+
+static int media_stat(const char *path, MediaInfo *info) {
+    struct stat st;
+    if (stat(path, &st) < 0)
+        return AVERROR(errno);
+    info->mtime = st.st_mtime;
+    info->size = st.st_size;
+    return 0;
+}
+
+int media_db_open(MediaDb *db, const char *path) {
+    struct stat st;
+    const MediaDbHeader *h;
+    size_t records_size;
+    int fd;
+
+    memset(db, 0, sizeof(*db));
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return AVERROR(errno);
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(MediaDbHeader)) {
+        close(fd);
+        return AVERROR_INVALIDDATA;
+    }
+    db->map = (uint8_t *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (db->map == MAP_FAILED) {
+        db->map = NULL;
+        return AVERROR(errno);
+    }
+    db->map_size = st.st_size;
+
+    h = (const MediaDbHeader *) db->map;
+    records_size = (size_t) h->nb_records * sizeof(MediaDbRecord);
+    if (h->magic != MEDIA_DB_MAGIC || h->version != MEDIA_DB_VERSION
+        || sizeof(*h) + records_size + h->strings_size != db->map_size) {
+        av_log(NULL, AV_LOG_WARNING, "%s: not a media database of this version\n", path);
+        media_db_close(db);
+        return AVERROR_INVALIDDATA;
+    }
+    db->header = h;
+    db->records = (const MediaDbRecord *) (db->map + sizeof(*h));
+    db->strings = (const char *) (db->map + sizeof(*h) + records_size);
+    return 0;
+}
+
+void media_db_close(MediaDb *db) {
+    if (db->map)
+        munmap(db->map, db->map_size);
+    memset(db, 0, sizeof(*db));
+}
+
+static int media_db_lookup(const MediaDb *db, const char *path, MediaInfo *info) {
+    uint64_t hash = media_path_hash(path);
+    size_t len = strlen(path);
+    int lo = 0, hi, i;
+
+    if (!db->header)
+        return 0;
+    /* the first record with this hash */
+    hi = db->header->nb_records;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (db->records[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    for (i = lo; i < (int) db->header->nb_records && db->records[i].hash == hash; i++) {
+        const MediaDbRecord *r = &db->records[i];
+        if (r->path_size == len && r->path_offset + len <= db->header->strings_size
+            && !memcmp(db->strings + r->path_offset, path, len)) {
+            *info = r->info;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int media_db_find(const MediaDb *db, const char *path, MediaInfo *info) {
+    MediaInfo cur;
+
+    if (!media_db_lookup(db, path, info) || media_stat(path, &cur) < 0)
+        return 0;
+    return info->mtime == cur.mtime && info->size == cur.size;
+}
+
+/* the time of the first video keyframe from where the poster should be */
+static int64_t media_poster_time(AVFormatContext *ic, int stream_index) {
+    AVStream *st = ic->streams[stream_index];
+    int64_t start = ic->start_time != AV_NOPTS_VALUE ? ic->start_time : 0;
+    int64_t target = ic->duration > 0 ? FFMIN(ic->duration / 10, MEDIA_POSTER_MAX_TIME) : 0;
+    int64_t poster = AV_NOPTS_VALUE;
+    AVPacket pkt;
+    int i;
+
+    for (i = 0; i < (int) ic->nb_streams; i++)
+        ic->streams[i]->discard = i == stream_index ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+    if (target && avformat_seek_file(ic, -1, INT64_MIN, start + target, INT64_MAX, 0) < 0)
+        return AV_NOPTS_VALUE;
+    for (i = 0; i < MEDIA_POSTER_MAX_PACKETS && av_read_frame(ic, &pkt) >= 0; i++) {
+        int64_t ts = pkt.pts != AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+        int key = pkt.stream_index == stream_index && (pkt.flags & AV_PKT_FLAG_KEY);
+        av_free_packet(&pkt);
+        if (key && ts != AV_NOPTS_VALUE) {
+            poster = FFMAX(av_rescale_q(ts, st->time_base, AV_TIME_BASE_Q) - start, 0);
+            break;
+        }
+    }
+    return poster;
+}
+
+static void media_probe(const char *path, MediaInfo *info) {
+    AVFormatContext *ic;
+    AVDictionary *opts = NULL;
+    int video, audio;
+
+    info->duration = AV_NOPTS_VALUE;
+    info->poster_time = AV_NOPTS_VALUE;
+    info->flags = MEDIA_INFO_FAILED;
+    if (!(ic = avformat_alloc_context()))
+        return;
+    av_dict_set(&opts, "probesize", MEDIA_PROBE_SIZE, 0);
+    av_dict_set(&opts, "analyzeduration", MEDIA_ANALYZE_DURATION, 0);
+    if (avformat_open_input(&ic, path, NULL, &opts) < 0) {
+        av_dict_free(&opts);
+        return;
+    }
+    av_dict_free(&opts);
+    if (avformat_find_stream_info(ic, NULL) < 0)
+        goto end;
+
+    info->flags = 0;
+    info->duration = ic->duration;
+    info->bit_rate = (int32_t) FFMIN(ic->bit_rate, INT32_MAX);
+    info->nb_streams = (int16_t) FFMIN(ic->nb_streams, INT16_MAX);
+
+    audio = av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (audio >= 0) {
+        AVCodecContext *avctx = ic->streams[audio]->codec;
+        info->audio_codec = avctx->codec_id;
+        info->sample_rate = avctx->sample_rate;
+        info->channels = (int16_t) avctx->channels;
+    }
+    video = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (video >= 0) {
+        AVStream *st = ic->streams[video];
+        info->video_codec = st->codec->codec_id;
+        info->width = (int16_t) st->codec->width;
+        info->height = (int16_t) st->codec->height;
+        if (st->disposition & AV_DISPOSITION_ATTACHED_PIC) {
+            info->flags |= MEDIA_INFO_ATTACHED_PIC;
+            info->poster_time = 0;
+        } else {
+            info->poster_time = media_poster_time(ic, video);
+        }
+    }
+
+    end:
+    avformat_close_input(&ic);
+}
+
+typedef struct MediaScanJob {
+    const char *path;
+    MediaInfo info;
+    int valid;              // found up to date in the database
+} MediaScanJob;
+
+typedef struct MediaScanner {
+    MediaScanJob *jobs;
+    int nb_jobs;
+    int next;
+    int nb_probed;
+    pthread_mutex_t mutex;
+} MediaScanner;
+
+static void *media_scanner_thread(void *arg) {
+    MediaScanner *s = (MediaScanner *) arg;
+    int i;
+
+    for (; ;) {
+        pthread_mutex_lock(&s->mutex);
+        while (s->next < s->nb_jobs && s->jobs[s->next].valid)
+            s->next++;
+        i = s->next++;
+        if (i < s->nb_jobs)
+            s->nb_probed++;
+        pthread_mutex_unlock(&s->mutex);
+        if (i >= s->nb_jobs)
+            break;
+        media_probe(s->jobs[i].path, &s->jobs[i].info);
+    }
+    return NULL;
+}
+
+static int media_record_cmp(const void *a, const void *b) {
+    uint64_t ha = ((const MediaDbRecord *) a)->hash, hb = ((const MediaDbRecord *) b)->hash;
+    return ha < hb ? -1 : ha > hb;
+}
+
+/* write to a temporary file renamed over the old one, lookups in progress
+ * keep their mapping of the old file */
+static int media_db_write(const char *db_path, MediaScanJob *jobs, int nb_jobs) {
+    MediaDbHeader header;
+    MediaDbRecord *records;
+    char *tmp_path;
+    FILE *f;
+    uint32_t offset = 0;
+    int i, n = 0, ret = 0;
+
+    if (!(records = (MediaDbRecord *) av_mallocz_array(FFMAX(nb_jobs, 1), sizeof(*records))))
+        return AVERROR(ENOMEM);
+    for (i = 0; i < nb_jobs; i++) {
+        if (jobs[i].info.mtime == 0 && jobs[i].info.size == 0)
+            continue;   // could not even stat it
+        records[n].hash = media_path_hash(jobs[i].path);
+        records[n].path_offset = offset;
+        records[n].path_size = strlen(jobs[i].path);
+        records[n].info = jobs[i].info;
+        offset += records[n].path_size;
+        n++;
+    }
+    qsort(records, n, sizeof(*records), media_record_cmp);
+
+    if (!(tmp_path = av_asprintf("%s.tmp", db_path))) {
+        av_free(records);
+        return AVERROR(ENOMEM);
+    }
+    if (!(f = fopen(tmp_path, "wb"))) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+    header.magic = MEDIA_DB_MAGIC;
+    header.version = MEDIA_DB_VERSION;
+    header.nb_records = n;
+    header.strings_size = offset;
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(records, sizeof(*records), n, f);
+    /* the paths in the order of the offsets, which is the order of the jobs */
+    for (i = 0; i < nb_jobs; i++)
+        if (jobs[i].info.mtime || jobs[i].info.size)
+            fwrite(jobs[i].path, 1, strlen(jobs[i].path), f);
+    if (ferror(f))
+        ret = AVERROR(EIO);
+    if (fclose(f) || ret < 0 || rename(tmp_path, db_path) < 0) {
+        ret = ret < 0 ? ret : AVERROR(errno);
+        unlink(tmp_path);
+    }
+
+    end:
+    av_free(tmp_path);
+    av_free(records);
+    return ret;
+}
+
+int media_scanner_scan(const char *db_path, const char *const *paths, int nb_paths,
+                       int nb_threads) {
+    MediaScanner s;
+    MediaDb db;
+    pthread_t *tids;
+    int64_t start_time = av_gettime_relative();
+    int i, nb_started = 0, ret;
+
+    ffmpeg_init();
+    memset(&s, 0, sizeof(s));
+    if (!(s.jobs = (MediaScanJob *) av_mallocz_array(FFMAX(nb_paths, 1), sizeof(*s.jobs))))
+        return AVERROR(ENOMEM);
+    s.nb_jobs = nb_paths;
+
+    /* unchanged files are not probed again */
+    media_db_open(&db, db_path);
+    for (i = 0; i < nb_paths; i++) {
+        MediaScanJob *job = &s.jobs[i];
+        job->path = paths[i];
+        if (media_stat(job->path, &job->info) < 0) {
+            job->valid = 1;
+            continue;
+        }
+        if (media_db_lookup(&db, job->path, &job->info)) {
+            MediaInfo cur;
+            media_stat(job->path, &cur);
+            if (job->info.mtime == cur.mtime && job->info.size == cur.size) {
+                job->valid = 1;
+                continue;
+            }
+            memset(&job->info, 0, sizeof(job->info));
+            job->info.mtime = cur.mtime;
+            job->info.size = cur.size;
+        }
+    }
+    media_db_close(&db);
+
+    nb_threads = av_clip(nb_threads, 1, 64);
+    if (!(tids = (pthread_t *) av_malloc_array(nb_threads, sizeof(*tids)))) {
+        av_free(s.jobs);
+        return AVERROR(ENOMEM);
+    }
+    pthread_mutex_init(&s.mutex, NULL);
+    for (i = 0; i < nb_threads; i++) {
+        if (pthread_create(&tids[i], NULL, media_scanner_thread, &s))
+            break;
+        pthread_setname_np(tids[i], "media_scanner");
+        nb_started++;
+    }
+    /* with no thread at all the scan runs here */
+    if (!nb_started)
+        media_scanner_thread(&s);
+    for (i = 0; i < nb_started; i++)
+        pthread_join(tids[i], NULL);
+    pthread_mutex_destroy(&s.mutex);
+    av_free(tids);
+
+    ret = media_db_write(db_path, s.jobs, s.nb_jobs);
+    av_log(NULL, AV_LOG_INFO, "media scan: %d files, %d probed, %.1f files/s\n",
+           nb_paths, s.nb_probed,
+           s.nb_probed * 1000000.0 / FFMAX(av_gettime_relative() - start_time, 1));
+    av_free(s.jobs);
+    return ret < 0 ? ret : s.nb_probed;
+}
+
+}
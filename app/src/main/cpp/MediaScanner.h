@@ -0,0 +1,80 @@
+#ifndef MYPLAYER_MEDIASCANNER_H
+#define MYPLAYER_MEDIASCANNER_H
+
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEDIA_DB_MAGIC MKTAG('M', 'P', 'D', 'B')
+#define MEDIA_DB_VERSION 1
+
+/* the file could not be probed, only mtime and size are valid */
+#define MEDIA_INFO_FAILED 1
+/* the poster is a cover picture stored in the file */
+#define MEDIA_INFO_ATTACHED_PIC 2
+
+namespace ffplayer {
+
+/* what a scan keeps of a file. Stored as is in the database, so only fixed
+ * size fields in decreasing size. */
+typedef struct MediaInfo {
+    int64_t mtime;          // seconds
+    int64_t size;
+    int64_t duration;       // microseconds, AV_NOPTS_VALUE if unknown
+    int64_t poster_time;    // microseconds, the keyframe to show for the file,
+                            // AV_NOPTS_VALUE if there is no video
+    int32_t bit_rate;
+    int32_t video_codec;    // enum AVCodecID, AV_CODEC_ID_NONE if no video
+    int32_t audio_codec;
+    int32_t sample_rate;
+    int32_t flags;          // MEDIA_INFO_*
+    int16_t width;
+    int16_t height;
+    int16_t channels;
+    int16_t nb_streams;
+} MediaInfo;
+
+typedef struct MediaDbHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nb_records;
+    uint32_t strings_size;
+} MediaDbHeader;
+
+/* the records follow the header sorted by hash, then the paths */
+typedef struct MediaDbRecord {
+    uint64_t hash;          // of the path
+    uint32_t path_offset;   // in the paths
+    uint32_t path_size;
+    MediaInfo info;
+} MediaDbRecord;
+
+/* a database file mapped read only */
+typedef struct MediaDb {
+    uint8_t *map;
+    size_t map_size;
+    const MediaDbHeader *header;
+    const MediaDbRecord *records;
+    const char *strings;
+} MediaDb;
+
+int media_db_open(MediaDb *db, const char *path);
+
+void media_db_close(MediaDb *db);
+
+/* return 1 and fill info if path is in the database with the mtime and size
+ * it has on disk now, 0 otherwise */
+int media_db_find(const MediaDb *db, const char *path, MediaInfo *info);
+
+/* probe the files on nb_threads threads, reusing the entries of the database
+ * at db_path that are still up to date, then replace the database with the
+ * result. Return the number of files probed, or < 0 on error. */
+int media_scanner_scan(const char *db_path, const char *const *paths, int nb_paths,
+                       int nb_threads);
+
+}
+
+#endif //MYPLAYER_MEDIASCANNER_H
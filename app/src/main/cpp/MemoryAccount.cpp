@@ -0,0 +1,83 @@
+#include "log.h"
+#include "MemoryAccount.h"
+
+#include <inttypes.h>
+#include <string.h>
+
+namespace ffplayer {
+
+static void peak_raise(int64_t *peak, int64_t value) {
+    int64_t old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+
+    while (value > old
+           && !__atomic_compare_exchange_n(peak, &old, value, 1,
+                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void memory_account_add(MemoryAccount *a, int tag, int64_t bytes) {
+    int64_t live, total;
+
+    if (!a || !bytes)
+        return;
+    live = __atomic_add_fetch(&a->live[tag], bytes, __ATOMIC_RELAXED);
+    total = __atomic_add_fetch(&a->total, bytes, __ATOMIC_RELAXED);
+    if (bytes > 0) {
+        peak_raise(&a->peak[tag], live);
+        peak_raise(&a->total_peak, total);
+    }
+}
+
+int64_t memory_account_room(MemoryAccount *a) {
+    int64_t budget = __atomic_load_n(&a->budget, __ATOMIC_RELAXED);
+
+    if (budget <= 0)
+        return INT64_MAX;
+    return budget - __atomic_load_n(&a->total, __ATOMIC_RELAXED);
+}
+
+void memory_account_copy(MemoryAccount *dst, MemoryAccount *a) {
+    int i;
+
+    for (i = 0; i < MEMORY_TAG_NB; i++) {
+        dst->live[i] = __atomic_load_n(&a->live[i], __ATOMIC_RELAXED);
+        dst->peak[i] = __atomic_load_n(&a->peak[i], __ATOMIC_RELAXED);
+    }
+    dst->total = __atomic_load_n(&a->total, __ATOMIC_RELAXED);
+    dst->total_peak = __atomic_load_n(&a->total_peak, __ATOMIC_RELAXED);
+    dst->budget = __atomic_load_n(&a->budget, __ATOMIC_RELAXED);
+}
+
+const char *memory_tag_name(int tag) {
+    static const char *const names[MEMORY_TAG_NB] = {
+            "packets", "back buffer", "pictures", "frame cache",
+            "decoders", "audio", "subtitles", "player",
+            "reverse", "sub index",
+    };
+    return tag >= 0 && tag < MEMORY_TAG_NB ? names[tag] : "?";
+}
+
+void memory_account_log(MemoryAccount *a) {
+    MemoryAccount m;
+    int i;
+
+    memory_account_copy(&m, a);
+    for (i = 0; i < MEMORY_TAG_NB; i++)
+        ALOGI("memory: %-12s live %8" PRId64 " KiB, peak %8" PRId64 " KiB",
+              memory_tag_name(i), m.live[i] >> 10, m.peak[i] >> 10);
+    ALOGI("memory: %-12s live %8" PRId64 " KiB, peak %8" PRId64 " KiB, budget %" PRId64 " KiB",
+          "total", m.total >> 10, m.total_peak >> 10, m.budget >> 10);
+}
+
+void memory_account_pack(const MemoryAccount *a, int64_t *values) {
+    int i;
+
+    for (i = 0; i < MEMORY_TAG_NB; i++) {
+        values[MEMORY_REPORT_LIVE(i)] = a->live[i];
+        values[MEMORY_REPORT_PEAK(i)] = a->peak[i];
+    }
+    values[MEMORY_REPORT_TOTAL] = a->total;
+    values[MEMORY_REPORT_TOTAL_PEAK] = a->total_peak;
+    values[MEMORY_REPORT_BUDGET] = a->budget;
+}
+
+}
@@ -0,0 +1,64 @@
+#ifndef MYPLAYER_MEMORYACCOUNT_H
+#define MYPLAYER_MEMORYACCOUNT_H
+
+#include <stdint.h>
+
+/* below this the forward packet queues are not shrunk for the budget, the
+ * decoders would starve: the budget is overrun instead */
+#define MEMORY_MIN_QUEUE_SIZE (1024 * 1024)
+
+namespace ffplayer {
+
+/* what the memory of a player is for */
+enum MemoryTag {
+    MEMORY_PACKETS = 0,        // queued for the decoders
+    MEMORY_BACK_BUFFER,        // packets kept for short rewinds
+    MEMORY_PICTURES,           // the RGBA copies of the picture queue
+    MEMORY_FRAME_CACHE,        // decoded frames kept for stepping back
+    MEMORY_DECODERS,           // estimated, the frames the video decoder holds
+    MEMORY_AUDIO,              // resampled samples and the waves
+    MEMORY_SUBTITLES,          // the converted overlays
+    MEMORY_PLAYER,             // the VideoState
+    MEMORY_REVERSE,            // estimated, the frames decoded to play backwards
+    MEMORY_SUBTITLE_INDEX,     // the packets of the subtitle index
+    MEMORY_TAG_NB
+};
+
+/* the bytes a player holds by tag, updated from any thread where the player
+ * allocates and frees: FFmpeg cannot hook av_malloc per player, so what the
+ * libraries allocate for themselves is estimated or not counted */
+typedef struct MemoryAccount {
+    int64_t live[MEMORY_TAG_NB];
+    int64_t peak[MEMORY_TAG_NB];
+    int64_t total;
+    int64_t total_peak;
+    int64_t budget;            // 0 for none
+} MemoryAccount;
+
+/* bytes < 0 when they are freed, a is NULL for what nothing accounts */
+void memory_account_add(MemoryAccount *a, int tag, int64_t bytes);
+
+/* what is left of the budget, negative once over it, INT64_MAX without one */
+int64_t memory_account_room(MemoryAccount *a);
+
+/* a copy that can be taken while the player runs */
+void memory_account_copy(MemoryAccount *dst, MemoryAccount *a);
+
+const char *memory_tag_name(int tag);
+
+void memory_account_log(MemoryAccount *a);
+
+/* the indices of the values of memory_account_pack: live and peak bytes of
+ * each tag, then the totals and the budget */
+#define MEMORY_REPORT_LIVE(tag) (2 * (tag))
+#define MEMORY_REPORT_PEAK(tag) (2 * (tag) + 1)
+#define MEMORY_REPORT_TOTAL (2 * MEMORY_TAG_NB)
+#define MEMORY_REPORT_TOTAL_PEAK (MEMORY_REPORT_TOTAL + 1)
+#define MEMORY_REPORT_BUDGET (MEMORY_REPORT_TOTAL + 2)
+#define MEMORY_REPORT_NB (MEMORY_REPORT_TOTAL + 3)
+
+void memory_account_pack(const MemoryAccount *a, int64_t *values);
+
+}
+
+#endif //MYPLAYER_MEMORYACCOUNT_H
@@ -5,20 +5,30 @@
 #include "MessageQueue.h"
 
 MessageQueue::MessageQueue() {
+    pthread_mutex_init(&mMutex, NULL);
+}
 
+MessageQueue::~MessageQueue() {
+    pthread_mutex_destroy(&mMutex);
 }
 
 
 void MessageQueue::sendMessage(Message msg) {
+    pthread_mutex_lock(&mMutex);
     mQueue.push_back(msg);
+    pthread_mutex_unlock(&mMutex);
 }
 
 
 bool MessageQueue::popMessage(Message &msg) {
-    if (mQueue.empty())
+    pthread_mutex_lock(&mMutex);
+    if (mQueue.empty()) {
+        pthread_mutex_unlock(&mMutex);
         return false;
+    }
     Message frontMessage = mQueue.front();
     mQueue.pop_front();
+    pthread_mutex_unlock(&mMutex);
     msg.messageCode = frontMessage.messageCode;
     msg.p_message = frontMessage.p_message;
     return true;
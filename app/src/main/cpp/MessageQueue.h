@@ -7,6 +7,7 @@
 
 #include <deque>
 #include <stdint.h>
+#include <pthread.h>
 
 typedef struct {
     uint8_t messageCode;
@@ -17,10 +18,13 @@ typedef struct {
 class MessageQueue {
 private:
     std::deque<Message> mQueue;
+    pthread_mutex_t mMutex;
 
 public:
     MessageQueue();
 
+    ~MessageQueue();
+
     void sendMessage(Message msg);
 
     bool popMessage(Message& msg);
@@ -0,0 +1,48 @@
+#include "NativeWindowSink.h"
+
+#include <errno.h>
+#include <stddef.h>
+
+NativeWindowSink::NativeWindowSink(ANativeWindow *window) : mWindow(window) {
+}
+
+NativeWindowSink::~NativeWindowSink() {
+    if (mWindow)
+        ANativeWindow_release(mWindow);
+}
+
+/* setWindow(NULL) leaves a sink without a window: no size, nothing shown */
+int NativeWindowSink::getWidth() {
+    return mWindow ? ANativeWindow_getWidth(mWindow) : 0;
+}
+
+int NativeWindowSink::getHeight() {
+    return mWindow ? ANativeWindow_getHeight(mWindow) : 0;
+}
+
+int NativeWindowSink::setBuffersGeometry(int width, int height) {
+    if (!mWindow)
+        return -EINVAL;
+    return ANativeWindow_setBuffersGeometry(mWindow, width, height, WINDOW_FORMAT_RGBA_8888);
+}
+
+int NativeWindowSink::lock(ffplayer::VideoSinkBuffer *buffer) {
+    ANativeWindow_Buffer windowBuffer;
+    int error;
+
+    if (!mWindow)
+        return -EINVAL;
+    error = ANativeWindow_lock(mWindow, &windowBuffer, NULL);
+    if (error != 0)
+        return error;
+    buffer->bits = (uint8_t *) windowBuffer.bits;
+    buffer->stride = windowBuffer.stride * 4;
+    buffer->width = windowBuffer.width;
+    buffer->height = windowBuffer.height;
+    return 0;
+}
+
+void NativeWindowSink::unlockAndPost(double pts) {
+    if (mWindow)
+        ANativeWindow_unlockAndPost(mWindow);
+}
@@ -0,0 +1,30 @@
+#ifndef MYPLAYER_NATIVEWINDOWSINK_H
+#define MYPLAYER_NATIVEWINDOWSINK_H
+
+#include <android/native_window.h>
+
+#include "Platform.h"
+
+/* the pictures of a player shown on an ANativeWindow, whose reference it
+ * takes over and releases */
+class NativeWindowSink : public ffplayer::VideoSink {
+private:
+    ANativeWindow *mWindow;
+
+public:
+    explicit NativeWindowSink(ANativeWindow *window);
+
+    ~NativeWindowSink();
+
+    int getWidth();
+
+    int getHeight();
+
+    int setBuffersGeometry(int width, int height);
+
+    int lock(ffplayer::VideoSinkBuffer *buffer);
+
+    void unlockAndPost(double pts);
+};
+
+#endif //MYPLAYER_NATIVEWINDOWSINK_H
@@ -0,0 +1,61 @@
+#ifndef MYPLAYER_PLATFORM_H
+#define MYPLAYER_PLATFORM_H
+
+#include <stdint.h>
+
+namespace ffplayer {
+
+/* where a player puts its pictures and samples: an ANativeWindow and OpenSL ES
+ * on Android, the sinks of host/ on a workstation. A player owns its sinks
+ * and deletes them when it is gone. */
+
+typedef struct VideoSinkBuffer {
+    uint8_t *bits;
+    int stride;                // in bytes
+    int width;
+    int height;
+} VideoSinkBuffer;
+
+class VideoSink {
+public:
+    virtual ~VideoSink() {}
+
+    /* the size it is shown at, to pick the decoding resolution */
+    virtual int getWidth() = 0;
+
+    virtual int getHeight() = 0;
+
+    /* the pictures posted from now on are RGBA of this size */
+    virtual int setBuffersGeometry(int width, int height) = 0;
+
+    /* the buffer to draw the next picture in, 0 or a negative error */
+    virtual int lock(VideoSinkBuffer *buffer) = 0;
+
+    /* show the picture drawn in the locked buffer, pts in seconds */
+    virtual void unlockAndPost(double pts) = 0;
+};
+
+/* fills stream with len bytes of the samples to play next, returns 0 if they
+ * are all silence put in for want of samples, when paused or at the end */
+typedef int (*AudioSinkCallback)(void *userdata, uint8_t *stream, int len);
+
+class AudioSink {
+public:
+    virtual ~AudioSink() {}
+
+    /* get ready for interleaved signed 16 bit samples, pulled through callback
+     * from the sink's own thread */
+    virtual void open(int sampleRate, unsigned int channels, void *userData,
+                      AudioSinkCallback callback) = 0;
+
+    /* start pulling samples */
+    virtual void start() = 0;
+
+    /* stop pulling, callback is not called anymore once it returns; the
+     * sink can be opened again */
+    virtual void close() = 0;
+};
+
+}
+
+#endif //MYPLAYER_PLATFORM_H
@@ -0,0 +1,53 @@
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __ANDROID__
+
+int platform_log_vprint(int prio, const char *tag, const char *fmt, va_list args) {
+    return __android_log_vprint(prio, tag, fmt, args);
+}
+
+void platform_log_set_priority(int prio) {
+}
+
+#else
+
+static int min_priority = ANDROID_LOG_INFO;
+
+int platform_log_vprint(int prio, const char *tag, const char *fmt, va_list args) {
+    static const char letters[] = "??VDIWEFS";
+    char line[1024];
+    int n;
+
+    if (prio < min_priority)
+        return 0;
+    n = snprintf(line, sizeof(line), "%c/%s: ",
+                 prio >= 0 && prio < (int) sizeof(letters) - 1 ? letters[prio] : '?',
+                 tag ? tag : "");
+    vsnprintf(line + n, sizeof(line) - n - 1, fmt, args);
+    n = strlen(line);
+    if (!n || line[n - 1] != '\n') {
+        line[n++] = '\n';
+        line[n] = 0;
+    }
+    /* one write per line, several players log at the same time */
+    return fputs(line, stderr);
+}
+
+void platform_log_set_priority(int prio) {
+    min_priority = prio;
+}
+
+#endif
+
+int platform_log_print(int prio, const char *tag, const char *fmt, ...) {
+    va_list args;
+    int ret;
+
+    va_start(args, fmt);
+    ret = platform_log_vprint(prio, tag, fmt, args);
+    va_end(args);
+    return ret;
+}
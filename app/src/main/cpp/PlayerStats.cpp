@@ -0,0 +1,124 @@
+#include "PlayerStats.h"
+
+extern "C" {
+#include "libavutil/common.h"
+}
+
+#include <math.h>
+#include <string.h>
+
+namespace ffplayer {
+
+static int latency_bucket(int64_t us) {
+    int log2, index;
+
+    if (us < 2)
+        return 0;
+    us = FFMIN(us, INT32_MAX);
+    log2 = av_log2((unsigned) us);
+    /* the bit below the top one splits the octave in two */
+    index = 2 * log2 + (int) ((us >> (log2 - 1)) & 1);
+    return FFMIN(index, STATS_LATENCY_BUCKETS - 1);
+}
+
+static int64_t latency_bucket_max(int index) {
+    int64_t octave = (int64_t) 1 << (index / 2);
+    return index & 1 ? 2 * octave : octave + (octave + 1) / 2;
+}
+
+void latency_histogram_add(LatencyHistogram *h, int64_t us) {
+    __atomic_fetch_add(&h->count[latency_bucket(us)], 1, __ATOMIC_RELAXED);
+}
+
+void latency_histogram_copy(LatencyHistogram *dst, const LatencyHistogram *h) {
+    int i;
+
+    for (i = 0; i < STATS_LATENCY_BUCKETS; i++)
+        dst->count[i] = __atomic_load_n(&h->count[i], __ATOMIC_RELAXED);
+}
+
+int64_t latency_histogram_percentile(const LatencyHistogram *now, const LatencyHistogram *base,
+                                     double p) {
+    uint32_t total = 0, seen = 0, target;
+    int i;
+
+    for (i = 0; i < STATS_LATENCY_BUCKETS; i++)
+        total += now->count[i] - base->count[i];
+    if (!total)
+        return 0;
+    target = FFMAX((uint32_t) (p * total + 0.5), 1);
+    for (i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+        seen += now->count[i] - base->count[i];
+        if (seen >= target)
+            break;
+    }
+    return latency_bucket_max(FFMIN(i, STATS_LATENCY_BUCKETS - 1));
+}
+
+int stats_drift_bucket(double diff) {
+    static const double edges[STATS_DRIFT_BUCKETS - 1] = {
+            -0.160, -0.080, -0.040, -0.020, -0.010, -0.005,
+            0.005, 0.010, 0.020, 0.040, 0.080, 0.160,
+    };
+    int i;
+
+    for (i = 0; i < STATS_DRIFT_BUCKETS - 1; i++) {
+        if (diff < edges[i])
+            break;
+    }
+    return i;
+}
+
+void stats_snapshot_publish(StatsSnapshot *s, const PlayerStats *stats) {
+    uint32_t sequence = s->sequence;
+
+    __atomic_store_n(&s->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&s->stats, stats, sizeof(*stats));
+    __atomic_store_n(&s->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+void stats_snapshot_read(StatsSnapshot *s, PlayerStats *stats) {
+    uint32_t sequence;
+
+    for (;;) {
+        sequence = __atomic_load_n(&s->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+            continue;
+        memcpy(stats, &s->stats, sizeof(*stats));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->sequence, __ATOMIC_RELAXED) == sequence)
+            return;
+    }
+}
+
+void player_stats_pack(const PlayerStats *stats, int64_t *values) {
+    int i;
+
+    values[STATS_MASTER_CLOCK] = isnan(stats->master_clock) ? -1 : (int64_t) (stats->master_clock * 1000000);
+    values[STATS_AV_DIFF] = (int64_t) (stats->av_diff * 1000000);
+    values[STATS_AUDIOQ_BYTES] = stats->audioq_bytes;
+    values[STATS_VIDEOQ_BYTES] = stats->videoq_bytes;
+    values[STATS_SUBTITLEQ_BYTES] = stats->subtitleq_bytes;
+    values[STATS_AUDIOQ_DURATION] = (int64_t) (stats->audioq_seconds * 1000000);
+    values[STATS_VIDEOQ_DURATION] = (int64_t) (stats->videoq_seconds * 1000000);
+    values[STATS_PICTQ_FRAMES] = stats->pictq_frames;
+    values[STATS_SAMPQ_FRAMES] = stats->sampq_frames;
+    values[STATS_DECODE_P50] = stats->decode_p50;
+    values[STATS_DECODE_P90] = stats->decode_p90;
+    values[STATS_DECODE_P99] = stats->decode_p99;
+    values[STATS_CONVERT_P50] = stats->convert_p50;
+    values[STATS_CONVERT_P90] = stats->convert_p90;
+    values[STATS_CONVERT_P99] = stats->convert_p99;
+    values[STATS_FRAMES_DISPLAYED] = stats->frames_displayed;
+    values[STATS_DROPS_EARLY] = stats->drops_early;
+    values[STATS_DROPS_LATE] = stats->drops_late;
+    values[STATS_AUDIO_UNDERRUNS] = stats->audio_underruns;
+    values[STATS_FAULTY_DTS] = stats->faulty_dts;
+    values[STATS_FAULTY_PTS] = stats->faulty_pts;
+    values[STATS_BITRATE] = stats->bitrate;
+    for (i = 0; i < STATS_DRIFT_BUCKETS; i++)
+        values[STATS_DRIFT + i] = stats->drift[i];
+}
+
+}
@@ -0,0 +1,117 @@
+#ifndef MYPLAYER_PLAYERSTATS_H
+#define MYPLAYER_PLAYERSTATS_H
+
+#include <stdint.h>
+
+/* microseconds between two updates of the snapshot */
+#define STATS_UPDATE_INTERVAL 30000
+/* the percentiles and the bitrate are over the last one to two windows */
+#define STATS_WINDOW 2000000
+
+/* two buckets per octave of microseconds, up to 2^24 us */
+#define STATS_LATENCY_BUCKETS 48
+/* the A-V drift in ms: < -160, -160, -80, -40, -20, -10, -5..5, 5, 10, 20, 40, 80, >= 160 */
+#define STATS_DRIFT_BUCKETS 13
+
+namespace ffplayer {
+
+/* how long something took, added to from any thread */
+typedef struct LatencyHistogram {
+    uint32_t count[STATS_LATENCY_BUCKETS];
+} LatencyHistogram;
+
+void latency_histogram_add(LatencyHistogram *h, int64_t us);
+
+/* a copy that can be taken while another thread adds to h */
+void latency_histogram_copy(LatencyHistogram *dst, const LatencyHistogram *h);
+
+/* the p-th percentile in microseconds of what was added between base and now,
+ * the upper bound of its bucket, 0 if nothing was */
+int64_t latency_histogram_percentile(const LatencyHistogram *now, const LatencyHistogram *base,
+                                     double p);
+
+int stats_drift_bucket(double diff);
+
+/* the counters when a window started */
+typedef struct StatsWindow {
+    int64_t start;
+    LatencyHistogram decode;
+    LatencyHistogram convert;
+    int64_t bytes_read;
+} StatsWindow;
+
+/* a player as the app sees it, all made of numbers so that nothing is
+ * formatted while playing */
+typedef struct PlayerStats {
+    int64_t time;                 // of the time source of the player, 0 before the first update
+    double master_clock;
+    double av_diff;               // the master clock, or audio if both, minus the video one
+    int64_t audioq_bytes;
+    int64_t videoq_bytes;
+    int64_t subtitleq_bytes;
+    double audioq_seconds;        // from the first to the last packet queued
+    double videoq_seconds;
+    int pictq_frames;             // decoded and converted, not shown yet
+    int sampq_frames;
+    int64_t decode_p50;           // microseconds to decode a picture
+    int64_t decode_p90;
+    int64_t decode_p99;
+    int64_t convert_p50;          // and to convert it to RGBA
+    int64_t convert_p90;
+    int64_t convert_p99;
+    int64_t frames_displayed;
+    int64_t drops_early;          // dropped before conversion, too late already
+    int64_t drops_late;           // converted but dropped by the display
+    int64_t audio_underruns;      // the audio callback waited for samples
+    int faulty_dts;
+    int faulty_pts;
+    int64_t bitrate;              // bits per second read from the input
+    int64_t drift[STATS_DRIFT_BUCKETS]; // updates by A-V drift range
+} PlayerStats;
+
+/* the latest stats of a player, written by its event thread only and read
+ * from any thread without a lock: the sequence is odd while it is written,
+ * a reader tries again when it changed under it */
+typedef struct StatsSnapshot {
+    uint32_t sequence;
+    PlayerStats stats;
+} StatsSnapshot;
+
+void stats_snapshot_publish(StatsSnapshot *s, const PlayerStats *stats);
+
+void stats_snapshot_read(StatsSnapshot *s, PlayerStats *stats);
+
+/* the indices of the values of player_stats_pack, times in microseconds */
+enum PlayerStatsField {
+    STATS_MASTER_CLOCK = 0,
+    STATS_AV_DIFF,
+    STATS_AUDIOQ_BYTES,
+    STATS_VIDEOQ_BYTES,
+    STATS_SUBTITLEQ_BYTES,
+    STATS_AUDIOQ_DURATION,
+    STATS_VIDEOQ_DURATION,
+    STATS_PICTQ_FRAMES,
+    STATS_SAMPQ_FRAMES,
+    STATS_DECODE_P50,
+    STATS_DECODE_P90,
+    STATS_DECODE_P99,
+    STATS_CONVERT_P50,
+    STATS_CONVERT_P90,
+    STATS_CONVERT_P99,
+    STATS_FRAMES_DISPLAYED,
+    STATS_DROPS_EARLY,
+    STATS_DROPS_LATE,
+    STATS_AUDIO_UNDERRUNS,
+    STATS_FAULTY_DTS,
+    STATS_FAULTY_PTS,
+    STATS_BITRATE,
+    STATS_DRIFT,                  // STATS_DRIFT_BUCKETS values
+    STATS_FIELD_NB = STATS_DRIFT + STATS_DRIFT_BUCKETS
+};
+
+/* flatten the stats into STATS_FIELD_NB integers */
+void player_stats_pack(const PlayerStats *stats, int64_t *values);
+
+}
+
+#endif //MYPLAYER_PLAYERSTATS_H
@@ -0,0 +1,291 @@
+#include "ReverseDecoder.h"
+
+extern "C" {
+#include "libavutil/common.h"
+#include "libavutil/imgutils.h"
+}
+
+#include <string.h>
+
+namespace ffplayer {
+
+/* the frames handed out are empty, the account only has the others */
+static void reverse_frame_free(ReverseDecoder *d, AVFrame **frame) {
+    if (*frame && (*frame)->buf[0])
+        memory_account_add(d->mem, MEMORY_REVERSE, -d->frame_size);
+    av_frame_free(frame);
+}
+
+static void reverse_chunk_clear(ReverseDecoder *d, ReverseChunk *c) {
+    int i;
+    for (i = 0; i < c->nb_frames; i++)
+        reverse_frame_free(d, &c->frames[i]);
+    c->nb_frames = 0;
+    c->rpos = 0;
+    c->ready = 0;
+}
+
+/* keep the last max_frames frames only, the chunk then starts later than its keyframe */
+static int reverse_chunk_append(ReverseDecoder *d, ReverseChunk *c, AVFrame *frame,
+                                int64_t pts) {
+    /* the budget can shrink while decoding */
+    while (c->nb_frames > 0
+           && c->nb_frames >= __atomic_load_n(&d->max_frames, __ATOMIC_RELAXED)) {
+        reverse_frame_free(d, &c->frames[0]);
+        memmove(c->frames, c->frames + 1, (c->nb_frames - 1) * sizeof(*c->frames));
+        memmove(c->pts, c->pts + 1, (c->nb_frames - 1) * sizeof(*c->pts));
+        c->nb_frames--;
+    }
+    if (!(c->frames[c->nb_frames] = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+    av_frame_move_ref(c->frames[c->nb_frames], frame);
+    memory_account_add(d->mem, MEMORY_REVERSE, d->frame_size);
+    c->pts[c->nb_frames] = pts;
+    c->nb_frames++;
+    return 0;
+}
+
+/* decode the frames from the keyframe before end up to end into c.
+ * Return the number of frames, or < 0 if the chunk is not wanted anymore. */
+static int reverse_decode_chunk(ReverseDecoder *d, ReverseChunk *c, int64_t end, int generation) {
+    AVPacket pkt;
+    AVFrame *frame;
+    int got_frame = 0, reading = 1, ret;
+
+    if (av_seek_frame(d->ic, d->stream_index, end - 1, AVSEEK_FLAG_BACKWARD) < 0)
+        return 0;
+    avcodec_flush_buffers(d->avctx);
+
+    if (!(frame = av_frame_alloc()))
+        return AVERROR(ENOMEM);
+
+    do {
+        if (d->abort_request || d->generation != generation) {
+            av_frame_free(&frame);
+            return -1;
+        }
+        if (reading) {
+            ret = av_read_frame(d->ic, &pkt);
+            if (ret >= 0 && pkt.stream_index != d->stream_index) {
+                av_free_packet(&pkt);
+                continue;
+            }
+            /* packets decoding to frames before end all have a dts before it */
+            if (ret < 0 || (pkt.dts != AV_NOPTS_VALUE && pkt.dts >= end)) {
+                if (ret >= 0)
+                    av_free_packet(&pkt);
+                reading = 0;
+            }
+        }
+        if (!reading) {
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+        }
+
+        got_frame = 0;
+        avcodec_decode_video2(d->avctx, frame, &got_frame, &pkt);
+        if (reading)
+            av_free_packet(&pkt);
+        if (got_frame) {
+            int64_t pts = av_frame_get_best_effort_timestamp(frame);
+            if (pts != AV_NOPTS_VALUE && pts < end
+                && reverse_chunk_append(d, c, frame, pts) < 0)
+                got_frame = reading = 0;
+            av_frame_unref(frame);
+        }
+    } while (reading || got_frame);
+
+    av_frame_free(&frame);
+    return c->nb_frames;
+}
+
+static void *reverse_decoder_thread(void *arg) {
+    ReverseDecoder *d = (ReverseDecoder *) arg;
+    ReverseChunk *c;
+    int64_t end;
+    int generation, ret;
+
+    pthread_mutex_lock(&d->mutex);
+    for (; ;) {
+        while (!d->abort_request
+               && (!d->running || d->done || d->chunks[d->windex].ready))
+            pthread_cond_wait(&d->cond, &d->mutex);
+        if (d->abort_request)
+            break;
+
+        c = &d->chunks[d->windex];
+        end = d->next_end;
+        generation = d->generation;
+        pthread_mutex_unlock(&d->mutex);
+
+        ret = reverse_decode_chunk(d, c, end, generation);
+
+        pthread_mutex_lock(&d->mutex);
+        if (generation != d->generation || !d->running) {
+            /* restarted or stopped while decoding */
+            reverse_chunk_clear(d, c);
+            continue;
+        }
+        if (ret <= 0) {
+            reverse_chunk_clear(d, c);
+            d->done = 1;
+            continue;
+        }
+        c->rpos = c->nb_frames;
+        c->serial = d->serial;
+        c->ready = 1;
+        d->next_end = c->pts[0];
+        d->windex = !d->windex;
+        pthread_cond_broadcast(&d->cond);
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return NULL;
+}
+
+int reverse_decoder_open(ReverseDecoder *d, const char *filename, int stream_index,
+                         AVCodecContext *codec, int max_size, MemoryAccount *mem) {
+    AVCodec *dec;
+    AVStream *st;
+    int i, ret;
+
+    memset(d, 0, sizeof(*d));
+    d->mem = mem;
+    if ((ret = avformat_open_input(&d->ic, filename, NULL, NULL)) < 0)
+        goto fail;
+    if (stream_index >= (int) d->ic->nb_streams
+        || d->ic->streams[stream_index]->codec->codec_id != codec->codec_id) {
+        av_log(NULL, AV_LOG_WARNING, "%s: video stream %d not found by the reverse decoder\n",
+               filename, stream_index);
+        ret = AVERROR_STREAM_NOT_FOUND;
+        goto fail;
+    }
+    for (i = 0; i < (int) d->ic->nb_streams; i++)
+        d->ic->streams[i]->discard = i == stream_index ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+    st = d->ic->streams[stream_index];
+
+    if (!(dec = avcodec_find_decoder(codec->codec_id))) {
+        ret = AVERROR_DECODER_NOT_FOUND;
+        goto fail;
+    }
+    if (!(d->avctx = avcodec_alloc_context3(dec))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    if ((ret = avcodec_copy_context(d->avctx, codec)) < 0)
+        goto fail;
+    d->avctx->refcounted_frames = 1;
+    av_codec_set_pkt_timebase(d->avctx, st->time_base);
+    if ((ret = avcodec_open2(d->avctx, dec, NULL)) < 0)
+        goto fail;
+
+    d->stream_index = stream_index;
+    d->time_base = st->time_base;
+
+    d->frame_size = av_image_get_buffer_size(codec->pix_fmt, codec->width, codec->height, 1);
+    if (d->frame_size <= 0)
+        d->frame_size = 1920 * 1080 * 3 / 2;
+    reverse_decoder_set_max_size(d, max_size);
+
+    pthread_mutex_init(&d->mutex, NULL);
+    pthread_cond_init(&d->cond, NULL);
+    if (pthread_create(&d->tid, NULL, reverse_decoder_thread, d)) {
+        pthread_cond_destroy(&d->cond);
+        pthread_mutex_destroy(&d->mutex);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    pthread_setname_np(d->tid, "reverse");
+    return 0;
+
+    fail:
+    avcodec_free_context(&d->avctx);
+    avformat_close_input(&d->ic);
+    return ret;
+}
+
+void reverse_decoder_close(ReverseDecoder *d) {
+    if (!d->ic)
+        return;
+
+    pthread_mutex_lock(&d->mutex);
+    d->abort_request = 1;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->mutex);
+    pthread_join(d->tid, NULL);
+
+    reverse_chunk_clear(d, &d->chunks[0]);
+    reverse_chunk_clear(d, &d->chunks[1]);
+    avcodec_free_context(&d->avctx);
+    avformat_close_input(&d->ic);
+    pthread_cond_destroy(&d->cond);
+    pthread_mutex_destroy(&d->mutex);
+}
+
+/* the chunk being decoded is left to the decoding thread, which drops it */
+static void reverse_decoder_reset(ReverseDecoder *d) {
+    int i;
+    for (i = 0; i < 2; i++)
+        if (d->chunks[i].ready)
+            reverse_chunk_clear(d, &d->chunks[i]);
+    d->rindex = d->windex;
+    d->generation++;
+    d->done = 0;
+}
+
+void reverse_decoder_set_max_size(ReverseDecoder *d, int max_size) {
+    /* two chunks share it, so bigger pictures mean shorter chunks */
+    __atomic_store_n(&d->max_frames,
+                     av_clip(max_size / 2 / d->frame_size, 2, REVERSE_CHUNK_MAX_FRAMES),
+                     __ATOMIC_RELAXED);
+}
+
+void reverse_decoder_start(ReverseDecoder *d, double pts, int serial) {
+    pthread_mutex_lock(&d->mutex);
+    reverse_decoder_reset(d);
+    d->serial = serial;
+    d->next_end = (int64_t) llrint(pts / av_q2d(d->time_base));
+    d->running = 1;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->mutex);
+}
+
+void reverse_decoder_stop(ReverseDecoder *d) {
+    if (!d->ic)
+        return;
+    pthread_mutex_lock(&d->mutex);
+    reverse_decoder_reset(d);
+    d->running = 0;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->mutex);
+}
+
+int reverse_decoder_get(ReverseDecoder *d, AVFrame *frame, double *pts, int *serial) {
+    ReverseChunk *c;
+    int ret = 0;
+
+    pthread_mutex_lock(&d->mutex);
+    while (!d->abort_request && d->running) {
+        c = &d->chunks[d->rindex];
+        if (c->ready && c->rpos > 0) {
+            c->rpos--;
+            av_frame_move_ref(frame, c->frames[c->rpos]);
+            memory_account_add(d->mem, MEMORY_REVERSE, -d->frame_size);
+            *pts = c->pts[c->rpos] * av_q2d(d->time_base);
+            *serial = c->serial;
+            if (!c->rpos) {
+                /* hand the chunk back to the decoding thread */
+                reverse_chunk_clear(d, c);
+                d->rindex = !d->rindex;
+                pthread_cond_broadcast(&d->cond);
+            }
+            ret = 1;
+            break;
+        }
+        pthread_cond_wait(&d->cond, &d->mutex);
+    }
+    pthread_mutex_unlock(&d->mutex);
+    return ret;
+}
+
+}
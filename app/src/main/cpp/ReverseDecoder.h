@@ -0,0 +1,74 @@
+#ifndef MYPLAYER_REVERSEDECODER_H
+#define MYPLAYER_REVERSEDECODER_H
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+}
+
+#include <pthread.h>
+
+#include "MemoryAccount.h"
+
+/* upper bound on the frames of one chunk whatever the memory budget */
+#define REVERSE_CHUNK_MAX_FRAMES 120
+
+namespace ffplayer {
+
+/* the last frames before some pts, decoded forward from the keyframe before them */
+typedef struct ReverseChunk {
+    AVFrame *frames[REVERSE_CHUNK_MAX_FRAMES]; // in presentation order
+    int64_t pts[REVERSE_CHUNK_MAX_FRAMES];
+    int nb_frames;
+    int rpos;       // frames[rpos - 1] is the next one to hand out
+    int ready;
+    int serial;
+} ReverseChunk;
+
+/* decodes a video stream backwards, GOP by GOP, on its own demuxer and thread.
+ * While one chunk is handed out the one before it is decoded into the other. */
+typedef struct ReverseDecoder {
+    AVFormatContext *ic;
+    AVCodecContext *avctx;
+    int stream_index;
+    AVRational time_base;
+    int max_frames;      // frames per chunk, from the memory budget and the frame size
+    int frame_size;      // estimated bytes of a decoded frame
+    MemoryAccount *mem;
+
+    ReverseChunk chunks[2];
+    int rindex;
+    int windex;
+    int64_t next_end;    // the next chunk holds the frames before this pts
+    int serial;          // handed out with the frames
+    int generation;      // bumped on every start and stop
+    int running;
+    int done;            // reached the start of the stream
+    int abort_request;
+
+    pthread_t tid;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} ReverseDecoder;
+
+int reverse_decoder_open(ReverseDecoder *d, const char *filename, int stream_index,
+                         AVCodecContext *codec, int max_size, MemoryAccount *mem);
+
+/* bound the bytes of the frames held for the chunks to come, never less
+ * than two frames each; the frames over it are dropped as they are decoded */
+void reverse_decoder_set_max_size(ReverseDecoder *d, int max_size);
+
+void reverse_decoder_close(ReverseDecoder *d);
+
+/* hand out the frames before pts (in seconds), latest first, tagged with serial */
+void reverse_decoder_start(ReverseDecoder *d, double pts, int serial);
+
+void reverse_decoder_stop(ReverseDecoder *d);
+
+/* wait for the next frame going backwards. Return 1 with a new reference in
+ * frame, 0 once the decoder is stopped. At the start of the stream it waits. */
+int reverse_decoder_get(ReverseDecoder *d, AVFrame *frame, double *pts, int *serial);
+
+}
+
+#endif //MYPLAYER_REVERSEDECODER_H
@@ -0,0 +1,89 @@
+#include "log.h"
+#include "StartupReport.h"
+
+extern "C" {
+#include "libavutil/time.h"
+}
+
+#include <string.h>
+
+namespace ffplayer {
+
+void startup_report_init(StartupReport *r, int64_t prepare_time) {
+    memset(r, 0, sizeof(*r));
+    r->time[STARTUP_PREPARE] = prepare_time;
+}
+
+int startup_report_mark(StartupReport *r, int phase) {
+    int64_t unset = 0;
+
+    if (__atomic_load_n(&r->time[phase], __ATOMIC_SEQ_CST))
+        return 0;
+    /* the first thread to reach the phase sets its time */
+    return __atomic_compare_exchange_n(&r->time[phase], &unset, av_gettime_relative(), 0,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+int64_t startup_report_time(const StartupReport *r, int phase) {
+    return __atomic_load_n(&r->time[phase], __ATOMIC_SEQ_CST);
+}
+
+int startup_report_claim(StartupReport *r) {
+    int unclaimed = 0;
+
+    return __atomic_compare_exchange_n(&r->reported, &unclaimed, 1, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+void startup_report_copy(StartupReport *dst, const StartupReport *src) {
+    int i;
+
+    *dst = *src;
+    for (i = 0; i < STARTUP_PHASE_NB; i++)
+        dst->time[i] = startup_report_time(src, i);
+}
+
+int64_t startup_report_elapsed(const StartupReport *r, int phase) {
+    int64_t time = startup_report_time(r, phase);
+
+    if (!time)
+        return -1;
+    return (time - startup_report_time(r, STARTUP_PREPARE)) / 1000;
+}
+
+void startup_report_log(const StartupReport *r) {
+    int64_t last = startup_report_time(r, STARTUP_PREPARE), time;
+    int i;
+
+    ALOGI("startup: stream info %s%s", r->stream_info_cached ? "cached" : "probed",
+          r->fast_start ? ", fast start" : "");
+    for (i = STARTUP_PREPARE + 1; i < STARTUP_PHASE_NB; i++) {
+        if (!(time = startup_report_time(r, i)))
+            continue;
+        /* the phases on different threads overlap, so the step can be negative */
+        ALOGI("startup: %-14s %5lld ms (%+lld ms)", startup_phase_name(i),
+              (long long) startup_report_elapsed(r, i),
+              (long long) ((time - last) / 1000));
+        last = time;
+    }
+}
+
+const char *startup_phase_name(int phase) {
+    static const char *const names[STARTUP_PHASE_NB] = {
+            "prepare",
+            "read thread",
+            "open",
+            "probe",
+            "codec open",
+            "audio device",
+            "first decode",
+            "first convert",
+            "first display",
+            "first audio",
+    };
+    if (phase < 0 || phase >= STARTUP_PHASE_NB)
+        return "unknown";
+    return names[phase];
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef MYPLAYER_STARTUPREPORT_H
+#define MYPLAYER_STARTUPREPORT_H
+
+#include <stdint.h>
+
+namespace ffplayer {
+
+/* the steps from prepare() to the first frame and sample, in the order they
+ * are usually reached */
+enum StartupPhase {
+    STARTUP_PREPARE = 0,    // FFPlayer::prepare called
+    STARTUP_READ_THREAD,    // the read thread is running
+    STARTUP_OPEN,           // the input is opened
+    STARTUP_PROBE,          // the stream info is probed or restored from the cache
+    STARTUP_CODEC_OPEN,     // the decoders are opened
+    STARTUP_AUDIO_DEVICE,   // the audio player is created and started
+    STARTUP_FIRST_DECODE,   // the first video frame is decoded
+    STARTUP_FIRST_CONVERT,  // and converted to RGBA
+    STARTUP_FIRST_DISPLAY,  // and shown
+    STARTUP_FIRST_AUDIO,    // the first decoded samples are handed to the audio player
+    STARTUP_PHASE_NB
+};
+
+/* the phases are marked from the read, video and audio threads, so the times
+ * are only accessed through the functions below */
+typedef struct StartupReport {
+    int64_t time[STARTUP_PHASE_NB]; // av_gettime_relative() when reached, 0 until then
+    int stream_info_cached;
+    int fast_start;
+    int reported;           // the report was claimed by startup_report_claim
+} StartupReport;
+
+void startup_report_init(StartupReport *r, int64_t prepare_time);
+
+/* record the time of a phase the first time it is reached. Return 1 if it was
+ * reached just now. */
+int startup_report_mark(StartupReport *r, int phase);
+
+/* when the phase was reached, 0 if not yet */
+int64_t startup_report_time(const StartupReport *r, int phase);
+
+/* return 1 to the first caller only, which logs the report */
+int startup_report_claim(StartupReport *r);
+
+/* a consistent copy for another thread */
+void startup_report_copy(StartupReport *dst, const StartupReport *src);
+
+/* milliseconds from prepare() to the phase, -1 if not reached */
+int64_t startup_report_elapsed(const StartupReport *r, int phase);
+
+void startup_report_log(const StartupReport *r);
+
+const char *startup_phase_name(int phase);
+
+}
+
+#endif //MYPLAYER_STARTUPREPORT_H
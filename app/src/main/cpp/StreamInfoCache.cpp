@@ -0,0 +1,272 @@
+#include "StreamInfoCache.h"
+
+extern "C" {
+#include "libavutil/avstring.h"
+#include "libavutil/common.h"
+}
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* the streams found by probing, which a plain open may not have found */
+#define STREAM_INFO_MAX_STREAMS 64
+
+namespace ffplayer {
+
+typedef struct StreamInfoHeader {
+    uint32_t magic;
+    uint32_t version;
+    int64_t size;           // of the media file
+    int64_t mtime;
+    int64_t duration;
+    int64_t start_time;
+    int64_t bit_rate;
+    uint32_t nb_streams;
+    uint32_t filename_size; // the file name follows, then the records, then the extradata
+} StreamInfoHeader;
+
+typedef struct StreamInfoRecord {
+    int64_t duration;
+    int64_t start_time;
+    int64_t channel_layout;
+    int64_t bit_rate;
+    int32_t codec_type;
+    int32_t codec_id;
+    int32_t codec_tag;
+    int32_t format;         // pixel or sample format
+    int32_t width;
+    int32_t height;
+    int32_t sample_rate;
+    int32_t channels;
+    int32_t has_b_frames;
+    int32_t profile;
+    int32_t level;
+    int32_t codec_info_nb_frames;
+    int32_t time_base[2];
+    int32_t sample_aspect_ratio[2];
+    int32_t r_frame_rate[2];
+    int32_t avg_frame_rate[2];
+    int32_t extradata_size;
+    int32_t reserved;
+} StreamInfoRecord;
+
+static char *stream_info_path(const char *dir, const char *filename) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const char *p;
+    for (p = filename; *p; p++)
+        h = (h ^ (uint8_t) *p) * 0x100000001b3ULL;
+    return av_asprintf("%s/%016llx.si", dir, (unsigned long long) h);
+}
+
+static inline AVRational to_rational(const int32_t *q) {
+    return av_make_q(q[0], q[1]);
+}
+
+static inline void from_rational(int32_t *q, AVRational r) {
+    q[0] = r.num;
+    q[1] = r.den;
+}
+
+/* the streams the demuxer created on its own must be the ones probed before */
+static int stream_info_match(AVFormatContext *ic, const StreamInfoRecord *r, int nb_streams) {
+    int i;
+    if ((int) ic->nb_streams != nb_streams)
+        return 0;
+    for (i = 0; i < nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        if (st->codec->codec_type != r[i].codec_type
+            || (st->codec->codec_id != AV_CODEC_ID_NONE && st->codec->codec_id != r[i].codec_id)
+            || av_cmp_q(st->time_base, to_rational(r[i].time_base)))
+            return 0;
+    }
+    return 1;
+}
+
+static void stream_info_restore(AVStream *st, const StreamInfoRecord *r, const uint8_t *extradata) {
+    AVCodecContext *c = st->codec;
+
+    c->codec_id = (enum AVCodecID) r->codec_id;
+    if (!c->codec_tag)
+        c->codec_tag = r->codec_tag;
+    if (c->codec_type == AVMEDIA_TYPE_VIDEO) {
+        c->pix_fmt = (enum AVPixelFormat) r->format;
+        c->width = r->width;
+        c->height = r->height;
+        c->has_b_frames = r->has_b_frames;
+    } else if (c->codec_type == AVMEDIA_TYPE_AUDIO) {
+        c->sample_fmt = (enum AVSampleFormat) r->format;
+        c->sample_rate = r->sample_rate;
+        c->channels = r->channels;
+        c->channel_layout = r->channel_layout;
+    } else if (c->codec_type == AVMEDIA_TYPE_SUBTITLE) {
+        c->width = r->width;
+        c->height = r->height;
+    }
+    if (!c->bit_rate)
+        c->bit_rate = r->bit_rate;
+    c->profile = r->profile;
+    c->level = r->level;
+    if (!c->extradata && r->extradata_size > 0) {
+        c->extradata = (uint8_t *) av_mallocz(r->extradata_size + FF_INPUT_BUFFER_PADDING_SIZE);
+        if (c->extradata) {
+            memcpy(c->extradata, extradata, r->extradata_size);
+            c->extradata_size = r->extradata_size;
+        }
+    }
+    st->sample_aspect_ratio = to_rational(r->sample_aspect_ratio);
+    st->r_frame_rate = to_rational(r->r_frame_rate);
+    st->avg_frame_rate = to_rational(r->avg_frame_rate);
+    if (st->duration == AV_NOPTS_VALUE)
+        st->duration = r->duration;
+    if (st->start_time == AV_NOPTS_VALUE)
+        st->start_time = r->start_time;
+    st->codec_info_nb_frames = r->codec_info_nb_frames;
+}
+
+int stream_info_cache_load(const char *dir, const char *filename, AVFormatContext *ic) {
+    StreamInfoHeader h;
+    StreamInfoRecord *records = NULL;
+    uint8_t *extradata = NULL;
+    char *name = NULL, *path;
+    struct stat st;
+    FILE *f = NULL;
+    int64_t extradata_size = 0;
+    int i, ret = 0;
+
+    if (!dir || stat(filename, &st) < 0 || !(path = stream_info_path(dir, filename)))
+        return 0;
+    f = fopen(path, "rb");
+    av_free(path);
+    if (!f)
+        return 0;
+
+    if (fread(&h, sizeof(h), 1, f) != 1 || h.magic != STREAM_INFO_MAGIC
+        || h.version != STREAM_INFO_VERSION || h.size != st.st_size || h.mtime != st.st_mtime
+        || h.nb_streams > STREAM_INFO_MAX_STREAMS || h.filename_size != strlen(filename))
+        goto end;
+    if (!(name = (char *) av_malloc(h.filename_size + 1))
+        || fread(name, 1, h.filename_size, f) != h.filename_size)
+        goto end;
+    name[h.filename_size] = 0;
+    if (strcmp(name, filename))
+        goto end;
+
+    if (!(records = (StreamInfoRecord *) av_malloc_array(FFMAX(h.nb_streams, 1), sizeof(*records)))
+        || fread(records, sizeof(*records), h.nb_streams, f) != h.nb_streams
+        || !stream_info_match(ic, records, h.nb_streams))
+        goto end;
+    for (i = 0; i < (int) h.nb_streams; i++) {
+        if (records[i].extradata_size < 0 || records[i].extradata_size > 1 << 24)
+            goto end;
+        extradata_size += records[i].extradata_size;
+    }
+    if (!(extradata = (uint8_t *) av_malloc(FFMAX(extradata_size, 1)))
+        || fread(extradata, 1, extradata_size, f) != (size_t) extradata_size)
+        goto end;
+
+    extradata_size = 0;
+    for (i = 0; i < (int) h.nb_streams; i++) {
+        stream_info_restore(ic->streams[i], &records[i], extradata + extradata_size);
+        extradata_size += records[i].extradata_size;
+    }
+    if (ic->duration == AV_NOPTS_VALUE)
+        ic->duration = h.duration;
+    if (ic->start_time == AV_NOPTS_VALUE)
+        ic->start_time = h.start_time;
+    if (!ic->bit_rate)
+        ic->bit_rate = h.bit_rate;
+    ret = 1;
+
+    end:
+    av_free(extradata);
+    av_free(records);
+    av_free(name);
+    fclose(f);
+    return ret;
+}
+
+int stream_info_cache_save(const char *dir, const char *filename, AVFormatContext *ic) {
+    StreamInfoHeader h;
+    StreamInfoRecord r;
+    struct stat st;
+    char *path, *tmp_path;
+    FILE *f;
+    unsigned i;
+    int ret = 0;
+
+    if (!dir || ic->nb_streams > STREAM_INFO_MAX_STREAMS || stat(filename, &st) < 0)
+        return 0;
+    if (!(path = stream_info_path(dir, filename)))
+        return AVERROR(ENOMEM);
+    if (!(tmp_path = av_asprintf("%s.tmp", path))) {
+        av_free(path);
+        return AVERROR(ENOMEM);
+    }
+    if (!(f = fopen(tmp_path, "wb"))) {
+        ret = AVERROR(errno);
+        goto end;
+    }
+
+    memset(&h, 0, sizeof(h));
+    h.magic = STREAM_INFO_MAGIC;
+    h.version = STREAM_INFO_VERSION;
+    h.size = st.st_size;
+    h.mtime = st.st_mtime;
+    h.duration = ic->duration;
+    h.start_time = ic->start_time;
+    h.bit_rate = ic->bit_rate;
+    h.nb_streams = ic->nb_streams;
+    h.filename_size = strlen(filename);
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(filename, 1, h.filename_size, f);
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *s = ic->streams[i];
+        AVCodecContext *c = s->codec;
+        memset(&r, 0, sizeof(r));
+        r.duration = s->duration;
+        r.start_time = s->start_time;
+        r.channel_layout = c->channel_layout;
+        r.bit_rate = c->bit_rate;
+        r.codec_type = c->codec_type;
+        r.codec_id = c->codec_id;
+        r.codec_tag = c->codec_tag;
+        r.format = c->codec_type == AVMEDIA_TYPE_AUDIO ? (int) c->sample_fmt : (int) c->pix_fmt;
+        r.width = c->width;
+        r.height = c->height;
+        r.sample_rate = c->sample_rate;
+        r.channels = c->channels;
+        r.has_b_frames = c->has_b_frames;
+        r.profile = c->profile;
+        r.level = c->level;
+        r.codec_info_nb_frames = s->codec_info_nb_frames;
+        from_rational(r.time_base, s->time_base);
+        from_rational(r.sample_aspect_ratio, s->sample_aspect_ratio);
+        from_rational(r.r_frame_rate, s->r_frame_rate);
+        from_rational(r.avg_frame_rate, s->avg_frame_rate);
+        r.extradata_size = c->extradata ? c->extradata_size : 0;
+        fwrite(&r, sizeof(r), 1, f);
+    }
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVCodecContext *c = ic->streams[i]->codec;
+        if (c->extradata && c->extradata_size > 0)
+            fwrite(c->extradata, 1, c->extradata_size, f);
+    }
+
+    if (ferror(f))
+        ret = AVERROR(EIO);
+    if (fclose(f) || ret < 0 || rename(tmp_path, path) < 0) {
+        ret = ret < 0 ? ret : AVERROR(errno);
+        unlink(tmp_path);
+    }
+
+    end:
+    av_free(tmp_path);
+    av_free(path);
+    return ret;
+}
+
+}
@@ -0,0 +1,24 @@
+#ifndef MYPLAYER_STREAMINFOCACHE_H
+#define MYPLAYER_STREAMINFOCACHE_H
+
+extern "C" {
+#include "libavformat/avformat.h"
+}
+
+#define STREAM_INFO_MAGIC MKTAG('M', 'P', 'S', 'I')
+#define STREAM_INFO_VERSION 1
+
+namespace ffplayer {
+
+/* what avformat_find_stream_info found for a file, kept in a cache directory
+ * so that the next open of the same file can skip the probing */
+
+/* restore the stream info of filename into ic, just opened. Return 1 if it
+ * was restored, 0 if it is not cached or the file or its streams changed. */
+int stream_info_cache_load(const char *dir, const char *filename, AVFormatContext *ic);
+
+int stream_info_cache_save(const char *dir, const char *filename, AVFormatContext *ic);
+
+}
+
+#endif //MYPLAYER_STREAMINFOCACHE_H
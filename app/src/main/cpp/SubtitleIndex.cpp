@@ -0,0 +1,259 @@
+#include "SubtitleIndex.h"
+
+extern "C" {
+#include "libavutil/common.h"
+#include "libavutil/time.h"
+}
+
+#include <math.h>
+#include <string.h>
+
+namespace ffplayer {
+
+static void subtitle_tracks_free(SubtitleTrack *tracks, int nb_tracks, MemoryAccount *mem) {
+    int i, j;
+    for (i = 0; i < nb_tracks; i++) {
+        for (j = 0; j < tracks[i].nb_events; j++) {
+            memory_account_add(mem, MEMORY_SUBTITLE_INDEX, -tracks[i].events[j].pkt.size);
+            av_free_packet(&tracks[i].events[j].pkt);
+        }
+        av_free(tracks[i].events);
+        av_free(tracks[i].max_end);
+        avcodec_free_context(&tracks[i].avctx);
+    }
+    av_free(tracks);
+}
+
+/* the times of sub, decoded from pkt which is kept instead of it. Events come
+ * almost in order, so they are kept sorted by moving the few late ones back. */
+static int subtitle_track_add(SubtitleTrack *t, const AVSubtitle *sub, AVPacket *pkt,
+                              double pts, MemoryAccount *mem) {
+    SubtitleEvent *ev;
+    int i;
+
+    if (t->nb_events == t->events_size) {
+        int size = FFMAX(t->events_size * 2, 64);
+        void *events = av_realloc_array(t->events, size, sizeof(*t->events));
+        if (!events)
+            return AVERROR(ENOMEM);
+        t->events = (SubtitleEvent *) events;
+        t->events_size = size;
+    }
+
+    ev = &t->events[t->nb_events];
+    if (av_packet_ref(&ev->pkt, pkt) < 0)
+        return AVERROR(ENOMEM);
+    memory_account_add(mem, MEMORY_SUBTITLE_INDEX, ev->pkt.size);
+    ev->start = pts + sub->start_display_time / 1000.0;
+    /* bitmap decoders leave the end open until the next event */
+    ev->end = !sub->end_display_time || sub->end_display_time == UINT32_MAX ?
+              INFINITY : pts + sub->end_display_time / 1000.0;
+    ev->format = sub->format;
+
+    for (i = t->nb_events; i > 0 && t->events[i - 1].start > t->events[i].start; i--)
+        FFSWAP(SubtitleEvent, t->events[i - 1], t->events[i]);
+    t->nb_events++;
+    return 0;
+}
+
+static int subtitle_track_finish(SubtitleTrack *t) {
+    int i;
+
+    if (!t->nb_events)
+        return 0;
+    /* a bitmap event is replaced by the next one, empty events included, and
+     * an open-ended one of any kind ends there too, so that max_end stays
+     * finite and lookups go back only over the events that overlap */
+    for (i = 0; i + 1 < t->nb_events; i++)
+        if (t->events[i].format == 0 || isinf(t->events[i].end))
+            t->events[i].end = FFMIN(t->events[i].end, t->events[i + 1].start);
+
+    if (!(t->max_end = (double *) av_malloc_array(t->nb_events, sizeof(*t->max_end))))
+        return AVERROR(ENOMEM);
+    t->max_end[0] = t->events[0].end;
+    for (i = 1; i < t->nb_events; i++)
+        t->max_end[i] = FFMAX(t->max_end[i - 1], t->events[i].end);
+    return 0;
+}
+
+static int subtitle_index_interrupt(void *arg) {
+    SubtitleIndex *x = (SubtitleIndex *) arg;
+    return x->abort_request;
+}
+
+static void *subtitle_index_thread(void *arg) {
+    SubtitleIndex *x = (SubtitleIndex *) arg;
+    AVFormatContext *ic = NULL;
+    SubtitleTrack *tracks = NULL;
+    int *track_of = NULL;
+    int64_t start_time = av_gettime_relative();
+    int nb_tracks = 0, nb_events = 0, got_subtitle, i;
+    AVSubtitle sub;
+    AVPacket pkt;
+
+    if (!(ic = avformat_alloc_context()))
+        return NULL;
+    ic->interrupt_callback.callback = subtitle_index_interrupt;
+    ic->interrupt_callback.opaque = x;
+    if (avformat_open_input(&ic, x->filename, NULL, NULL) < 0
+        || avformat_find_stream_info(ic, NULL) < 0)
+        goto end;
+
+    track_of = (int *) av_malloc_array(ic->nb_streams, sizeof(*track_of));
+    tracks = (SubtitleTrack *) av_mallocz_array(ic->nb_streams, sizeof(*tracks));
+    if (!track_of || !tracks)
+        goto end;
+
+    for (i = 0; i < (int) ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        AVCodec *dec;
+        AVCodecContext *c;
+
+        track_of[i] = -1;
+        st->discard = AVDISCARD_ALL;
+        if (st->codec->codec_type != AVMEDIA_TYPE_SUBTITLE
+            || !(dec = avcodec_find_decoder(st->codec->codec_id))
+            || !(c = avcodec_alloc_context3(dec)))
+            continue;
+        if (avcodec_copy_context(c, st->codec) < 0) {
+            avcodec_free_context(&c);
+            continue;
+        }
+        av_codec_set_pkt_timebase(c, st->time_base);
+        if (avcodec_open2(c, dec, NULL) < 0) {
+            avcodec_free_context(&c);
+            continue;
+        }
+        st->discard = AVDISCARD_DEFAULT;
+        track_of[i] = nb_tracks;
+        tracks[nb_tracks].avctx = c;
+        tracks[nb_tracks].stream_index = i;
+        tracks[nb_tracks].width = c->width;
+        tracks[nb_tracks].height = c->height;
+        nb_tracks++;
+    }
+    if (!nb_tracks)
+        goto end;
+
+    while (!x->abort_request && av_read_frame(ic, &pkt) >= 0) {
+        AVStream *st = ic->streams[pkt.stream_index];
+        SubtitleTrack *t = track_of[pkt.stream_index] >= 0 ? &tracks[track_of[pkt.stream_index]] : NULL;
+
+        got_subtitle = 0;
+        /* decoded for the times only, the packet is decoded again when shown */
+        if (t && avcodec_decode_subtitle2(t->avctx, &sub, &got_subtitle, &pkt) >= 0
+            && got_subtitle) {
+            double pts = sub.pts != AV_NOPTS_VALUE ? sub.pts / (double) AV_TIME_BASE :
+                         pkt.pts != AV_NOPTS_VALUE ? pkt.pts * av_q2d(st->time_base) : NAN;
+            if (!isnan(pts) && subtitle_track_add(t, &sub, &pkt, pts, x->mem) >= 0)
+                nb_events++;
+            avsubtitle_free(&sub);
+        }
+        av_free_packet(&pkt);
+    }
+    if (x->abort_request)
+        goto end;
+
+    for (i = 0; i < nb_tracks; i++)
+        if (subtitle_track_finish(&tracks[i]) < 0)
+            goto end;
+
+    av_log(NULL, AV_LOG_INFO, "%s: indexed %d subtitle events of %d tracks in %.3fs\n",
+           x->filename, nb_events, nb_tracks,
+           (av_gettime_relative() - start_time) / 1000000.0);
+    pthread_mutex_lock(&x->mutex);
+    x->tracks = tracks;
+    x->nb_tracks = nb_tracks;
+    x->ready = 1;
+    pthread_mutex_unlock(&x->mutex);
+    tracks = NULL;
+
+    end:
+    if (tracks)
+        subtitle_tracks_free(tracks, nb_tracks, x->mem);
+    av_free(track_of);
+    avformat_close_input(&ic);
+    return NULL;
+}
+
+int subtitle_index_open(SubtitleIndex *x, const char *filename, MemoryAccount *mem) {
+    memset(x, 0, sizeof(*x));
+    x->mem = mem;
+    if (!(x->filename = av_strdup(filename)))
+        return AVERROR(ENOMEM);
+    pthread_mutex_init(&x->mutex, NULL);
+    if (pthread_create(&x->tid, NULL, subtitle_index_thread, x)) {
+        pthread_mutex_destroy(&x->mutex);
+        av_freep(&x->filename);
+        return AVERROR(ENOMEM);
+    }
+    pthread_setname_np(x->tid, "subtitle_index");
+    x->started = 1;
+    return 0;
+}
+
+void subtitle_index_close(SubtitleIndex *x) {
+    if (!x->started)
+        return;
+    x->abort_request = 1;
+    pthread_join(x->tid, NULL);
+    subtitle_tracks_free(x->tracks, x->nb_tracks, x->mem);
+    pthread_mutex_destroy(&x->mutex);
+    av_free(x->filename);
+    memset(x, 0, sizeof(*x));
+}
+
+SubtitleTrack *subtitle_index_track(SubtitleIndex *x, int stream_index) {
+    SubtitleTrack *t = NULL;
+    int i, ready;
+
+    if (!x->started)
+        return NULL;
+    pthread_mutex_lock(&x->mutex);
+    ready = x->ready;
+    pthread_mutex_unlock(&x->mutex);
+    if (!ready)
+        return NULL;
+    for (i = 0; i < x->nb_tracks; i++)
+        if (x->tracks[i].stream_index == stream_index)
+            t = &x->tracks[i];
+    return t;
+}
+
+SubtitleEvent *subtitle_track_find(SubtitleTrack *t, double pts) {
+    int lo = 0, hi = t->nb_events - 1, i = -1;
+
+    /* the last event starting at pts or before */
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (t->events[mid].start <= pts) {
+            i = mid;
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    /* going back only while an earlier event can still be shown */
+    for (; i >= 0 && t->max_end[i] > pts; i--)
+        if (t->events[i].end > pts)
+            return &t->events[i];
+    return NULL;
+}
+
+int subtitle_track_decode(SubtitleTrack *t, SubtitleEvent *ev, AVSubtitle *sub) {
+    AVPacket pkt = ev->pkt;
+    int got_subtitle = 0, ret;
+
+    /* text and DVD subtitles need nothing but their packet; a PGS or DVB set
+     * that reuses the objects of an earlier one may come out incomplete */
+    if ((ret = avcodec_decode_subtitle2(t->avctx, sub, &got_subtitle, &pkt)) < 0
+        || !got_subtitle) {
+        if (got_subtitle)
+            avsubtitle_free(sub);
+        memset(sub, 0, sizeof(*sub));
+        return ret < 0 ? ret : AVERROR_INVALIDDATA;
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,65 @@
+#ifndef MYPLAYER_SUBTITLEINDEX_H
+#define MYPLAYER_SUBTITLEINDEX_H
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+}
+
+#include <pthread.h>
+
+#include "MemoryAccount.h"
+
+namespace ffplayer {
+
+typedef struct SubtitleEvent {
+    double start;       // seconds, stream time
+    double end;
+    int format;         // of the decoded subtitle, 0 for bitmaps
+    AVPacket pkt;       // decoded again when shown, the rects are not kept
+} SubtitleEvent;
+
+typedef struct SubtitleTrack {
+    int stream_index;
+    int width;          // canvas of the bitmap rects, 0 if unknown
+    int height;
+    AVCodecContext *avctx; // decodes the events when they are shown
+    SubtitleEvent *events; // sorted by start
+    double *max_end;    // max_end[i]: latest end of events[0..i]
+    int nb_events;
+    int events_size;
+} SubtitleTrack;
+
+/* when every subtitle event of every subtitle track of a file is shown,
+ * found ahead of time on its own demuxer and thread */
+typedef struct SubtitleIndex {
+    char *filename;
+    SubtitleTrack *tracks;
+    int nb_tracks;
+    int ready;          // tracks can be looked up
+    MemoryAccount *mem;
+    int abort_request;
+    int started;
+
+    pthread_t tid;
+    pthread_mutex_t mutex;
+} SubtitleIndex;
+
+/* start indexing filename in the background */
+int subtitle_index_open(SubtitleIndex *x, const char *filename, MemoryAccount *mem);
+
+void subtitle_index_close(SubtitleIndex *x);
+
+/* the indexed track of stream_index, NULL while the index is not complete */
+SubtitleTrack *subtitle_index_track(SubtitleIndex *x, int stream_index);
+
+/* the event shown at pts, the latest starting one if several are, or NULL */
+SubtitleEvent *subtitle_track_find(SubtitleTrack *t, double pts);
+
+/* decode ev into sub, which is left empty on error; from the thread that
+ * shows the track only */
+int subtitle_track_decode(SubtitleTrack *t, SubtitleEvent *ev, AVSubtitle *sub);
+
+}
+
+#endif //MYPLAYER_SUBTITLEINDEX_H
@@ -0,0 +1,233 @@
+#include "SubtitleOverlay.h"
+
+extern "C" {
+#include "libavutil/common.h"
+#include "libavutil/mem.h"
+}
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HAVE_BLEND_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_BLEND_SSE2 1
+#endif
+
+namespace ffplayer {
+
+/* x * y / 255, rounded */
+static inline int mul_div255(int x, int y) {
+    int t = x * y + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+#if HAVE_BLEND_SSE2
+/* two pixels widened to 16 bits: dst * (255 - src alpha) / 255 */
+static inline __m128i blend_half_sse2(__m128i s, __m128i d) {
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+    __m128i t = _mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(255), a));
+    t = _mm_add_epi16(t, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+#endif
+
+/* premultiplied src over dst, w RGBA pixels */
+static void blend_row(uint8_t *dst, const uint8_t *src, int w) {
+    int i = 0;
+
+#if HAVE_BLEND_NEON
+    for (; i + 8 <= w; i += 8) {
+        uint8x8x4_t s = vld4_u8(src + i * 4);
+        uint8x8x4_t d = vld4_u8(dst + i * 4);
+        uint8x8_t inv = vmvn_u8(s.val[3]);
+        int c;
+        for (c = 0; c < 4; c++) {
+            uint16x8_t t = vmull_u8(d.val[c], inv);
+            d.val[c] = vqadd_u8(s.val[c], vraddhn_u16(t, vrshrq_n_u16(t, 8)));
+        }
+        vst4_u8(dst + i * 4, d);
+    }
+#elif HAVE_BLEND_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 4 <= w; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i *) (src + i * 4));
+        __m128i d = _mm_loadu_si128((const __m128i *) (dst + i * 4));
+        __m128i lo = blend_half_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i hi = blend_half_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i *) (dst + i * 4), _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+#endif
+    for (; i < w; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t *d = dst + i * 4;
+        int inv = 255 - s[3];
+        int c;
+        if (!s[3])
+            continue;
+        for (c = 0; c < 4; c++)
+            d[c] = FFMIN(s[c] + mul_div255(d[c], inv), 255);
+    }
+}
+
+/* scaling a premultiplied palette keeps the edges of the glyphs clean */
+static void premultiply_palette(uint32_t *dst, const uint32_t *src) {
+    int i;
+    for (i = 0; i < AVPALETTE_COUNT; i++) {
+        uint32_t p = src[i];
+        int a = p >> 24;
+        dst[i] = (uint32_t) a << 24
+                 | mul_div255((p >> 16) & 0xff, a) << 16
+                 | mul_div255((p >> 8) & 0xff, a) << 8
+                 | mul_div255(p & 0xff, a);
+    }
+}
+
+void subtitle_scalers_init(SubtitleScalers *s, int sws_flags) {
+    memset(s, 0, sizeof(*s));
+    s->sws_flags = sws_flags;
+}
+
+void subtitle_scalers_free(SubtitleScalers *s) {
+    int i;
+    for (i = 0; i < SUBTITLE_SCALERS; i++)
+        sws_freeContext(s->scalers[i].ctx);
+    subtitle_scalers_init(s, s->sws_flags);
+}
+
+/* the scaler for these sizes, replacing the least recently used one */
+static struct SwsContext *subtitle_scaler_get(SubtitleScalers *s, int in_w, int in_h,
+                                              int out_w, int out_h) {
+    SubtitleScaler *sc = &s->scalers[0];
+    int i;
+
+    for (i = 0; i < SUBTITLE_SCALERS; i++) {
+        SubtitleScaler *c = &s->scalers[i];
+        if (c->ctx && c->in_w == in_w && c->in_h == in_h
+            && c->out_w == out_w && c->out_h == out_h) {
+            c->last_used = ++s->clock;
+            return c->ctx;
+        }
+        if (!c->ctx || (sc->ctx && c->last_used < sc->last_used))
+            sc = c;
+    }
+
+    sws_freeContext(sc->ctx);
+    sc->ctx = sws_getContext(in_w, in_h, AV_PIX_FMT_PAL8, out_w, out_h, AV_PIX_FMT_RGBA,
+                             s->sws_flags, NULL, NULL, NULL);
+    sc->in_w = in_w;
+    sc->in_h = in_h;
+    sc->out_w = out_w;
+    sc->out_h = out_h;
+    sc->last_used = ++s->clock;
+    return sc->ctx;
+}
+
+/* where a subtitle rect lands in the picture */
+typedef struct RectPlacement {
+    int x, y;           // may be outside the picture
+    int out_w, out_h;   // scaled size
+    int x0, y0, x1, y1; // visible part
+    int linesize;
+} RectPlacement;
+
+static int rect_place(RectPlacement *p, const AVSubtitleRect *sr,
+                      int sub_width, int sub_height, int width, int height) {
+    if (sr->type != SUBTITLE_BITMAP || !sr->pict.data[0] || !sr->pict.data[1]
+        || sr->w <= 0 || sr->h <= 0)
+        return 0;
+    p->x = (int) ((int64_t) sr->x * width / sub_width);
+    p->y = (int) ((int64_t) sr->y * height / sub_height);
+    p->out_w = FFMAX((int) ((int64_t) sr->w * width / sub_width), 1);
+    p->out_h = FFMAX((int) ((int64_t) sr->h * height / sub_height), 1);
+    p->x0 = av_clip(p->x, 0, width);
+    p->y0 = av_clip(p->y, 0, height);
+    p->x1 = av_clip(p->x + p->out_w, 0, width);
+    p->y1 = av_clip(p->y + p->out_h, 0, height);
+    p->linesize = FFALIGN(p->out_w * 4, 32);
+    return p->x1 > p->x0 && p->y1 > p->y0;
+}
+
+static int overlay_rect_build(SubtitleOverlayRect *r, const AVSubtitleRect *sr,
+                              const RectPlacement *p, uint8_t *buf,
+                              SubtitleScalers *scalers) {
+    uint32_t palette[AVPALETTE_COUNT];
+    const uint8_t *src[4] = {sr->pict.data[0], (const uint8_t *) palette, NULL, NULL};
+    int src_linesize[4] = {sr->pict.linesize[0], 0, 0, 0};
+    uint8_t *dst[4] = {buf, NULL, NULL, NULL};
+    int dst_linesize[4] = {p->linesize, 0, 0, 0};
+    struct SwsContext *ctx;
+
+    if (!(ctx = subtitle_scaler_get(scalers, sr->w, sr->h, p->out_w, p->out_h)))
+        return AVERROR(EINVAL);
+    premultiply_palette(palette, (const uint32_t *) sr->pict.data[1]);
+    sws_scale(ctx, src, src_linesize, 0, sr->h, dst, dst_linesize);
+
+    /* keep only the part inside the picture */
+    r->x = p->x0;
+    r->y = p->y0;
+    r->w = p->x1 - p->x0;
+    r->h = p->y1 - p->y0;
+    r->linesize = p->linesize;
+    r->data = buf + (p->y0 - p->y) * p->linesize + (p->x0 - p->x) * 4;
+    return 0;
+}
+
+int subtitle_overlay_build(SubtitleOverlay *o, const AVSubtitle *sub,
+                           int sub_width, int sub_height, int width, int height,
+                           SubtitleScalers *scalers) {
+    RectPlacement p;
+    size_t rects_size, size;
+    uint8_t *buf;
+    unsigned i;
+
+    subtitle_overlay_free(o);
+    o->width = width;
+    o->height = height;
+    if (!sub->num_rects || sub_width <= 0 || sub_height <= 0)
+        return 0;
+
+    /* size everything first so that the event needs a single allocation */
+    rects_size = FFALIGN(sub->num_rects * sizeof(*o->rects), 32);
+    size = rects_size;
+    for (i = 0; i < sub->num_rects; i++)
+        if (rect_place(&p, sub->rects[i], sub_width, sub_height, width, height))
+            size += (size_t) p.linesize * p.out_h;
+    if (size == rects_size)
+        return 0;
+    if (!(o->arena = (uint8_t *) av_malloc(size)))
+        return AVERROR(ENOMEM);
+    o->size = size;
+    o->rects = (SubtitleOverlayRect *) o->arena;
+
+    buf = o->arena + rects_size;
+    for (i = 0; i < sub->num_rects; i++) {
+        const AVSubtitleRect *sr = sub->rects[i];
+        if (!rect_place(&p, sr, sub_width, sub_height, width, height))
+            continue;
+        if (overlay_rect_build(&o->rects[o->nb_rects], sr, &p, buf, scalers) < 0)
+            av_log(NULL, AV_LOG_ERROR, "Cannot convert the subtitle rect %d\n", i);
+        else
+            o->nb_rects++;
+        buf += (size_t) p.linesize * p.out_h;
+    }
+    return 0;
+}
+
+void subtitle_overlay_blend(const SubtitleOverlay *o, uint8_t *dst, int dst_linesize) {
+    int i, y;
+    for (i = 0; i < o->nb_rects; i++) {
+        const SubtitleOverlayRect *r = &o->rects[i];
+        uint8_t *d = dst + r->y * dst_linesize + r->x * 4;
+        for (y = 0; y < r->h; y++)
+            blend_row(d + y * dst_linesize, r->data + y * r->linesize, r->w);
+    }
+}
+
+void subtitle_overlay_free(SubtitleOverlay *o) {
+    av_freep(&o->arena);
+    memset(o, 0, sizeof(*o));
+}
+
+}
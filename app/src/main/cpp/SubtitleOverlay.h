@@ -0,0 +1,67 @@
+#ifndef MYPLAYER_SUBTITLEOVERLAY_H
+#define MYPLAYER_SUBTITLEOVERLAY_H
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libswscale/swscale.h"
+}
+
+/* scalers kept for the rect sizes of a subtitle stream */
+#define SUBTITLE_SCALERS 8
+
+namespace ffplayer {
+
+typedef struct SubtitleScaler {
+    struct SwsContext *ctx;
+    int in_w;
+    int in_h;
+    int out_w;
+    int out_h;
+    unsigned last_used;
+} SubtitleScaler;
+
+/* one scaler per input and output size instead of reinitializing a single one
+ * for every rect of a different size */
+typedef struct SubtitleScalers {
+    SubtitleScaler scalers[SUBTITLE_SCALERS];
+    unsigned clock;
+    int sws_flags;
+} SubtitleScalers;
+
+typedef struct SubtitleOverlayRect {
+    int x;              // position in the picture, clipped to it
+    int y;
+    int w;
+    int h;
+    int linesize;
+    uint8_t *data;      // premultiplied RGBA, first visible pixel
+} SubtitleOverlayRect;
+
+/* the bitmap rects of one subtitle event, converted for one picture size */
+typedef struct SubtitleOverlay {
+    int width;          // 0 while not built
+    int height;
+    int nb_rects;
+    SubtitleOverlayRect *rects;
+    uint8_t *arena;     // the rects and all their pixels, in one block
+    size_t size;        // of the arena
+} SubtitleOverlay;
+
+void subtitle_scalers_init(SubtitleScalers *s, int sws_flags);
+
+void subtitle_scalers_free(SubtitleScalers *s);
+
+/* convert the bitmap rects of sub, laid out on a sub_width x sub_height canvas,
+ * for a width x height RGBA picture. Text rects are left out. */
+int subtitle_overlay_build(SubtitleOverlay *o, const AVSubtitle *sub,
+                           int sub_width, int sub_height, int width, int height,
+                           SubtitleScalers *scalers);
+
+/* blend the overlay over a RGBA picture of the size it was built for */
+void subtitle_overlay_blend(const SubtitleOverlay *o, uint8_t *dst, int dst_linesize);
+
+void subtitle_overlay_free(SubtitleOverlay *o);
+
+}
+
+#endif //MYPLAYER_SUBTITLEOVERLAY_H
@@ -0,0 +1,292 @@
+#include "ThumbnailExtractor.h"
+#include "FFPlayer.h"
+
+extern "C" {
+#include "libavutil/common.h"
+#include "libavutil/imgutils.h"
+}
+
+#include <string.h>
+
+/* give up on a bucket after this many packets without a usable keyframe */
+#define THUMBNAIL_MAX_PACKETS 500
+
+namespace ffplayer {
+
+static int64_t thumbnail_last_bucket(ThumbnailExtractor *t) {
+    return t->duration > 0 ? (t->duration - 1) / t->bucket_us : INT64_MAX;
+}
+
+static Thumbnail *thumbnail_cache_find(ThumbnailExtractor *t, int64_t bucket) {
+    int i;
+    for (i = 0; i < t->cache_size; i++) {
+        if (t->cache[i].bucket == bucket) {
+            t->cache[i].last_used = ++t->clock;
+            return &t->cache[i];
+        }
+    }
+    return NULL;
+}
+
+/* a free slot, or the least recently used one */
+static Thumbnail *thumbnail_cache_slot(ThumbnailExtractor *t) {
+    Thumbnail *c = &t->cache[0];
+    int i;
+
+    for (i = 0; i < t->cache_size; i++) {
+        if (t->cache[i].bucket < 0) {
+            c = &t->cache[i];
+            break;
+        }
+        if (t->cache[i].last_used < c->last_used)
+            c = &t->cache[i];
+    }
+    c->bucket = -1;
+    if (!c->data && !(c->data = (uint8_t *) av_malloc((size_t) t->width * 4 * t->height)))
+        return NULL;
+    return c;
+}
+
+/* decode the first keyframe at or before the middle of the bucket into dst */
+static int thumbnail_decode(ThumbnailExtractor *t, int64_t bucket, uint8_t *dst) {
+    AVStream *st = t->ic->streams[t->stream_index];
+    int64_t ts = bucket * t->bucket_us + t->bucket_us / 2;
+    uint8_t *data[4] = {dst, NULL, NULL, NULL};
+    int linesize[4] = {t->width * 4, 0, 0, 0};
+    int got_frame = 0, reading = 1, nb_packets = 0, ret;
+    AVPacket pkt;
+
+    if (t->ic->start_time != AV_NOPTS_VALUE)
+        ts += t->ic->start_time;
+    ts = av_rescale_q(ts, AV_TIME_BASE_Q, st->time_base);
+    if ((ret = av_seek_frame(t->ic, t->stream_index, ts, AVSEEK_FLAG_BACKWARD)) < 0)
+        return ret;
+    avcodec_flush_buffers(t->avctx);
+
+    while (!got_frame && nb_packets < THUMBNAIL_MAX_PACKETS) {
+        if (reading) {
+            if (av_read_frame(t->ic, &pkt) < 0) {
+                reading = 0;
+                continue;
+            }
+            nb_packets++;
+            /* only keyframes are decoded, the rest is not even handed to the decoder */
+            if (pkt.stream_index != t->stream_index || !(pkt.flags & AV_PKT_FLAG_KEY)) {
+                av_free_packet(&pkt);
+                continue;
+            }
+            avcodec_decode_video2(t->avctx, t->frame, &got_frame, &pkt);
+            av_free_packet(&pkt);
+        } else {
+            /* a decoder with delay gives the picture back when drained */
+            av_init_packet(&pkt);
+            pkt.data = NULL;
+            pkt.size = 0;
+            if (avcodec_decode_video2(t->avctx, t->frame, &got_frame, &pkt) < 0 || !got_frame)
+                break;
+        }
+    }
+    if (!got_frame)
+        return AVERROR(EAGAIN);
+
+    t->sws = sws_getCachedContext(t->sws, t->frame->width, t->frame->height,
+                                  AVPixelFormat(t->frame->format), t->width, t->height,
+                                  AV_PIX_FMT_RGBA, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (!t->sws) {
+        av_frame_unref(t->frame);
+        return AVERROR(EINVAL);
+    }
+    sws_scale(t->sws, (const uint8_t *const *) t->frame->data, t->frame->linesize, 0,
+              t->frame->height, data, linesize);
+    av_frame_unref(t->frame);
+    return 0;
+}
+
+/* decode into the cache, called with the mutex held */
+static Thumbnail *thumbnail_load(ThumbnailExtractor *t, int64_t bucket) {
+    Thumbnail *c;
+
+    if ((c = thumbnail_cache_find(t, bucket)))
+        return c;
+    if (!(c = thumbnail_cache_slot(t)))
+        return NULL;
+    if (thumbnail_decode(t, bucket, c->data) < 0)
+        return NULL;
+    c->bucket = bucket;
+    c->last_used = ++t->clock;
+    return c;
+}
+
+/* decodes the buckets next to the last requested one, nearest first, one at
+ * a time and none while a request waits, so that a request never waits for
+ * more than one decode: the mutex is not fair, this thread would take it back */
+static void *thumbnail_prefetch_thread(void *arg) {
+    ThumbnailExtractor *t = (ThumbnailExtractor *) arg;
+    int64_t center, bucket;
+    int d, i;
+
+    pthread_mutex_lock(&t->mutex);
+    for (; ;) {
+        while (!t->abort_request
+               && (t->prefetch_center < 0 || __atomic_load_n(&t->nb_waiting, __ATOMIC_ACQUIRE)))
+            pthread_cond_wait(&t->cond, &t->mutex);
+        if (t->abort_request)
+            break;
+
+        center = t->prefetch_center;
+        bucket = -1;
+        for (d = 1; d <= THUMBNAIL_PREFETCH && bucket < 0; d++) {
+            for (i = 0; i < 2 && bucket < 0; i++) {
+                int64_t b = i ? center - d : center + d;
+                if (b >= 0 && b <= thumbnail_last_bucket(t) && !thumbnail_cache_find(t, b))
+                    bucket = b;
+            }
+        }
+        if (bucket < 0) {
+            if (t->prefetch_center == center)
+                t->prefetch_center = -1;
+            continue;
+        }
+        /* a bucket that cannot be decoded ends the prefetching until the next request */
+        if (!thumbnail_load(t, bucket) && t->prefetch_center == center)
+            t->prefetch_center = -1;
+    }
+    pthread_mutex_unlock(&t->mutex);
+    return NULL;
+}
+
+int thumbnail_extractor_open(ThumbnailExtractor *t, const char *filename, int width,
+                             int height, int64_t bucket_us, int cache_size) {
+    AVCodec *dec = NULL;
+    AVStream *st;
+    int i, lowres = 0, ret;
+
+    memset(t, 0, sizeof(*t));
+    ffmpeg_init();
+    if (width <= 0 || bucket_us <= 0)
+        return AVERROR(EINVAL);
+
+    if ((ret = avformat_open_input(&t->ic, filename, NULL, NULL)) < 0)
+        goto fail;
+    if ((ret = avformat_find_stream_info(t->ic, NULL)) < 0)
+        goto fail;
+    if ((ret = av_find_best_stream(t->ic, AVMEDIA_TYPE_VIDEO, -1, -1, &dec, 0)) < 0)
+        goto fail;
+    t->stream_index = ret;
+    for (i = 0; i < (int) t->ic->nb_streams; i++)
+        t->ic->streams[i]->discard = i == t->stream_index ? AVDISCARD_NONKEY : AVDISCARD_ALL;
+    st = t->ic->streams[t->stream_index];
+
+    if (height <= 0) {
+        AVRational sar = av_guess_sample_aspect_ratio(t->ic, st, NULL);
+        double aspect = st->codec->height ? (double) st->codec->width / st->codec->height : 16.0 / 9;
+        if (sar.num && sar.den)
+            aspect *= av_q2d(sar);
+        height = FFMAX((int) (width / aspect) & ~1, 2);
+    }
+    t->width = width;
+    t->height = height;
+
+    if (!(t->avctx = avcodec_alloc_context3(dec))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    if ((ret = avcodec_copy_context(t->avctx, st->codec)) < 0)
+        goto fail;
+    av_codec_set_pkt_timebase(t->avctx, st->time_base);
+    /* keyframes only, as cheap as the codec allows: the picture is tiny anyway */
+    while (lowres < av_codec_get_max_lowres(dec)
+           && st->codec->width >> (lowres + 1) >= width
+           && st->codec->height >> (lowres + 1) >= height)
+        lowres++;
+    av_codec_set_lowres(t->avctx, lowres);
+    t->avctx->skip_frame = AVDISCARD_NONKEY;
+    t->avctx->skip_loop_filter = AVDISCARD_ALL;
+    t->avctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    t->avctx->thread_count = 1;
+    t->avctx->refcounted_frames = 1;
+    if ((ret = avcodec_open2(t->avctx, dec, NULL)) < 0)
+        goto fail;
+    if (!(t->frame = av_frame_alloc())) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    t->bucket_us = bucket_us;
+    t->duration = t->ic->duration;
+    t->cache_size = FFMAX(cache_size, 2 * THUMBNAIL_PREFETCH + 1);
+    if (!(t->cache = (Thumbnail *) av_mallocz_array(t->cache_size, sizeof(*t->cache)))) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (i = 0; i < t->cache_size; i++)
+        t->cache[i].bucket = -1;
+    t->prefetch_center = -1;
+
+    pthread_mutex_init(&t->mutex, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    if (pthread_create(&t->prefetch_tid, NULL, thumbnail_prefetch_thread, t)) {
+        pthread_cond_destroy(&t->cond);
+        pthread_mutex_destroy(&t->mutex);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    pthread_setname_np(t->prefetch_tid, "thumbnail");
+    return 0;
+
+    fail:
+    av_log(NULL, AV_LOG_ERROR, "%s: cannot open for thumbnails\n", filename);
+    av_freep(&t->cache);
+    av_frame_free(&t->frame);
+    avcodec_free_context(&t->avctx);
+    avformat_close_input(&t->ic);
+    return ret;
+}
+
+void thumbnail_extractor_close(ThumbnailExtractor *t) {
+    int i;
+
+    if (!t->ic)
+        return;
+    pthread_mutex_lock(&t->mutex);
+    t->abort_request = 1;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->mutex);
+    pthread_join(t->prefetch_tid, NULL);
+
+    for (i = 0; i < t->cache_size; i++)
+        av_free(t->cache[i].data);
+    av_freep(&t->cache);
+    sws_freeContext(t->sws);
+    av_frame_free(&t->frame);
+    avcodec_free_context(&t->avctx);
+    avformat_close_input(&t->ic);
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->mutex);
+}
+
+int thumbnail_extractor_get(ThumbnailExtractor *t, int64_t time_us, uint8_t *dst,
+                            int dst_linesize) {
+    int64_t bucket = av_clip64(time_us / t->bucket_us, 0, thumbnail_last_bucket(t));
+    Thumbnail *c;
+    int y;
+
+    /* counted before locking so that the prefetching stops after its decode */
+    __atomic_add_fetch(&t->nb_waiting, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&t->mutex);
+    __atomic_sub_fetch(&t->nb_waiting, 1, __ATOMIC_RELAXED);
+    if (!(c = thumbnail_load(t, bucket))) {
+        /* the prefetching may be waiting for this request to be done */
+        pthread_cond_signal(&t->cond);
+        pthread_mutex_unlock(&t->mutex);
+        return AVERROR(EAGAIN);
+    }
+    for (y = 0; y < t->height; y++)
+        memcpy(dst + y * dst_linesize, c->data + y * t->width * 4, t->width * 4);
+    t->prefetch_center = bucket;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->mutex);
+    return 0;
+}
+
+}
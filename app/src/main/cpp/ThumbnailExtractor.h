@@ -0,0 +1,61 @@
+#ifndef MYPLAYER_THUMBNAILEXTRACTOR_H
+#define MYPLAYER_THUMBNAILEXTRACTOR_H
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavformat/avformat.h"
+#include "libswscale/swscale.h"
+}
+
+#include <pthread.h>
+
+/* buckets on each side of the last requested one decoded ahead */
+#define THUMBNAIL_PREFETCH 2
+
+namespace ffplayer {
+
+typedef struct Thumbnail {
+    int64_t bucket;     // -1 if the slot is free
+    uint8_t *data;      // RGBA, width * 4 bytes per line
+    unsigned last_used;
+} Thumbnail;
+
+/* small RGBA pictures of the keyframes of a file, for a seek bar preview.
+ * It has its own demuxer and decoder so that it never disturbs playback. */
+typedef struct ThumbnailExtractor {
+    AVFormatContext *ic;
+    AVCodecContext *avctx;
+    int stream_index;
+    AVFrame *frame;
+    struct SwsContext *sws;
+    int width;
+    int height;
+    int64_t bucket_us;      // thumbnails are shared by the times of a bucket
+    int64_t duration;
+
+    Thumbnail *cache;       // LRU
+    int cache_size;
+    unsigned clock;
+
+    int64_t prefetch_center; // -1 if there is nothing to prefetch
+    int nb_waiting;         // requests waiting for the mutex, prefetching yields to them
+    int abort_request;
+    pthread_t prefetch_tid;
+    pthread_mutex_t mutex;  // the decoder and the cache
+    pthread_cond_t cond;
+} ThumbnailExtractor;
+
+/* height <= 0 keeps the aspect ratio of the video */
+int thumbnail_extractor_open(ThumbnailExtractor *t, const char *filename, int width,
+                             int height, int64_t bucket_us, int cache_size);
+
+void thumbnail_extractor_close(ThumbnailExtractor *t);
+
+/* copy the thumbnail of the bucket of time_us into dst, decoding it if it is
+ * not cached, and prefetch the buckets around it */
+int thumbnail_extractor_get(ThumbnailExtractor *t, int64_t time_us, uint8_t *dst,
+                            int dst_linesize);
+
+}
+
+#endif //MYPLAYER_THUMBNAILEXTRACTOR_H
@@ -0,0 +1,81 @@
+#include "TimeSource.h"
+
+extern "C" {
+#include "libavutil/time.h"
+}
+
+namespace ffplayer {
+
+int64_t SystemTimeSource::now() {
+    return av_gettime_relative();
+}
+
+void SystemTimeSource::sleepUntil(int64_t time) {
+    int64_t delay = time - av_gettime_relative();
+    if (delay > 0)
+        av_usleep(delay);
+}
+
+TimeSource *time_source_system() {
+    static SystemTimeSource system;
+    return &system;
+}
+
+/* starts at the time of the system so that the times look alike */
+VirtualTimeSource::VirtualTimeSource() : mNow(av_gettime_relative()), mNbJoined(0) {
+    pthread_mutex_init(&mMutex, NULL);
+    pthread_cond_init(&mCond, NULL);
+}
+
+VirtualTimeSource::~VirtualTimeSource() {
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mMutex);
+}
+
+int64_t VirtualTimeSource::now() {
+    int64_t now;
+    pthread_mutex_lock(&mMutex);
+    now = mNow;
+    pthread_mutex_unlock(&mMutex);
+    return now;
+}
+
+/* with the mutex held */
+void VirtualTimeSource::advance() {
+    if (mSleepers.empty() || (int) mSleepers.size() < mNbJoined)
+        return;
+    if (*mSleepers.begin() > mNow) {
+        mNow = *mSleepers.begin();
+        pthread_cond_broadcast(&mCond);
+    }
+}
+
+void VirtualTimeSource::sleepUntil(int64_t time) {
+    std::multiset<int64_t>::iterator sleeper;
+
+    pthread_mutex_lock(&mMutex);
+    if (time > mNow) {
+        sleeper = mSleepers.insert(time);
+        advance();
+        while (mNow < time)
+            pthread_cond_wait(&mCond, &mMutex);
+        mSleepers.erase(sleeper);
+    }
+    pthread_mutex_unlock(&mMutex);
+}
+
+void VirtualTimeSource::join() {
+    pthread_mutex_lock(&mMutex);
+    mNbJoined++;
+    pthread_mutex_unlock(&mMutex);
+}
+
+/* the others may all be sleeping already */
+void VirtualTimeSource::leave() {
+    pthread_mutex_lock(&mMutex);
+    mNbJoined--;
+    advance();
+    pthread_mutex_unlock(&mMutex);
+}
+
+}
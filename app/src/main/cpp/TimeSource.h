@@ -0,0 +1,70 @@
+#ifndef MYPLAYER_TIMESOURCE_H
+#define MYPLAYER_TIMESOURCE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <set>
+
+namespace ffplayer {
+
+/* what the players pace the output with, in microseconds like
+ * av_gettime_relative(). It is shared by a player and its sinks and must
+ * outlive them. */
+class TimeSource {
+public:
+    virtual ~TimeSource() {}
+
+    virtual int64_t now() = 0;
+
+    /* return once now() >= time */
+    virtual void sleepUntil(int64_t time) = 0;
+
+    /* a thread that paces itself with sleepUntil() from now on, until leave() */
+    virtual void join() {}
+
+    virtual void leave() {}
+};
+
+/* the monotonic clock of the system */
+class SystemTimeSource : public TimeSource {
+public:
+    int64_t now();
+
+    void sleepUntil(int64_t time);
+};
+
+/* the process-wide SystemTimeSource, the default of the players */
+TimeSource *time_source_system();
+
+/* time that only goes on once every thread that joined sleeps, and then
+ * jumps to the earliest time one of them sleeps until. A thread waiting for
+ * data rather than for time holds it, so a pipeline plays as fast as it
+ * decodes while taking the decisions it would take in real time. */
+class VirtualTimeSource : public TimeSource {
+public:
+    VirtualTimeSource();
+
+    ~VirtualTimeSource();
+
+    int64_t now();
+
+    void sleepUntil(int64_t time);
+
+    void join();
+
+    void leave();
+
+private:
+    pthread_mutex_t mMutex;
+    pthread_cond_t mCond;
+    int64_t mNow;
+    int mNbJoined;
+    std::multiset<int64_t> mSleepers; // the times the sleeping threads wait for
+
+    void advance();
+};
+
+}
+
+#endif //MYPLAYER_TIMESOURCE_H
@@ -0,0 +1,220 @@
+#include "log.h"
+#include "Trace.h"
+
+extern "C" {
+#include "libavutil/common.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+}
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ffplayer {
+
+typedef struct TraceRecord {
+    const char *name;
+    int64_t start;             // av_gettime_relative()
+    int32_t duration;          // in microseconds, -1 for an instant
+    int32_t tid;
+} TraceRecord;
+
+/* written by one thread at a time, read by trace_write while it is written */
+typedef struct TraceRing {
+    TraceRecord records[TRACE_RING_SIZE];
+    uint32_t head;             // records written so far, the last ones are kept
+    int tid;
+    char thread_name[16];
+    int in_use;                // by a living thread, the others are reused
+    struct TraceRing *next;
+} TraceRing;
+
+volatile int trace_enabled;
+
+/* the rings of all the threads that recorded something, never freed so that
+ * what a finished thread recorded is still written */
+static TraceRing *rings;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+static int64_t capture_start;
+static int64_t capture_end;    // 0 while the capture runs
+
+static void ring_release(void *arg) {
+    TraceRing *ring = (TraceRing *) arg;
+
+    pthread_mutex_lock(&rings_mutex);
+    ring->in_use = 0;
+    pthread_mutex_unlock(&rings_mutex);
+}
+
+static void ring_key_create() {
+    pthread_key_create(&ring_key, ring_release);
+}
+
+/* the ring of the calling thread, taken on its first span */
+static TraceRing *ring_get() {
+    TraceRing *ring;
+
+    pthread_once(&ring_key_once, ring_key_create);
+    if ((ring = (TraceRing *) pthread_getspecific(ring_key)))
+        return ring;
+
+    pthread_mutex_lock(&rings_mutex);
+    for (ring = rings; ring && ring->in_use; ring = ring->next);
+    if (!ring && (ring = (TraceRing *) av_mallocz(sizeof(*ring)))) {
+        ring->next = rings;
+        rings = ring;
+    }
+    if (ring) {
+        ring->in_use = 1;
+        ring->tid = (int) syscall(SYS_gettid);
+        if (prctl(PR_GET_NAME, ring->thread_name) < 0)
+            ring->thread_name[0] = 0;
+    }
+    pthread_mutex_unlock(&rings_mutex);
+    if (ring)
+        pthread_setspecific(ring_key, ring);
+    return ring;
+}
+
+static void ring_push(const char *name, int64_t start, int32_t duration) {
+    TraceRing *ring = ring_get();
+    TraceRecord *r;
+    uint32_t head;
+
+    if (!ring)
+        return;
+    head = ring->head;
+    r = &ring->records[head % TRACE_RING_SIZE];
+    r->name = name;
+    r->start = start;
+    r->duration = duration;
+    r->tid = ring->tid;
+    /* the record is complete before the reader sees it */
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int64_t trace_now() {
+    return av_gettime_relative();
+}
+
+void trace_record(const char *name, int64_t start, int64_t end) {
+    ring_push(name, start, (int32_t) FFMIN(end - start, INT32_MAX));
+}
+
+void trace_instant(const char *name) {
+    if (trace_enabled)
+        ring_push(name, trace_now(), -1);
+}
+
+void trace_start() {
+    pthread_mutex_lock(&rings_mutex);
+    capture_start = av_gettime_relative();
+    capture_end = 0;
+    trace_enabled = 1;
+    pthread_mutex_unlock(&rings_mutex);
+    ALOGI("trace: capture started");
+}
+
+void trace_stop() {
+    pthread_mutex_lock(&rings_mutex);
+    if (trace_enabled)
+        capture_end = av_gettime_relative();
+    trace_enabled = 0;
+    pthread_mutex_unlock(&rings_mutex);
+}
+
+/* the thread names only come from the kernel, keep them valid JSON */
+static void write_thread_name(FILE *out, const char *name) {
+    for (; *name; name++)
+        fputc(*name == '"' || *name == '\\' || (unsigned char) *name < 0x20 ? '_' : *name, out);
+}
+
+/* copy the records of a ring that are still there once copied, the writer
+ * goes on meanwhile. Return how many, the oldest first. */
+static int ring_snapshot(TraceRing *ring, TraceRecord *dst) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    uint32_t i, valid;
+
+    for (i = first; i != head; i++)
+        dst[i - first] = ring->records[i % TRACE_RING_SIZE];
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    /* the records written over while copying are dropped, and the one in the
+     * slot being written now, which can be torn */
+    valid = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    valid = valid >= TRACE_RING_SIZE ? valid - TRACE_RING_SIZE + 1 : 0;
+    if (valid <= first)
+        valid = first;
+    if (valid >= head)
+        return 0;
+    memmove(dst, dst + (valid - first), (head - valid) * sizeof(*dst));
+    return head - valid;
+}
+
+int trace_write_file(FILE *out) {
+    TraceRecord *records = (TraceRecord *) av_malloc(TRACE_RING_SIZE * sizeof(*records));
+    int pid = getpid(), nb_events = 0, nb, i;
+    int64_t start, end;
+    TraceRing *ring;
+
+    if (!records)
+        return AVERROR(ENOMEM);
+
+    pthread_mutex_lock(&rings_mutex);
+    start = capture_start;
+    end = capture_end ? capture_end : INT64_MAX;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (ring = rings; ring; ring = ring->next) {
+        fprintf(out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                "\"args\":{\"name\":\"", nb_events++ ? "," : "", pid, ring->tid);
+        write_thread_name(out, ring->thread_name);
+        fprintf(out, "\"}}");
+
+        nb = ring_snapshot(ring, records);
+        for (i = 0; i < nb; i++) {
+            TraceRecord *r = &records[i];
+            if (r->start < start || r->start > end)
+                continue;
+            if (r->duration < 0)
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"ffplayer\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%" PRId64 ",\"pid\":%d,\"tid\":%d}",
+                        r->name, r->start - start, pid, r->tid);
+            else
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"ffplayer\",\"ph\":\"X\","
+                        "\"ts\":%" PRId64 ",\"dur\":%d,\"pid\":%d,\"tid\":%d}",
+                        r->name, r->start - start, r->duration, pid, r->tid);
+            nb_events++;
+        }
+    }
+    pthread_mutex_unlock(&rings_mutex);
+    fprintf(out, "\n]}\n");
+    av_free(records);
+
+    ALOGI("trace: %d events written", nb_events);
+    return ferror(out) ? AVERROR(EIO) : 0;
+}
+
+int trace_write(const char *path) {
+    FILE *out = fopen(path, "w");
+    int ret;
+
+    if (!out) {
+        ret = AVERROR(errno);
+        ALOGE("trace: could not open %s", path);
+        return ret;
+    }
+    ret = trace_write_file(out);
+    if (fclose(out) && !ret)
+        ret = AVERROR(EIO);
+    return ret;
+}
+
+}
@@ -0,0 +1,74 @@
+#ifndef MYPLAYER_TRACE_H
+#define MYPLAYER_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* spans kept per thread, the oldest are overwritten */
+#define TRACE_RING_SIZE 4096
+
+namespace ffplayer {
+
+/* where the time of the pipeline goes, process wide: each thread records its
+ * spans in a ring of its own without a lock, and a capture is written as
+ * Chrome trace JSON to open in chrome://tracing or Perfetto. When no capture
+ * runs a trace point costs the test of trace_enabled. */
+
+/* set while a capture runs */
+extern volatile int trace_enabled;
+
+int64_t trace_now();
+
+/* record a span of the calling thread, name is kept as a pointer so it has to
+ * be a string literal */
+void trace_record(const char *name, int64_t start, int64_t end);
+
+/* record a point in time of the calling thread */
+void trace_instant(const char *name);
+
+/* the start of a span, 0 when no capture runs */
+static inline int64_t trace_begin() {
+    return trace_enabled ? trace_now() : 0;
+}
+
+static inline void trace_end(const char *name, int64_t start) {
+    if (start)
+        trace_record(name, start, trace_now());
+}
+
+/* a span measured with av_gettime_relative() anyway */
+static inline void trace_span(const char *name, int64_t start, int64_t end) {
+    if (trace_enabled)
+        trace_record(name, start, end);
+}
+
+/* the span from here to the end of the scope */
+class TraceScope {
+public:
+    explicit TraceScope(const char *name) : mName(name), mStart(trace_begin()) {}
+
+    ~TraceScope() { trace_end(mName, mStart); }
+
+private:
+    const char *mName;
+    int64_t mStart;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) ffplayer::TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+/* start a capture, what an earlier one recorded is not written anymore */
+void trace_start();
+
+void trace_stop();
+
+/* write the spans of the last capture, or of the running one so far, 0 or a
+ * negative AVERROR */
+int trace_write(const char *path);
+
+int trace_write_file(FILE *out);
+
+}
+
+#endif //MYPLAYER_TRACE_H
@@ -2,8 +2,12 @@
 #include <stdio.h>
 
 
+#include "AudioEngine.h"
 #include "JNIHelp.h"
 #include "FFPlayer.h"
+#include "NativeWindowSink.h"
+#include "MediaScanner.h"
+#include "ThumbnailExtractor.h"
 #include "log.h"
 #include <pthread.h>
 #include <android/native_window_jni.h>
@@ -15,12 +19,16 @@ using namespace ffplayer;
 
 struct java_fields {
     jfieldID playerReference;
+    jfieldID extractorReference;
+    jfieldID libraryReference;
 };
 
 static void setMediaPlayer(JNIEnv *pEnv, jobject pJobject, FFPlayer *pPlayer);
 
 static java_fields fields;
 static JavaField nativePlayer = {"mNativePlayer", "J"};
+static JavaField nativeExtractor = {"mNativeExtractor", "J"};
+static JavaField nativeLibrary = {"mNativeLibrary", "J"};
 
 pthread_mutex_t mJniPlayerMutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -36,6 +44,7 @@ static void nativeInit(JNIEnv *env, jclass clazz) {
 static void nativeSetup(JNIEnv *env, jobject thiz) {
     ALOGD("nativeSetup");
     FFPlayer *player = new FFPlayer();
+    player->setAudioSink(new AudioEngine());
     setMediaPlayer(env, thiz, player);
 }
 
@@ -53,11 +62,23 @@ static FFPlayer *getMediaPlayer(JNIEnv *env, jobject thiz) {
 }
 
 static void nativeStart(JNIEnv *env, jobject thiz) {
-
+    ALOGD("nativeStart");
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->start();
 }
 
 static void nativePause(JNIEnv *env, jobject thiz) {
-
+    ALOGD("nativePause");
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->pause();
 }
 
 static void nativeSetDataSource(JNIEnv *env, jobject thiz, jstring jPath) {
@@ -101,7 +122,7 @@ static void nativeSeekTo(JNIEnv *env, jobject thiz, jint msec) {
         jniThrowException(env, "java/lang/IllegalStateException", NULL);
         return;
     }
-    player->seekTo(msec);
+    player->seekTo((int64_t) msec * 1000);
     ALOGD("nativeSeekTo done");
 }
 
@@ -112,13 +133,324 @@ static void nativeSetSurface(JNIEnv *env, jobject thiz, jobject jsurface) {
         jniThrowException(env, "java/lang/IllegalStateException", NULL);
         return;
     }
+    /* the sink takes over the reference of the window */
+    ANativeWindow *window = ANativeWindow_fromSurface(env, jsurface);
+    player->setVideoSink(new NativeWindowSink(window));
+}
+
+static void nativeSetBackBuffer(JNIEnv *env, jobject thiz, jint msec, jint bytes) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setBackBuffer((int64_t) msec * 1000, bytes);
+}
+
+static void nativeStepForward(JNIEnv *env, jobject thiz) {
+    ALOGD("nativeStepForward");
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->stepForward();
+}
+
+static void nativeStepBackward(JNIEnv *env, jobject thiz) {
+    ALOGD("nativeStepBackward");
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->stepBackward();
+}
+
+static void nativeSetFrameCacheSize(JNIEnv *env, jobject thiz, jint bytes) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setFrameCacheSize(bytes);
+}
+
+static void nativeSetReversePlayback(JNIEnv *env, jobject thiz, jfloat speed) {
+    ALOGD("nativeSetReversePlayback %f", speed);
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setReversePlayback(speed);
+}
+
+static void nativeSetTrickPlay(JNIEnv *env, jobject thiz, jint speed) {
+    ALOGD("nativeSetTrickPlay %d", speed);
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setTrickPlay(speed);
+}
+
+static void nativeSetLooping(JNIEnv *env, jobject thiz, jboolean looping) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setLooping(looping);
+}
+
+static void nativeSetLoopRange(JNIEnv *env, jobject thiz, jint startMsec, jint endMsec) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setLoopRange((int64_t) startMsec * 1000, (int64_t) endMsec * 1000);
+}
+
+static void nativeSetSurfaceSize(JNIEnv *env, jobject thiz, jint width, jint height) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setSurfaceSize(width, height);
+}
+
+static void nativeCycleSubtitleTrack(JNIEnv *env, jobject thiz) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->cycleSubtitleTrack();
+}
+
+static void nativeSetStreamInfoCacheDir(JNIEnv *env, jobject thiz, jstring jDir) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    if (jDir == NULL) {
+        player->setStreamInfoCacheDir(NULL);
+        return;
+    }
+    const char *dir = env->GetStringUTFChars(jDir, NULL);
+    if (dir == NULL) // Out of memory
+        return;
+    player->setStreamInfoCacheDir(dir);
+    env->ReleaseStringUTFChars(jDir, dir);
+}
+
+static void nativeSetPreloadBudget(JNIEnv *env, jobject thiz, jint bytes) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setPreloadBudget(bytes);
+}
+
+static void nativeSetShowMode(JNIEnv *env, jobject thiz, jint mode) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setShowMode(mode);
+}
+
+static void nativeSetMemoryBudget(JNIEnv *env, jobject thiz, jlong bytes) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setMemoryBudget(bytes);
+}
+
+static void nativePromote(JNIEnv *env, jobject thiz, jobject jsurface) {
+    ALOGD("nativePromote");
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL || player->is == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
     ANativeWindow *window = ANativeWindow_fromSurface(env, jsurface);
-    ANativeWindow_acquire(window);
-    player->setWindow(window);
+    player->promote(new NativeWindowSink(window));
+}
+
+static void nativeSetFocused(JNIEnv *env, jobject thiz, jboolean focused) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setFocused(focused);
+}
+
+static void nativeSetFastStart(JNIEnv *env, jobject thiz, jboolean fastStart) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setFastStart(fastStart);
+}
+
+static jlongArray nativeGetStartupReport(JNIEnv *env, jobject thiz) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return NULL;
+    }
+    StartupReport report;
+    jlong values[STARTUP_PHASE_NB + 1];
+    int i;
+
+    player->getStartupReport(&report);
+    for (i = 0; i < STARTUP_PHASE_NB; i++)
+        values[i] = startup_report_elapsed(&report, i);
+    values[STARTUP_PHASE_NB] = report.stream_info_cached;
+
+    jlongArray array = env->NewLongArray(NELEM(values));
+    if (array == NULL)
+        return NULL;
+    env->SetLongArrayRegion(array, 0, NELEM(values), values);
+    return array;
+}
+
+static jlongArray nativeGetStats(JNIEnv *env, jobject thiz, jlongArray reuse) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return NULL;
+    }
+    PlayerStats stats;
+    jlong values[STATS_FIELD_NB];
+
+    player->getStats(&stats);
+    player_stats_pack(&stats, (int64_t *) values);
+
+    jlongArray array = reuse;
+    if (array == NULL || env->GetArrayLength(array) < STATS_FIELD_NB)
+        array = env->NewLongArray(STATS_FIELD_NB);
+    if (array == NULL)
+        return NULL;
+    env->SetLongArrayRegion(array, 0, STATS_FIELD_NB, values);
+    return array;
+}
+
+static jlongArray nativeGetMemoryReport(JNIEnv *env, jobject thiz, jlongArray reuse) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return NULL;
+    }
+    MemoryAccount report;
+    jlong values[MEMORY_REPORT_NB];
+
+    player->getMemoryReport(&report);
+    memory_account_pack(&report, (int64_t *) values);
+
+    jlongArray array = reuse;
+    if (array == NULL || env->GetArrayLength(array) < MEMORY_REPORT_NB)
+        array = env->NewLongArray(MEMORY_REPORT_NB);
+    if (array == NULL)
+        return NULL;
+    env->SetLongArrayRegion(array, 0, MEMORY_REPORT_NB, values);
+    return array;
+}
+
+static void nativeSetVisualizationRate(JNIEnv *env, jobject thiz, jint rate) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return;
+    }
+    player->setVisualizationRate(rate);
+}
+
+static jint nativeGetVisualization(JNIEnv *env, jobject thiz, jfloatArray spectrum,
+                                   jfloatArray peaks) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return 0;
+    }
+    if (spectrum == NULL || env->GetArrayLength(spectrum) < VISUALIZER_BINS
+        || peaks == NULL || env->GetArrayLength(peaks) < 2 * VISUALIZER_PEAKS) {
+        jniThrowException(env, "java/lang/IllegalArgumentException", NULL);
+        return 0;
+    }
+    VisualizerFrame frame;
+
+    player->getVisualization(&frame);
+    if (!frame.count)
+        return 0;
+    env->SetFloatArrayRegion(spectrum, 0, VISUALIZER_BINS, frame.spectrum);
+    env->SetFloatArrayRegion(peaks, 0, 2 * VISUALIZER_PEAKS, frame.peaks);
+    return frame.sample_rate;
+}
+
+static jintArray nativeGetDecodeMetrics(JNIEnv *env, jobject thiz) {
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return NULL;
+    }
+    DecodeLadderStats stats;
+    jint metrics[4 + DECODE_LEVEL_NB];
+    int i;
+
+    player->getDecodeLadderStats(&stats);
+    metrics[0] = stats.level;
+    metrics[1] = stats.nb_up;
+    metrics[2] = stats.nb_down;
+    metrics[3] = (jint) (stats.decode_load * 100);
+    for (i = 0; i < DECODE_LEVEL_NB; i++)
+        metrics[4 + i] = (jint) (stats.time_in_level[i] / 1000);
+
+    jintArray array = env->NewIntArray(NELEM(metrics));
+    if (array == NULL)
+        return NULL;
+    env->SetIntArrayRegion(array, 0, NELEM(metrics), metrics);
+    return array;
 }
 
 static jint nativeGetDuration(JNIEnv *env, jobject thiz) {
-    return 0;
+    FFPlayer *player = getMediaPlayer(env, thiz);
+    if (player == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return -1;
+    }
+    int64_t timeUs;
+    player->getDuration(&timeUs);
+    return timeUs < 0 ? -1 : (jint) (timeUs / 1000);
+}
+
+static void nativeStartTracing(JNIEnv *env, jclass clazz) {
+    trace_start();
+}
+
+static void nativeStopTracing(JNIEnv *env, jclass clazz, jstring jPath) {
+    trace_stop();
+    if (jPath == NULL)
+        return;
+    const char *path = env->GetStringUTFChars(jPath, NULL);
+    if (path == NULL) // Out of memory
+        return;
+    int ret = trace_write(path);
+    env->ReleaseStringUTFChars(jPath, path);
+    if (ret < 0)
+        jniThrowException(env, "java/io/IOException", "could not write the trace");
 }
 
 static void nativeFinalize(JNIEnv *env, jobject thiz) {
@@ -140,10 +472,209 @@ static JNINativeMethod gMethods[]{
         {"native_prepare",       "()V",                       (void *) nativePrepare},
         {"native_seekTo",        "(I)V",                      (void *) nativeSeekTo},
         {"native_setSurface",    "(Landroid/view/Surface;)V", (void *) nativeSetSurface},
+        {"native_setBackBuffer", "(II)V",                     (void *) nativeSetBackBuffer},
+        {"native_setFrameCacheSize", "(I)V",                  (void *) nativeSetFrameCacheSize},
+        {"native_stepForward",   "()V",                       (void *) nativeStepForward},
+        {"native_stepBackward",  "()V",                       (void *) nativeStepBackward},
+        {"native_setReversePlayback", "(F)V",                 (void *) nativeSetReversePlayback},
+        {"native_setTrickPlay",  "(I)V",                      (void *) nativeSetTrickPlay},
+        {"native_setLooping",    "(Z)V",                      (void *) nativeSetLooping},
+        {"native_setLoopRange",  "(II)V",                     (void *) nativeSetLoopRange},
+        {"native_setSurfaceSize", "(II)V",                    (void *) nativeSetSurfaceSize},
+        {"native_cycleSubtitleTrack", "()V",                  (void *) nativeCycleSubtitleTrack},
+        {"native_setStreamInfoCacheDir", "(Ljava/lang/String;)V", (void *) nativeSetStreamInfoCacheDir},
+        {"native_setPreloadBudget", "(I)V",                   (void *) nativeSetPreloadBudget},
+        {"native_setMemoryBudget", "(J)V",                    (void *) nativeSetMemoryBudget},
+        {"native_setShowMode",   "(I)V",                      (void *) nativeSetShowMode},
+        {"native_promote",       "(Landroid/view/Surface;)V", (void *) nativePromote},
+        {"native_setFocused",    "(Z)V",                      (void *) nativeSetFocused},
+        {"native_setFastStart",  "(Z)V",                      (void *) nativeSetFastStart},
+        {"native_getStartupReport", "()[J",                   (void *) nativeGetStartupReport},
+        {"native_getStats",      "([J)[J",                    (void *) nativeGetStats},
+        {"native_getMemoryReport", "([J)[J",                  (void *) nativeGetMemoryReport},
+        {"native_setVisualizationRate", "(I)V",               (void *) nativeSetVisualizationRate},
+        {"native_getVisualization", "([F[F)I",                (void *) nativeGetVisualization},
+        {"native_getDecodeMetrics", "()[I",                   (void *) nativeGetDecodeMetrics},
         {"native_getDuration",   "()I",                       (void *) nativeGetDuration},
+        {"native_startTracing",  "()V",                       (void *) nativeStartTracing},
+        {"native_stopTracing",   "(Ljava/lang/String;)V",     (void *) nativeStopTracing},
         {"native_finalize",      "()V",                       (void *) nativeFinalize},
 };
 
+static void nativeThumbnailInit(JNIEnv *env, jclass clazz) {
+    fields.extractorReference = env->GetFieldID(clazz, nativeExtractor.name,
+                                                nativeExtractor.signature);
+}
+
+static ThumbnailExtractor *getThumbnailExtractor(JNIEnv *env, jobject thiz) {
+    return (ThumbnailExtractor *) env->GetLongField(thiz, fields.extractorReference);
+}
+
+static void nativeThumbnailSetup(JNIEnv *env, jobject thiz, jstring jPath, jint width,
+                                 jint height, jint bucketMsec, jint cacheSize) {
+    const char *path = env->GetStringUTFChars(jPath, NULL);
+    if (path == NULL) // Out of memory
+        return;
+    ALOGD("nativeThumbnailSetup path %s", path);
+    ThumbnailExtractor *extractor = (ThumbnailExtractor *) av_mallocz(sizeof(*extractor));
+    if (extractor == NULL
+        || thumbnail_extractor_open(extractor, path, width, height,
+                                    (int64_t) bucketMsec * 1000, cacheSize) < 0) {
+        av_free(extractor);
+        env->ReleaseStringUTFChars(jPath, path);
+        jniThrowException(env, "java/io/IOException", "cannot open for thumbnails");
+        return;
+    }
+    env->ReleaseStringUTFChars(jPath, path);
+    env->SetLongField(thiz, fields.extractorReference, (jlong) extractor);
+}
+
+static jbyteArray nativeGetThumbnail(JNIEnv *env, jobject thiz, jint msec) {
+    ThumbnailExtractor *extractor = getThumbnailExtractor(env, thiz);
+    if (extractor == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return NULL;
+    }
+    int size = extractor->width * extractor->height * 4;
+    jbyteArray pixels = env->NewByteArray(size);
+    if (pixels == NULL)
+        return NULL;
+    jbyte *dst = env->GetByteArrayElements(pixels, NULL);
+    int ret = thumbnail_extractor_get(extractor, (int64_t) msec * 1000, (uint8_t *) dst,
+                                      extractor->width * 4);
+    env->ReleaseByteArrayElements(pixels, dst, 0);
+    if (ret < 0) {
+        env->DeleteLocalRef(pixels);
+        return NULL;
+    }
+    return pixels;
+}
+
+static jint nativeGetThumbnailWidth(JNIEnv *env, jobject thiz) {
+    ThumbnailExtractor *extractor = getThumbnailExtractor(env, thiz);
+    return extractor ? extractor->width : 0;
+}
+
+static jint nativeGetThumbnailHeight(JNIEnv *env, jobject thiz) {
+    ThumbnailExtractor *extractor = getThumbnailExtractor(env, thiz);
+    return extractor ? extractor->height : 0;
+}
+
+static void nativeThumbnailRelease(JNIEnv *env, jobject thiz) {
+    ThumbnailExtractor *extractor = getThumbnailExtractor(env, thiz);
+    if (extractor == NULL)
+        return;
+    env->SetLongField(thiz, fields.extractorReference, 0);
+    thumbnail_extractor_close(extractor);
+    av_free(extractor);
+}
+
+static JNINativeMethod gThumbnailMethods[]{
+        {"native_init",          "()V",                       (void *) nativeThumbnailInit},
+        {"native_setup",         "(Ljava/lang/String;IIII)V", (void *) nativeThumbnailSetup},
+        {"native_getThumbnail",  "(I)[B",                     (void *) nativeGetThumbnail},
+        {"native_getWidth",      "()I",                       (void *) nativeGetThumbnailWidth},
+        {"native_getHeight",     "()I",                       (void *) nativeGetThumbnailHeight},
+        {"native_release",       "()V",                       (void *) nativeThumbnailRelease},
+};
+
+static void nativeLibraryInit(JNIEnv *env, jclass clazz) {
+    fields.libraryReference = env->GetFieldID(clazz, nativeLibrary.name, nativeLibrary.signature);
+}
+
+static jint nativeLibraryScan(JNIEnv *env, jclass clazz, jstring jDbPath, jobjectArray jPaths,
+                              jint threads) {
+    int nb_paths = env->GetArrayLength(jPaths);
+    const char **paths = (const char **) av_mallocz_array(FFMAX(nb_paths, 1), sizeof(*paths));
+    jstring *strings = (jstring *) av_mallocz_array(FFMAX(nb_paths, 1), sizeof(*strings));
+    const char *dbPath = env->GetStringUTFChars(jDbPath, NULL);
+    int i, ret = AVERROR(ENOMEM);
+
+    if (paths && strings && dbPath) {
+        for (i = 0; i < nb_paths; i++) {
+            strings[i] = (jstring) env->GetObjectArrayElement(jPaths, i);
+            paths[i] = strings[i] ? env->GetStringUTFChars(strings[i], NULL) : "";
+        }
+        ret = media_scanner_scan(dbPath, paths, nb_paths, threads);
+        for (i = 0; i < nb_paths; i++) {
+            if (strings[i]) {
+                env->ReleaseStringUTFChars(strings[i], paths[i]);
+                env->DeleteLocalRef(strings[i]);
+            }
+        }
+    }
+    if (dbPath)
+        env->ReleaseStringUTFChars(jDbPath, dbPath);
+    av_free(strings);
+    av_free(paths);
+    if (ret < 0)
+        jniThrowException(env, "java/io/IOException", "media scan failed");
+    return ret;
+}
+
+static MediaDb *getMediaDb(JNIEnv *env, jobject thiz) {
+    return (MediaDb *) env->GetLongField(thiz, fields.libraryReference);
+}
+
+static void nativeLibrarySetup(JNIEnv *env, jobject thiz, jstring jDbPath) {
+    const char *dbPath = env->GetStringUTFChars(jDbPath, NULL);
+    if (dbPath == NULL) // Out of memory
+        return;
+    MediaDb *db = (MediaDb *) av_mallocz(sizeof(*db));
+    if (db == NULL || media_db_open(db, dbPath) < 0) {
+        av_free(db);
+        env->ReleaseStringUTFChars(jDbPath, dbPath);
+        jniThrowException(env, "java/io/IOException", "cannot open the media database");
+        return;
+    }
+    env->ReleaseStringUTFChars(jDbPath, dbPath);
+    env->SetLongField(thiz, fields.libraryReference, (jlong) db);
+}
+
+static jlongArray nativeLibraryGetInfo(JNIEnv *env, jobject thiz, jstring jPath) {
+    MediaDb *db = getMediaDb(env, thiz);
+    MediaInfo info;
+    if (db == NULL) {
+        jniThrowException(env, "java/lang/IllegalStateException", NULL);
+        return NULL;
+    }
+    const char *path = env->GetStringUTFChars(jPath, NULL);
+    if (path == NULL) // Out of memory
+        return NULL;
+    int found = media_db_find(db, path, &info);
+    env->ReleaseStringUTFChars(jPath, path);
+    if (!found || (info.flags & MEDIA_INFO_FAILED))
+        return NULL;
+
+    jlong values[] = {
+            info.duration == AV_NOPTS_VALUE ? -1 : info.duration / 1000,
+            info.width, info.height, info.bit_rate,
+            info.video_codec, info.audio_codec, info.sample_rate, info.channels,
+            info.poster_time == AV_NOPTS_VALUE ? -1 : info.poster_time / 1000,
+    };
+    jlongArray result = env->NewLongArray(NELEM(values));
+    if (result != NULL)
+        env->SetLongArrayRegion(result, 0, NELEM(values), values);
+    return result;
+}
+
+static void nativeLibraryRelease(JNIEnv *env, jobject thiz) {
+    MediaDb *db = getMediaDb(env, thiz);
+    if (db == NULL)
+        return;
+    env->SetLongField(thiz, fields.libraryReference, 0);
+    media_db_close(db);
+    av_free(db);
+}
+
+static JNINativeMethod gLibraryMethods[]{
+        {"native_init",          "()V",                       (void *) nativeLibraryInit},
+        {"native_scan",          "(Ljava/lang/String;[Ljava/lang/String;I)I", (void *) nativeLibraryScan},
+        {"native_setup",         "(Ljava/lang/String;)V",     (void *) nativeLibrarySetup},
+        {"native_getInfo",       "(Ljava/lang/String;)[J",    (void *) nativeLibraryGetInfo},
+        {"native_release",       "()V",                       (void *) nativeLibraryRelease},
+};
+
 jint JNI_OnLoad(JavaVM *vm, void *reserved) {
     JNIEnv *env;
     if (vm->GetEnv(reinterpret_cast<void **>(&env), JNI_VERSION_1_4) != JNI_OK) {
@@ -156,6 +687,18 @@ jint JNI_OnLoad(JavaVM *vm, void *reserved) {
     if ((*env).RegisterNatives(clazz, gMethods, NELEM(gMethods)) != JNI_OK) {
         return -1;
     }
+    clazz = env->FindClass("com/leon/player/ThumbnailExtractor");
+    if (clazz == NULL)
+        return -1;
+    if ((*env).RegisterNatives(clazz, gThumbnailMethods, NELEM(gThumbnailMethods)) != JNI_OK) {
+        return -1;
+    }
+    clazz = env->FindClass("com/leon/player/MediaLibrary");
+    if (clazz == NULL)
+        return -1;
+    if ((*env).RegisterNatives(clazz, gLibraryMethods, NELEM(gLibraryMethods)) != JNI_OK) {
+        return -1;
+    }
     // Get jclass with env->FindClass.
     // Register methods with env->RegisterNatives.
 
@@ -0,0 +1,287 @@
+#include "HostSinks.h"
+
+extern "C" {
+#include "libavutil/error.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+}
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+namespace ffplayer {
+
+static void md5_hex(struct AVMD5 *md5, char *hex) {
+    uint8_t digest[16];
+    int i;
+
+    av_md5_final(md5, digest);
+    for (i = 0; i < 16; i++)
+        snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+}
+
+NullVideoSink::NullVideoSink(int width, int height, SinkStats *stats)
+        : mSurfaceWidth(width), mSurfaceHeight(height), mWidth(width), mHeight(height),
+          mBuffer(NULL), mStats(stats) {
+}
+
+NullVideoSink::~NullVideoSink() {
+    av_free(mBuffer);
+}
+
+int NullVideoSink::getWidth() {
+    return mSurfaceWidth;
+}
+
+int NullVideoSink::getHeight() {
+    return mSurfaceHeight;
+}
+
+int NullVideoSink::setBuffersGeometry(int width, int height) {
+    if (width != mWidth || height != mHeight)
+        av_freep(&mBuffer);
+    mWidth = width;
+    mHeight = height;
+    return 0;
+}
+
+int NullVideoSink::lock(VideoSinkBuffer *buffer) {
+    if (!mBuffer && !(mBuffer = (uint8_t *) av_malloc((size_t) mWidth * mHeight * 4)))
+        return AVERROR(ENOMEM);
+    buffer->bits = mBuffer;
+    buffer->stride = mWidth * 4;
+    buffer->width = mWidth;
+    buffer->height = mHeight;
+    return 0;
+}
+
+void NullVideoSink::unlockAndPost(double pts) {
+    if (mStats) {
+        mStats->frames++;
+        mStats->bytes += (int64_t) mWidth * mHeight * 4;
+    }
+    post(mBuffer, mWidth * 4, mWidth, mHeight, pts);
+}
+
+HashVideoSink::HashVideoSink(int width, int height, FILE *out, SinkStats *stats)
+        : NullVideoSink(width, height, stats), mOut(out), mIndex(0),
+          mFrameMd5(av_md5_alloc()), mTotalMd5(av_md5_alloc()) {
+    if (mTotalMd5)
+        av_md5_init(mTotalMd5);
+}
+
+HashVideoSink::~HashVideoSink() {
+    if (mStats && mTotalMd5)
+        md5_hex(mTotalMd5, mStats->md5);
+    if (mOut)
+        fflush(mOut);
+    av_free(mFrameMd5);
+    av_free(mTotalMd5);
+}
+
+void HashVideoSink::post(const uint8_t *rgba, int stride, int width, int height, double pts) {
+    char hex[33];
+    int y;
+
+    if (!mFrameMd5 || !mTotalMd5)
+        return;
+    av_md5_init(mFrameMd5);
+    for (y = 0; y < height; y++) {
+        av_md5_update(mFrameMd5, rgba + y * stride, width * 4);
+        av_md5_update(mTotalMd5, rgba + y * stride, width * 4);
+    }
+    md5_hex(mFrameMd5, hex);
+    if (mOut)
+        fprintf(mOut, "%" PRId64 ", %.6f, %dx%d, %s\n", mIndex, pts, width, height, hex);
+    mIndex++;
+}
+
+Y4mVideoSink::Y4mVideoSink(int width, int height, FILE *out, AVRational rate, SinkStats *stats)
+        : NullVideoSink(width, height, stats), mOut(out), mRate(rate), mOutWidth(0),
+          mOutHeight(0), mConvertCtx(NULL) {
+    memset(mPlanes, 0, sizeof(mPlanes));
+    memset(mLinesizes, 0, sizeof(mLinesizes));
+}
+
+Y4mVideoSink::~Y4mVideoSink() {
+    fflush(mOut);
+    av_freep(&mPlanes[0]);
+    sws_freeContext(mConvertCtx);
+}
+
+void Y4mVideoSink::post(const uint8_t *rgba, int stride, int width, int height, double pts) {
+    int chroma_width, chroma_height, y;
+
+    /* a Y4M stream has one size, later pictures of another are scaled to it */
+    if (!mOutWidth) {
+        if (av_image_alloc(mPlanes, mLinesizes, width, height, AV_PIX_FMT_YUV420P, 16) < 0)
+            return;
+        mOutWidth = width;
+        mOutHeight = height;
+        fprintf(mOut, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C420jpeg XYSCSS=420JPEG\n",
+                mOutWidth, mOutHeight, mRate.num, mRate.den);
+    }
+    mConvertCtx = sws_getCachedContext(mConvertCtx, width, height, AV_PIX_FMT_RGBA,
+                                       mOutWidth, mOutHeight, AV_PIX_FMT_YUV420P,
+                                       SWS_BICUBIC, NULL, NULL, NULL);
+    if (!mConvertCtx)
+        return;
+    sws_scale(mConvertCtx, &rgba, &stride, 0, height, mPlanes, mLinesizes);
+
+    chroma_width = (mOutWidth + 1) >> 1;
+    chroma_height = (mOutHeight + 1) >> 1;
+    fputs("FRAME\n", mOut);
+    for (y = 0; y < mOutHeight; y++)
+        fwrite(mPlanes[0] + y * mLinesizes[0], 1, mOutWidth, mOut);
+    for (y = 0; y < chroma_height; y++)
+        fwrite(mPlanes[1] + y * mLinesizes[1], 1, chroma_width, mOut);
+    for (y = 0; y < chroma_height; y++)
+        fwrite(mPlanes[2] + y * mLinesizes[2], 1, chroma_width, mOut);
+}
+
+NullAudioSink::NullAudioSink(TimeSource *timeSource, SinkStats *stats)
+        : mSampleRate(0), mChannels(0), mStats(stats), mTimeSource(timeSource), mStopping(0),
+          mRunning(0), mBuffer(NULL), mBufferSize(0), mUserData(NULL), mCallback(NULL) {
+}
+
+NullAudioSink::~NullAudioSink() {
+    close();
+}
+
+void NullAudioSink::open(int sampleRate, unsigned int channels, void *userData,
+                         AudioSinkCallback callback) {
+    mSampleRate = sampleRate;
+    mChannels = channels;
+    mUserData = userData;
+    mCallback = callback;
+    mBufferSize = HOST_AUDIO_BUFFER_SAMPLES * channels * 2;
+    av_freep(&mBuffer);
+    mBuffer = (uint8_t *) av_malloc(mBufferSize);
+}
+
+void NullAudioSink::start() {
+    if (mRunning || !mBuffer)
+        return;
+    mStopping = 0;
+    /* here rather than on the thread, virtual time must not go on without it */
+    mTimeSource->join();
+    if (!pthread_create(&mThread, NULL, pullThread, this)) {
+        pthread_setname_np(mThread, "audio_sink");
+        mRunning = 1;
+    } else {
+        mTimeSource->leave();
+    }
+}
+
+void NullAudioSink::close() {
+    mStopping = 1;
+    if (mRunning) {
+        /* leaving wakes it up if it sleeps until a time no one else lets come */
+        mTimeSource->leave();
+        pthread_join(mThread, NULL);
+        mRunning = 0;
+    }
+    av_freep(&mBuffer);
+    mCallback = NULL;
+    mUserData = NULL;
+}
+
+/* like an audio device with one buffer of latency */
+void *NullAudioSink::pullThread(void *arg) {
+    NullAudioSink *sink = (NullAudioSink *) arg;
+    TimeSource *time_source = sink->mTimeSource;
+    int64_t start_time = time_source->now();
+    int64_t pulled = 0;
+
+    while (!sink->mStopping) {
+        if (sink->mCallback(sink->mUserData, sink->mBuffer, sink->mBufferSize) > 0) {
+            sink->write(sink->mBuffer, sink->mBufferSize);
+            if (sink->mStats) {
+                sink->mStats->frames += HOST_AUDIO_BUFFER_SAMPLES;
+                sink->mStats->bytes += sink->mBufferSize;
+            }
+        }
+        pulled += HOST_AUDIO_BUFFER_SAMPLES;
+        time_source->sleepUntil(start_time + pulled * 1000000 / sink->mSampleRate);
+    }
+    return NULL;
+}
+
+static void wav_put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void wav_put_le16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+WavAudioSink::WavAudioSink(TimeSource *timeSource, FILE *out, SinkStats *stats)
+        : NullAudioSink(timeSource, stats), mOut(out), mDataSize(0), mHeaderWritten(0) {
+}
+
+WavAudioSink::~WavAudioSink() {
+    uint8_t size[4];
+
+    /* the pull thread calls write() */
+    close();
+    /* the sizes are only known now, a pipe keeps the placeholders */
+    if (mHeaderWritten && !fseek(mOut, 4, SEEK_SET)) {
+        wav_put_le32(size, (uint32_t) FFMIN(mDataSize + 36, UINT32_MAX));
+        fwrite(size, 1, 4, mOut);
+        if (!fseek(mOut, 40, SEEK_SET)) {
+            wav_put_le32(size, (uint32_t) FFMIN(mDataSize, UINT32_MAX));
+            fwrite(size, 1, 4, mOut);
+        }
+        fseek(mOut, 0, SEEK_END);
+    }
+    fflush(mOut);
+}
+
+void WavAudioSink::write(const uint8_t *samples, int len) {
+    uint8_t header[44];
+
+    if (!mHeaderWritten) {
+        memcpy(header, "RIFF", 4);
+        wav_put_le32(header + 4, UINT32_MAX);
+        memcpy(header + 8, "WAVEfmt ", 8);
+        wav_put_le32(header + 16, 16);
+        wav_put_le16(header + 20, 1);                      // PCM
+        wav_put_le16(header + 22, mChannels);
+        wav_put_le32(header + 24, mSampleRate);
+        wav_put_le32(header + 28, mSampleRate * mChannels * 2);
+        wav_put_le16(header + 32, mChannels * 2);
+        wav_put_le16(header + 34, 16);
+        memcpy(header + 36, "data", 4);
+        wav_put_le32(header + 40, UINT32_MAX);
+        fwrite(header, 1, sizeof(header), mOut);
+        mHeaderWritten = 1;
+    }
+    fwrite(samples, 1, len, mOut);
+    mDataSize += len;
+}
+
+HashAudioSink::HashAudioSink(TimeSource *timeSource, SinkStats *stats)
+        : NullAudioSink(timeSource, stats), mMd5(av_md5_alloc()) {
+    if (mMd5)
+        av_md5_init(mMd5);
+}
+
+HashAudioSink::~HashAudioSink() {
+    close();
+    if (mStats && mMd5)
+        md5_hex(mMd5, mStats->md5);
+    av_free(mMd5);
+}
+
+void HashAudioSink::write(const uint8_t *samples, int len) {
+    if (mMd5)
+        av_md5_update(mMd5, samples, len);
+}
+
+}
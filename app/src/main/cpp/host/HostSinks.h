@@ -0,0 +1,167 @@
+#ifndef MYPLAYER_HOSTSINKS_H
+#define MYPLAYER_HOSTSINKS_H
+
+extern "C" {
+#include "libavutil/md5.h"
+#include "libavutil/rational.h"
+#include "libswscale/swscale.h"
+}
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "../Platform.h"
+#include "../TimeSource.h"
+
+/* sample frames pulled by the audio sinks at a time */
+#define HOST_AUDIO_BUFFER_SAMPLES 1024
+
+namespace ffplayer {
+
+/* the sinks of the host build, which take the place of the window and the
+ * audio device of Android to run the player on a workstation */
+
+/* what a sink was given, read once the player and its sinks are gone */
+typedef struct SinkStats {
+    int64_t frames;            // pictures, or sample frames of audio
+    int64_t bytes;
+    char md5[33];              // of all the pictures or samples, by the hashing sinks
+} SinkStats;
+
+/* drops the pictures, counting them */
+class NullVideoSink : public VideoSink {
+public:
+    /* the size of the surface it stands for */
+    NullVideoSink(int width, int height, SinkStats *stats);
+
+    ~NullVideoSink();
+
+    int getWidth();
+
+    int getHeight();
+
+    int setBuffersGeometry(int width, int height);
+
+    int lock(VideoSinkBuffer *buffer);
+
+    void unlockAndPost(double pts);
+
+protected:
+    /* the RGBA picture drawn in the buffer */
+    virtual void post(const uint8_t *rgba, int stride, int width, int height, double pts) {}
+
+    int mSurfaceWidth;
+    int mSurfaceHeight;
+    int mWidth;
+    int mHeight;
+    uint8_t *mBuffer;
+    SinkStats *mStats;
+};
+
+/* the md5 of each picture as a line of out, if not NULL, and of them all */
+class HashVideoSink : public NullVideoSink {
+public:
+    HashVideoSink(int width, int height, FILE *out, SinkStats *stats);
+
+    ~HashVideoSink();
+
+protected:
+    void post(const uint8_t *rgba, int stride, int width, int height, double pts);
+
+private:
+    FILE *mOut;
+    int64_t mIndex;
+    struct AVMD5 *mFrameMd5;
+    struct AVMD5 *mTotalMd5;
+};
+
+/* the pictures as a YUV4MPEG2 stream of yuv420p at the size of the first one.
+ * Y4M has no timestamps, the header gives the rate to play them at. */
+class Y4mVideoSink : public NullVideoSink {
+public:
+    Y4mVideoSink(int width, int height, FILE *out, AVRational rate, SinkStats *stats);
+
+    ~Y4mVideoSink();
+
+protected:
+    void post(const uint8_t *rgba, int stride, int width, int height, double pts);
+
+private:
+    FILE *mOut;
+    AVRational mRate;
+    int mOutWidth;             // of the first picture, 0 until written
+    int mOutHeight;
+    uint8_t *mPlanes[4];
+    int mLinesizes[4];
+    struct SwsContext *mConvertCtx;
+};
+
+/* pulls the samples from its own thread and drops them, paced by the time
+ * source of the player */
+class NullAudioSink : public AudioSink {
+public:
+    NullAudioSink(TimeSource *timeSource, SinkStats *stats);
+
+    ~NullAudioSink();
+
+    void open(int sampleRate, unsigned int channels, void *userData, AudioSinkCallback callback);
+
+    void start();
+
+    void close();
+
+protected:
+    /* only the buffers with samples of the stream, silence while paused or
+     * after the end is dropped */
+    virtual void write(const uint8_t *samples, int len) {}
+
+    int mSampleRate;
+    int mChannels;
+    SinkStats *mStats;
+
+private:
+    static void *pullThread(void *arg);
+
+    TimeSource *mTimeSource;
+    volatile int mStopping;
+    int mRunning;
+    pthread_t mThread;
+    uint8_t *mBuffer;
+    int mBufferSize;
+    void *mUserData;
+    AudioSinkCallback mCallback;
+};
+
+/* the samples as a 16 bit PCM WAV file, in the format of the first open */
+class WavAudioSink : public NullAudioSink {
+public:
+    WavAudioSink(TimeSource *timeSource, FILE *out, SinkStats *stats);
+
+    ~WavAudioSink();
+
+protected:
+    void write(const uint8_t *samples, int len);
+
+private:
+    FILE *mOut;
+    int64_t mDataSize;
+    int mHeaderWritten;
+};
+
+/* the md5 of all the samples */
+class HashAudioSink : public NullAudioSink {
+public:
+    HashAudioSink(TimeSource *timeSource, SinkStats *stats);
+
+    ~HashAudioSink();
+
+protected:
+    void write(const uint8_t *samples, int len);
+
+private:
+    struct AVMD5 *mMd5;
+};
+
+}
+
+#endif //MYPLAYER_HOSTSINKS_H
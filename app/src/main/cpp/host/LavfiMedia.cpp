@@ -0,0 +1,148 @@
+#include "LavfiMedia.h"
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavfilter/avfilter.h"
+#include "libavfilter/buffersink.h"
+#include "libavformat/avformat.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+}
+
+#include <stdio.h>
+
+namespace ffplayer {
+
+AVFrame **lavfi_frames(const char *desc, int audio, int nb_frames) {
+    AVFilterGraph *graph = avfilter_graph_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc(), *outputs = NULL;
+    AVFilterContext *sink = NULL;
+    AVFrame **frames = (AVFrame **) av_mallocz_array(nb_frames + 1, sizeof(*frames));
+    int i, ret = AVERROR(ENOMEM);
+
+    if (!graph || !inputs || !frames)
+        goto end;
+    if ((ret = avfilter_graph_create_filter(&sink, avfilter_get_by_name(audio ? "abuffersink" : "buffersink"),
+                                            "out", NULL, NULL, graph)) < 0)
+        goto end;
+    inputs->name = av_strdup("out");
+    inputs->filter_ctx = sink;
+    inputs->pad_idx = 0;
+    inputs->next = NULL;
+    if ((ret = avfilter_graph_parse_ptr(graph, desc, &inputs, &outputs, NULL)) < 0
+        || (ret = avfilter_graph_config(graph, NULL)) < 0)
+        goto end;
+    for (i = 0; i < nb_frames; i++) {
+        if (!(frames[i] = av_frame_alloc())) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        if ((ret = av_buffersink_get_frame(sink, frames[i])) < 0)
+            goto end;
+    }
+    ret = 0;
+end:
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    avfilter_graph_free(&graph);
+    if (ret < 0 && frames) {
+        char error[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, error, sizeof(error));
+        fprintf(stderr, "%s: %s\n", desc, error);
+        for (i = 0; i < nb_frames; i++)
+            av_frame_free(&frames[i]);
+        av_freep(&frames);
+    }
+    return frames;
+}
+
+void frames_free(AVFrame **frames) {
+    int i;
+
+    for (i = 0; frames && frames[i]; i++)
+        av_frame_free(&frames[i]);
+    av_free(frames);
+}
+
+AVFrame **testsrc_frames(int width, int height, int nb_frames) {
+    char desc[128];
+
+    snprintf(desc, sizeof(desc), "testsrc=size=%dx%d:rate=25,format=yuv420p", width, height);
+    return lavfi_frames(desc, 0, nb_frames);
+}
+
+static int write_packet(AVFormatContext *oc, AVCodecContext *enc, AVPacket *pkt) {
+    av_packet_rescale_ts(pkt, enc->time_base, oc->streams[0]->time_base);
+    pkt->stream_index = 0;
+    return av_interleaved_write_frame(oc, pkt);
+}
+
+int testsrc_write_file(const char *path, enum AVCodecID codec_id, int width, int height,
+                       int nb_frames, int gop) {
+    AVCodec *encoder = avcodec_find_encoder(codec_id);
+    AVFormatContext *oc = NULL;
+    AVCodecContext *enc;
+    AVFrame **frames = NULL;
+    AVStream *st;
+    AVPacket pkt;
+    int i, got, ret;
+
+    if (!encoder)
+        return AVERROR_ENCODER_NOT_FOUND;
+    if ((ret = avformat_alloc_output_context2(&oc, NULL, "matroska", path)) < 0)
+        return ret;
+    ret = AVERROR(ENOMEM);
+    if (!(st = avformat_new_stream(oc, encoder))
+        || !(frames = testsrc_frames(width, height, nb_frames)))
+        goto end;
+    enc = st->codec;
+    enc->codec_id = codec_id;
+    enc->width = width;
+    enc->height = height;
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->time_base = (AVRational) {1, 25};
+    enc->gop_size = gop;
+    enc->max_b_frames = 0;
+    enc->bit_rate = (int64_t) width * height * 4;
+    /* the MJPEG encoder takes yuv420p only as the full range yuvj420p */
+    enc->strict_std_compliance = FF_COMPLIANCE_UNOFFICIAL;
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER)
+        enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    st->time_base = enc->time_base;
+    if ((ret = avcodec_open2(enc, encoder, NULL)) < 0
+        || (ret = avio_open(&oc->pb, path, AVIO_FLAG_WRITE)) < 0
+        || (ret = avformat_write_header(oc, NULL)) < 0)
+        goto end;
+    /* then flush the encoder, with NULL frames, for the delayed packets */
+    for (i = 0;; i++) {
+        av_init_packet(&pkt);
+        pkt.data = NULL;
+        pkt.size = 0;
+        if (i < nb_frames)
+            frames[i]->pts = i;
+        if ((ret = avcodec_encode_video2(enc, &pkt, i < nb_frames ? frames[i] : NULL, &got)) < 0)
+            goto end;
+        if (!got) {
+            if (i >= nb_frames)
+                break;
+            continue;
+        }
+        if ((ret = write_packet(oc, enc, &pkt)) < 0)
+            goto end;
+    }
+    ret = av_write_trailer(oc);
+end:
+    if (ret < 0) {
+        char error[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, error, sizeof(error));
+        fprintf(stderr, "%s: %s\n", path, error);
+    }
+    frames_free(frames);
+    if (oc->nb_streams)
+        avcodec_close(oc->streams[0]->codec);
+    avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    return ret;
+}
+
+}
@@ -0,0 +1,30 @@
+#ifndef MYPLAYER_LAVFIMEDIA_H
+#define MYPLAYER_LAVFIMEDIA_H
+
+extern "C" {
+#include "libavcodec/avcodec.h"
+#include "libavutil/frame.h"
+}
+
+namespace ffplayer {
+
+/* the media of the benchmarks and the tests, made by the lavfi sources so
+ * that nothing has to be shipped with them */
+
+/* the first nb_frames frames of a lavfi source graph, NULL terminated, NULL
+ * on error */
+AVFrame **lavfi_frames(const char *desc, int audio, int nb_frames);
+
+void frames_free(AVFrame **frames);
+
+/* testsrc at 25 fps in yuv420p */
+AVFrame **testsrc_frames(int width, int height, int nb_frames);
+
+/* nb_frames of testsrc encoded with codec_id in Matroska, a keyframe every gop
+ * frames, so that the demuxer has an index to seek with */
+int testsrc_write_file(const char *path, enum AVCodecID codec_id, int width, int height,
+                       int nb_frames, int gop);
+
+}
+
+#endif //MYPLAYER_LAVFIMEDIA_H
@@ -0,0 +1,894 @@
+// Microbenchmarks of the primitives the pipeline is made of, on a workstation:
+//
+//   ffplayer_bench [-filter TEXT] [-min-time SECONDS] [-json FILE]
+//
+// The primitives are static in FFPlayer.cpp, so it is built into this file
+// instead of being linked from ffplayer_core. The media comes from the lavfi
+// sources testsrc and sine, encoded here when a codec needs packets, so that
+// nothing has to be shipped; the decode_file and media_scanner benchmarks
+// write their files to /tmp and read them back through the demuxer. Each
+// benchmark runs more and more iterations until it lasts -min-time; the results are printed as a table and, with
+// -json, written in the format of Google Benchmark to track them over time.
+
+#include "../FFPlayer.cpp"
+#include "../MediaScanner.h"
+#include "LavfiMedia.h"
+
+extern "C" {
+#include "libavfilter/avfilter.h"
+}
+
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_MAX_ITERATIONS 1000000000
+#define BENCH_MAX_RESULTS 64
+/* pictures encoded for the decoding benchmarks, one GOP */
+#define BENCH_GOP 12
+/* the file of the file decoding benchmarks, 1080p decoded for a small window */
+#define BENCH_FILE_WIDTH 1920
+#define BENCH_FILE_HEIGHT 1080
+#define BENCH_FILE_FRAMES (4 * BENCH_GOP)
+/* the small files of the media scanner benchmarks */
+#define BENCH_SCAN_FILES 16
+/* producers of the contended packet queue, like the read thread and the
+ * back-buffer rewind */
+#define BENCH_MAX_PRODUCERS 4
+/* the producers wait while the contended queue is this full, as the read
+ * thread does, and the consumer wakes them once it is half empty */
+#define BENCH_QUEUE_PACKETS 64
+
+typedef struct BenchResult {
+    char name[64];
+    int64_t iterations;
+    double real_time;          // nanoseconds per iteration
+    double cpu_time;           // of the whole process, the executor included
+    double bytes_per_second;   // 0 if the benchmark does not count bytes
+    double items_per_second;   // 0 if the benchmark does not count items
+} BenchResult;
+
+typedef struct Benchmark {
+    char name[64];
+    /* the state the iterations work on, NULL if it cannot run here */
+    void *(*setup)(const struct Benchmark *b);
+    /* run iterations times, return the bytes processed */
+    int64_t (*run)(void *ctx, int64_t iterations);
+    void (*teardown)(void *ctx);
+    int width;
+    int height;
+    int param;
+    const char *graph;
+    int items;                 // per iteration, decoded pictures or scanned files
+} Benchmark;
+
+static double min_time = 0.5;
+static BenchResult results[BENCH_MAX_RESULTS];
+static int nb_results;
+
+static int64_t cpu_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ---- packet queue ---- */
+
+typedef struct QueueBench {
+    PacketQueue q;
+    AVPacket pkt;              // the payload put again and again
+    int nb_producers;
+    int64_t per_producer;
+    pthread_t producers[BENCH_MAX_PRODUCERS];
+    pthread_mutex_t room_mutex;
+    pthread_cond_t room;
+} QueueBench;
+
+static void *queue_setup(const Benchmark *b) {
+    QueueBench *s = (QueueBench *) av_mallocz(sizeof(*s));
+
+    if (!s)
+        return NULL;
+    packet_queue_init(&s->q, NULL);
+    packet_queue_start(&s->q);
+    /* a packet of a 4 Mb/s stream at 25 fps */
+    av_new_packet(&s->pkt, 20000);
+    s->nb_producers = b->param;
+    pthread_mutex_init(&s->room_mutex, NULL);
+    pthread_cond_init(&s->room, NULL);
+    return s;
+}
+
+static void *queue_producer(void *arg) {
+    QueueBench *s = (QueueBench *) arg;
+    AVPacket pkt;
+    int64_t i;
+
+    for (i = 0; i < s->per_producer; i++) {
+        /* the others can each put one more meanwhile, no more */
+        pthread_mutex_lock(&s->room_mutex);
+        while (__atomic_load_n(&s->q.nb_packets, __ATOMIC_RELAXED) >= BENCH_QUEUE_PACKETS)
+            pthread_cond_wait(&s->room, &s->room_mutex);
+        pthread_mutex_unlock(&s->room_mutex);
+        av_packet_ref(&pkt, &s->pkt);
+        packet_queue_put(&s->q, &pkt);
+    }
+    return NULL;
+}
+
+static int64_t queue_get(QueueBench *s, int64_t n) {
+    AVPacket pkt;
+    int serial;
+    int64_t got = 0;
+
+    while (got < n && packet_queue_get(&s->q, &pkt, 1, &serial) > 0) {
+        if (pkt.data != flush_pkt.data)
+            got++;
+        av_free_packet(&pkt);
+        /* the producers only wait with the queue full, so it drains through
+         * half full before they could all be waiting */
+        if (__atomic_load_n(&s->q.nb_packets, __ATOMIC_RELAXED) == BENCH_QUEUE_PACKETS / 2) {
+            pthread_mutex_lock(&s->room_mutex);
+            pthread_cond_broadcast(&s->room);
+            pthread_mutex_unlock(&s->room_mutex);
+        }
+    }
+    return got;
+}
+
+/* the read thread and the decoder: put then get on one thread, or the given
+ * number of producers against one consumer */
+static int64_t queue_run(void *ctx, int64_t iterations) {
+    QueueBench *s = (QueueBench *) ctx;
+    AVPacket pkt;
+    int64_t i;
+    int p;
+
+    if (!s->nb_producers) {
+        for (i = 0; i < iterations; i++) {
+            av_packet_ref(&pkt, &s->pkt);
+            packet_queue_put(&s->q, &pkt);
+            queue_get(s, 1);
+        }
+        return iterations * s->pkt.size;
+    }
+    s->per_producer = (iterations + s->nb_producers - 1) / s->nb_producers;
+    for (p = 0; p < s->nb_producers; p++)
+        pthread_create(&s->producers[p], NULL, queue_producer, s);
+    queue_get(s, s->per_producer * s->nb_producers);
+    for (p = 0; p < s->nb_producers; p++)
+        pthread_join(s->producers[p], NULL);
+    return s->per_producer * s->nb_producers * s->pkt.size;
+}
+
+static void queue_teardown(void *ctx) {
+    QueueBench *s = (QueueBench *) ctx;
+
+    packet_queue_destroy(&s->q);
+    pthread_cond_destroy(&s->room);
+    pthread_mutex_destroy(&s->room_mutex);
+    av_free_packet(&s->pkt);
+    av_free(s);
+}
+
+/* ---- frame queue ---- */
+
+typedef struct FrameQueueBench {
+    PacketQueue q;
+    FrameQueue f;
+    AVFrame *frame;
+    int threaded;
+    int64_t iterations;
+    pthread_t producer;
+} FrameQueueBench;
+
+static void *frame_queue_setup(const Benchmark *b) {
+    FrameQueueBench *s = (FrameQueueBench *) av_mallocz(sizeof(*s));
+    AVFrame **frames;
+
+    if (!s || !(frames = testsrc_frames(b->width, b->height, 1))) {
+        av_free(s);
+        return NULL;
+    }
+    s->frame = frames[0];
+    av_free(frames);
+    packet_queue_init(&s->q, NULL);
+    packet_queue_start(&s->q);
+    frame_queue_init(&s->f, &s->q, VIDEO_PICTURE_QUEUE_SIZE, 1);
+    s->threaded = b->param;
+    return s;
+}
+
+static int frame_queue_produce(FrameQueueBench *s) {
+    Frame *vp;
+
+    if (!(vp = frame_queue_peek_writable(&s->f)))
+        return -1;
+    av_frame_ref(vp->frame, s->frame);
+    vp->serial = s->q.serial;
+    frame_queue_push(&s->f);
+    return 0;
+}
+
+static void *frame_queue_producer(void *arg) {
+    FrameQueueBench *s = (FrameQueueBench *) arg;
+    int64_t i;
+
+    for (i = 0; i < s->iterations; i++) {
+        if (frame_queue_produce(s) < 0)
+            break;
+    }
+    return NULL;
+}
+
+/* the decoder thread and the display, each frame referenced in and released
+ * out as the video thread and video_refresh do */
+static int64_t frame_queue_run(void *ctx, int64_t iterations) {
+    FrameQueueBench *s = (FrameQueueBench *) ctx;
+    int64_t i;
+
+    s->iterations = iterations;
+    if (s->threaded)
+        pthread_create(&s->producer, NULL, frame_queue_producer, s);
+    for (i = 0; i < iterations; i++) {
+        if (!s->threaded)
+            frame_queue_produce(s);
+        if (!frame_queue_peek_readable(&s->f))
+            break;
+        frame_queue_next(&s->f);
+    }
+    if (s->threaded)
+        pthread_join(s->producer, NULL);
+    return 0;
+}
+
+static void frame_queue_teardown(void *ctx) {
+    FrameQueueBench *s = (FrameQueueBench *) ctx;
+
+    frame_queue_destory(&s->f);
+    packet_queue_destroy(&s->q);
+    av_frame_free(&s->frame);
+    av_free(s);
+}
+
+/* ---- decoding ---- */
+
+typedef struct DecodeBench {
+    PacketQueue q;
+    pthread_cond_t empty_queue_cond;
+    Decoder d;
+    AVPacket packets[BENCH_GOP];
+    int nb_packets;
+    int64_t bytes;             // of all the packets
+    AVFrame *frame;
+} DecodeBench;
+
+/* one GOP of testsrc encoded with the codec of the benchmark */
+static int encode_gop(DecodeBench *s, const Benchmark *b, AVCodec *encoder) {
+    AVCodecContext *enc = avcodec_alloc_context3(encoder);
+    AVFrame **frames = testsrc_frames(b->width, b->height, BENCH_GOP);
+    int i, got, ret = AVERROR(ENOMEM);
+
+    if (!enc || !frames)
+        goto end;
+    enc->width = b->width;
+    enc->height = b->height;
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->time_base = (AVRational) {1, 25};
+    enc->gop_size = BENCH_GOP;
+    enc->max_b_frames = 0;
+    enc->bit_rate = (int64_t) b->width * b->height * 4;
+    if ((ret = avcodec_open2(enc, encoder, NULL)) < 0)
+        goto end;
+    /* then flush the encoder, with NULL frames, for the delayed packets */
+    for (i = 0; s->nb_packets < BENCH_GOP; i++) {
+        AVPacket *pkt = &s->packets[s->nb_packets];
+        av_init_packet(pkt);
+        pkt->data = NULL;
+        pkt->size = 0;
+        if (i < BENCH_GOP)
+            frames[i]->pts = i;
+        if ((ret = avcodec_encode_video2(enc, pkt, i < BENCH_GOP ? frames[i] : NULL, &got)) < 0)
+            goto end;
+        if (got) {
+            s->bytes += pkt->size;
+            s->nb_packets++;
+        } else if (i >= BENCH_GOP) {
+            break;
+        }
+    }
+    ret = s->nb_packets ? 0 : AVERROR_BUG;
+end:
+    frames_free(frames);
+    avcodec_free_context(&enc);
+    return ret;
+}
+
+static void *decode_setup(const Benchmark *b) {
+    AVCodec *encoder = avcodec_find_encoder((AVCodecID) b->param);
+    AVCodec *decoder = avcodec_find_decoder((AVCodecID) b->param);
+    DecodeBench *s;
+    AVCodecContext *avctx;
+
+    if (!encoder || !decoder || !(s = (DecodeBench *) av_mallocz(sizeof(*s))))
+        return NULL;
+    if (encode_gop(s, b, encoder) < 0 || !(avctx = avcodec_alloc_context3(decoder))
+        || avcodec_open2(avctx, decoder, NULL) < 0) {
+        fprintf(stderr, "%s: could not encode the test GOP\n", b->name);
+        av_free(s);
+        return NULL;
+    }
+    s->frame = av_frame_alloc();
+    s->empty_queue_cond = PTHREAD_COND_INITIALIZER;
+    packet_queue_init(&s->q, NULL);
+    packet_queue_start(&s->q);
+    decoder_init(&s->d, avctx, &s->q, &s->empty_queue_cond);
+    return s;
+}
+
+/* decoder_decode_frame on the GOP over and over, one picture per iteration */
+static int64_t decode_run(void *ctx, int64_t iterations) {
+    DecodeBench *s = (DecodeBench *) ctx;
+    AVPacket pkt;
+    int64_t i;
+    int p;
+
+    for (i = 0; i < iterations; i++) {
+        /* the flush packet of the start counts too */
+        if (s->q.nb_packets <= 1) {
+            for (p = 0; p < s->nb_packets; p++) {
+                av_packet_ref(&pkt, &s->packets[p]);
+                packet_queue_put(&s->q, &pkt);
+            }
+        }
+        if (decoder_decode_frame(&s->d, s->frame, NULL) < 0)
+            break;
+        av_frame_unref(s->frame);
+    }
+    return iterations * s->bytes / s->nb_packets;
+}
+
+static void decode_teardown(void *ctx) {
+    DecodeBench *s = (DecodeBench *) ctx;
+    int p;
+
+    decoder_destroy(&s->d);
+    avcodec_free_context(&s->d.avctx);
+    packet_queue_destroy(&s->q);
+    for (p = 0; p < s->nb_packets; p++)
+        av_free_packet(&s->packets[p]);
+    av_frame_free(&s->frame);
+    av_free(s);
+}
+
+/* ---- decoding a file ---- */
+
+typedef struct FileDecodeBench {
+    char path[64];
+    PlayerOptions opts;
+    VideoState *is;
+    AVFormatContext *ic;
+    AVFrame *frame;
+} FileDecodeBench;
+
+static void file_decode_teardown(void *ctx) {
+    FileDecodeBench *s = (FileDecodeBench *) ctx;
+
+    if (s->ic)
+        avcodec_close(s->ic->streams[0]->codec);
+    avformat_close_input(&s->ic);
+    unlink(s->path);
+    av_frame_free(&s->frame);
+    av_free(s->is);
+    av_free(s);
+}
+
+/* a 1080p file written with the codec of the benchmark, its decoder opened
+ * at the lowres the player picks for a surface of the benchmark size, at
+ * full size without one */
+static void *file_decode_setup(const Benchmark *b) {
+    FileDecodeBench *s = (FileDecodeBench *) av_mallocz(sizeof(*s));
+    AVCodecContext *avctx;
+    AVCodec *decoder;
+    int fd;
+
+    if (!s)
+        return NULL;
+    av_strlcpy(s->path, "/tmp/ffplayer_bench_XXXXXX", sizeof(s->path));
+    if ((fd = mkstemp(s->path)) < 0) {
+        av_free(s);
+        return NULL;
+    }
+    close(fd);
+    if (!(s->is = (VideoState *) av_mallocz(sizeof(VideoState)))
+        || !(s->frame = av_frame_alloc())
+        || testsrc_write_file(s->path, (AVCodecID) b->param, BENCH_FILE_WIDTH,
+                              BENCH_FILE_HEIGHT, BENCH_FILE_FRAMES, BENCH_GOP) < 0
+        || avformat_open_input(&s->ic, s->path, NULL, NULL) < 0
+        || avformat_find_stream_info(s->ic, NULL) < 0)
+        goto fail;
+    avctx = s->ic->streams[0]->codec;
+    if (!(decoder = avcodec_find_decoder(avctx->codec_id)))
+        goto fail;
+    player_options_init(&s->opts);
+    s->is->opts = &s->opts;
+    s->is->surface_width = b->width;
+    s->is->surface_height = b->height;
+    s->is->video_full_width = avctx->width;
+    s->is->video_full_height = avctx->height;
+    av_codec_set_lowres(avctx, surface_lowres(s->is, decoder));
+    if (avcodec_open2(avctx, decoder, NULL) < 0)
+        goto fail;
+    return s;
+fail:
+    fprintf(stderr, "%s: could not write or open the test file\n", b->name);
+    file_decode_teardown(s);
+    return NULL;
+}
+
+/* read and decode the file over and over, one picture per iteration */
+static int64_t file_decode_run(void *ctx, int64_t iterations) {
+    FileDecodeBench *s = (FileDecodeBench *) ctx;
+    AVCodecContext *avctx = s->ic->streams[0]->codec;
+    AVPacket pkt;
+    int64_t i = 0, bytes = 0;
+    int got, ret, rewound = 0;
+
+    while (i < iterations) {
+        if ((ret = av_read_frame(s->ic, &pkt)) == AVERROR_EOF) {
+            /* without B-frames there are no delayed pictures to drain */
+            if (rewound || av_seek_frame(s->ic, 0, 0, AVSEEK_FLAG_BACKWARD) < 0)
+                break;
+            avcodec_flush_buffers(avctx);
+            rewound = 1;
+            continue;
+        }
+        if (ret < 0)
+            break;
+        rewound = 0;
+        bytes += pkt.size;
+        ret = avcodec_decode_video2(avctx, s->frame, &got, &pkt);
+        av_free_packet(&pkt);
+        if (ret < 0)
+            break;
+        if (got) {
+            av_frame_unref(s->frame);
+            i++;
+        }
+    }
+    return bytes;
+}
+
+/* ---- media scanner ---- */
+
+typedef struct ScanBench {
+    char dir[64];
+    char db_path[96];
+    char paths[BENCH_SCAN_FILES][96];
+    const char *path_list[BENCH_SCAN_FILES];
+    int nb_files;              // written so far
+    int nb_threads;
+} ScanBench;
+
+static void scan_teardown(void *ctx) {
+    ScanBench *s = (ScanBench *) ctx;
+    int i;
+
+    for (i = 0; i < s->nb_files; i++)
+        unlink(s->paths[i]);
+    unlink(s->db_path);
+    rmdir(s->dir);
+    av_free(s);
+}
+
+/* a directory of short files, like a camera roll to index */
+static void *scan_setup(const Benchmark *b) {
+    ScanBench *s = (ScanBench *) av_mallocz(sizeof(*s));
+
+    if (!s)
+        return NULL;
+    av_strlcpy(s->dir, "/tmp/ffplayer_bench_XXXXXX", sizeof(s->dir));
+    if (!mkdtemp(s->dir)) {
+        av_free(s);
+        return NULL;
+    }
+    snprintf(s->db_path, sizeof(s->db_path), "%s/media.db", s->dir);
+    for (; s->nb_files < BENCH_SCAN_FILES; s->nb_files++) {
+        snprintf(s->paths[s->nb_files], sizeof(s->paths[0]), "%s/%02d.mkv", s->dir, s->nb_files);
+        s->path_list[s->nb_files] = s->paths[s->nb_files];
+        if (testsrc_write_file(s->paths[s->nb_files], AV_CODEC_ID_MPEG4, 320, 240,
+                               BENCH_FILE_FRAMES, BENCH_GOP) < 0) {
+            scan_teardown(s);
+            return NULL;
+        }
+    }
+    s->nb_threads = b->param;
+    return s;
+}
+
+/* every file probed again, the database removed before each scan */
+static int64_t scan_run(void *ctx, int64_t iterations) {
+    ScanBench *s = (ScanBench *) ctx;
+    int64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        unlink(s->db_path);
+        if (media_scanner_scan(s->db_path, s->path_list, s->nb_files, s->nb_threads) < 0)
+            break;
+    }
+    return 0;
+}
+
+/* ---- conversion ---- */
+
+typedef struct ConvertBench {
+    PlayerOptions opts;
+    VideoState *is;
+    Frame vp;
+    AVFrame *frame;
+} ConvertBench;
+
+static void *convert_setup(const Benchmark *b) {
+    ConvertBench *s = (ConvertBench *) av_mallocz(sizeof(*s));
+    AVFrame **frames;
+
+    if (!s || !(s->is = (VideoState *) av_mallocz(sizeof(VideoState)))
+        || !(frames = testsrc_frames(b->width, b->height, 1))) {
+        if (s)
+            av_free(s->is);
+        av_free(s);
+        return NULL;
+    }
+    s->frame = frames[0];
+    av_free(frames);
+    player_options_init(&s->opts);
+    s->opts.focused = 1;
+    s->is->opts = &s->opts;
+    s->vp.width = b->width;
+    s->vp.height = b->height;
+    return s;
+}
+
+/* a decoded picture to RGBA at its own size, in bands on the executor */
+static int64_t convert_run(void *ctx, int64_t iterations) {
+    ConvertBench *s = (ConvertBench *) ctx;
+    int64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        s->is->convert_deadline = av_gettime_relative();
+        do_scale_picture(s->is, &s->vp, s->frame);
+    }
+    return iterations * s->vp.width * s->vp.height * 4;
+}
+
+static void convert_teardown(void *ctx) {
+    ConvertBench *s = (ConvertBench *) ctx;
+    int i;
+
+    sws_freeContext(s->is->img_convert_ctx);
+    for (i = 0; i < CONVERT_BANDS_MAX; i++)
+        sws_freeContext(s->is->band_convert_ctx[i]);
+    free_picture(&s->is->mem, &s->vp);
+    av_frame_free(&s->frame);
+    av_free(s->is);
+    av_free(s);
+}
+
+/* ---- audio ---- */
+
+#define BENCH_AUDIO_FRAMES 16
+
+typedef struct AudioBench {
+    VideoState *is;
+    AVFrame **frames;          // cycled through
+    int visualize;             // also update the visualizer at each iteration
+} AudioBench;
+
+static void *audio_setup(const Benchmark *b) {
+    AudioBench *s = (AudioBench *) av_mallocz(sizeof(*s));
+    VideoState *is;
+
+    if (!s || !(s->is = is = (VideoState *) av_mallocz(sizeof(VideoState)))
+        || !(s->frames = lavfi_frames(b->graph, 1, BENCH_AUDIO_FRAMES))) {
+        if (s)
+            av_free(s->is);
+        av_free(s);
+        return NULL;
+    }
+    packet_queue_init(&is->audioq, &is->mem);
+    packet_queue_start(&is->audioq);
+    frame_queue_init(&is->sampq, &is->audioq, SAMPLE_QUEUE_SIZE, 1);
+    init_clock(&is->audclk, &is->audioq.serial, time_source_system());
+    init_clock(&is->extclk, &is->extclk.serial, time_source_system());
+    is->av_sync_type = AV_SYNC_AUDIO_MASTER;
+    /* what audio_open asks the device for */
+    is->audio_tgt.fmt = AV_SAMPLE_FMT_S16;
+    is->audio_tgt.freq = 44100;
+    is->audio_tgt.channels = 2;
+    is->audio_tgt.channel_layout = AV_CH_LAYOUT_STEREO;
+    is->audio_tgt.frame_size = av_samples_get_buffer_size(NULL, 2, 1, AV_SAMPLE_FMT_S16, 1);
+    is->audio_tgt.bytes_per_sec = av_samples_get_buffer_size(NULL, 2, 44100, AV_SAMPLE_FMT_S16, 1);
+    is->audio_src = is->audio_tgt;
+    return s;
+}
+
+/* a decoded frame through the sample queue to the samples of the device */
+static int64_t audio_run(void *ctx, int64_t iterations) {
+    AudioBench *s = (AudioBench *) ctx;
+    VideoState *is = s->is;
+    int64_t i, bytes = 0;
+    Frame *af;
+    int size;
+
+    for (i = 0; i < iterations; i++) {
+        if (!(af = frame_queue_peek_writable(&is->sampq)))
+            break;
+        av_frame_ref(af->frame, s->frames[i % BENCH_AUDIO_FRAMES]);
+        af->pts = NAN;
+        af->serial = is->audioq.serial;
+        frame_queue_push(&is->sampq);
+        if ((size = audio_decode_frame(is)) > 0)
+            bytes += size;
+    }
+    return bytes;
+}
+
+static void audio_teardown(void *ctx) {
+    AudioBench *s = (AudioBench *) ctx;
+
+    swr_free(&s->is->swr_ctx);
+    av_freep(&s->is->audio_buf1);
+    frame_queue_destory(&s->is->sampq);
+    packet_queue_destroy(&s->is->audioq);
+    frames_free(s->frames);
+    av_free(s->is);
+    av_free(s);
+}
+
+/* the copy of the samples for the visualizer, what the audio callback pays
+ * for it; with a param the spectrum and the waveform are computed from them
+ * at each iteration too, what the visualizer thread pays */
+static void *sample_display_setup(const Benchmark *b) {
+    AudioBench *s = (AudioBench *) av_mallocz(sizeof(*s));
+
+    if (!s || !(s->is = (VideoState *) av_mallocz(sizeof(VideoState)))
+        || !(s->frames = lavfi_frames(b->graph, 1, 1))) {
+        if (s)
+            av_free(s->is);
+        av_free(s);
+        return NULL;
+    }
+    /* without its thread, the iterations update it */
+    s->visualize = b->param;
+    if (!(s->is->visualizer = audio_visualizer_create(ANDROID_AUDIO_CHANNELS, 0))) {
+        frames_free(s->frames);
+        av_free(s->is);
+        av_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static int64_t sample_display_run(void *ctx, int64_t iterations) {
+    AudioBench *s = (AudioBench *) ctx;
+    AVFrame *frame = s->frames[0];
+    int size = frame->nb_samples * av_frame_get_channels(frame) * 2;
+    int64_t i;
+
+    for (i = 0; i < iterations; i++) {
+        update_sample_display(s->is, (short *) frame->data[0], size);
+        if (s->visualize)
+            audio_visualizer_update(s->is->visualizer);
+    }
+    return iterations * size;
+}
+
+static void sample_display_teardown(void *ctx) {
+    AudioBench *s = (AudioBench *) ctx;
+
+    audio_visualizer_destroy(s->is->visualizer);
+    frames_free(s->frames);
+    av_free(s->is);
+    av_free(s);
+}
+
+/* ---- the runner ---- */
+
+static void run_benchmark(const Benchmark *b) {
+    BenchResult *r;
+    int64_t iterations = 1, real, cpu, bytes;
+    void *ctx;
+
+    if (!(ctx = b->setup(b))) {
+        fprintf(stderr, "%-40s skipped\n", b->name);
+        return;
+    }
+    /* once to warm up the caches and the contexts created on first use */
+    b->run(ctx, 1);
+    for (;;) {
+        real = av_gettime_relative();
+        cpu = cpu_time_ns();
+        bytes = b->run(ctx, iterations);
+        real = (av_gettime_relative() - real) * 1000;
+        cpu = cpu_time_ns() - cpu;
+        if (real >= min_time * 1e9 || iterations >= BENCH_MAX_ITERATIONS)
+            break;
+        /* aim a little over the minimum, at most ten times more */
+        iterations = (int64_t) FFMIN(iterations * 10.0,
+                                     FFMAX(iterations + 1.0,
+                                           iterations * min_time * 1.4e9 / FFMAX(real, 1)));
+    }
+    b->teardown(ctx);
+
+    if (nb_results >= BENCH_MAX_RESULTS)
+        return;
+    r = &results[nb_results++];
+    av_strlcpy(r->name, b->name, sizeof(r->name));
+    r->iterations = iterations;
+    r->real_time = (double) real / iterations;
+    r->cpu_time = (double) cpu / iterations;
+    r->bytes_per_second = bytes ? bytes * 1e9 / real : 0;
+    r->items_per_second = b->items ? iterations * b->items * 1e9 / real : 0;
+    printf("%-40s %12.0f ns %12.0f ns %12" PRId64, r->name, r->real_time, r->cpu_time,
+           r->iterations);
+    if (r->bytes_per_second)
+        printf(" %10.1f MB/s", r->bytes_per_second / 1e6);
+    if (r->items_per_second)
+        printf(" %10.1f items/s", r->items_per_second);
+    printf("\n");
+    fflush(stdout);
+}
+
+static int write_json(const char *path, const char *executable) {
+    FILE *out = fopen(path, "w");
+    time_t now = time(NULL);
+    char date[32];
+    int i;
+
+    if (!out) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return -1;
+    }
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+    fprintf(out, "{\n  \"context\": {\n    \"date\": \"%s\",\n    \"executable\": \"%s\",\n"
+                 "    \"num_cpus\": %ld,\n    \"ffmpeg_version\": \"%s\"\n  },\n"
+                 "  \"benchmarks\": [",
+            date, executable, sysconf(_SC_NPROCESSORS_ONLN), av_version_info());
+    for (i = 0; i < nb_results; i++) {
+        BenchResult *r = &results[i];
+        fprintf(out, "%s\n    {\n      \"name\": \"%s\",\n      \"run_name\": \"%s\",\n"
+                     "      \"run_type\": \"iteration\",\n      \"iterations\": %" PRId64 ",\n"
+                     "      \"real_time\": %.1f,\n      \"cpu_time\": %.1f,\n"
+                     "      \"time_unit\": \"ns\"",
+                i ? "," : "", r->name, r->name, r->iterations, r->real_time, r->cpu_time);
+        if (r->bytes_per_second)
+            fprintf(out, ",\n      \"bytes_per_second\": %.0f", r->bytes_per_second);
+        if (r->items_per_second)
+            fprintf(out, ",\n      \"items_per_second\": %.1f", r->items_per_second);
+        fprintf(out, "\n    }");
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out) ? -1 : 0;
+}
+
+static int nb_benchmarks;
+static Benchmark benchmarks[BENCH_MAX_RESULTS];
+
+static Benchmark *add(const char *name, void *(*setup)(const Benchmark *),
+                      int64_t (*run)(void *, int64_t), void (*teardown)(void *),
+                      int width, int height, int param, const char *graph) {
+    Benchmark *b = &benchmarks[nb_benchmarks++];
+
+    av_strlcpy(b->name, name, sizeof(b->name));
+    b->setup = setup;
+    b->run = run;
+    b->teardown = teardown;
+    b->width = width;
+    b->height = height;
+    b->param = param;
+    b->graph = graph;
+    return b;
+}
+
+static void add_benchmarks() {
+    static const int sizes[][2] = {{640, 360}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+    static const struct {
+        const char *name;
+        AVCodecID id;
+    } codecs[] = {{"mpeg4", AV_CODEC_ID_MPEG4}, {"h264", AV_CODEC_ID_H264}},
+            /* the codecs with lowres, in a 320x180 window or at full size */
+            lowres_codecs[] = {{"mpeg4", AV_CODEC_ID_MPEG4}, {"mjpeg", AV_CODEC_ID_MJPEG}};
+    static const int surfaces[][2] = {{320, 180}, {0, 0}};
+    char name[64];
+    int i, c;
+
+    add("packet_queue/put_get", queue_setup, queue_run, queue_teardown, 0, 0, 0, NULL);
+    for (i = 1; i <= BENCH_MAX_PRODUCERS; i *= 2) {
+        snprintf(name, sizeof(name), "packet_queue/contended/producers:%d", i);
+        add(name, queue_setup, queue_run, queue_teardown, 0, 0, i, NULL);
+    }
+    add("frame_queue/push_next", frame_queue_setup, frame_queue_run, frame_queue_teardown,
+        1280, 720, 0, NULL);
+    add("frame_queue/push_next/threaded", frame_queue_setup, frame_queue_run,
+        frame_queue_teardown, 1280, 720, 1, NULL);
+    for (c = 0; c < (int) FF_ARRAY_ELEMS(codecs); c++) {
+        for (i = 0; i < 3; i++) {
+            snprintf(name, sizeof(name), "decode/%s/%dx%d", codecs[c].name, sizes[i][0],
+                     sizes[i][1]);
+            add(name, decode_setup, decode_run, decode_teardown, sizes[i][0], sizes[i][1],
+                codecs[c].id, NULL)->items = 1;
+        }
+    }
+    for (c = 0; c < (int) FF_ARRAY_ELEMS(lowres_codecs); c++) {
+        for (i = 0; i < (int) FF_ARRAY_ELEMS(surfaces); i++) {
+            if (surfaces[i][0])
+                snprintf(name, sizeof(name), "decode_file/%s/%dx%d/surface:%dx%d",
+                         lowres_codecs[c].name, BENCH_FILE_WIDTH, BENCH_FILE_HEIGHT,
+                         surfaces[i][0], surfaces[i][1]);
+            else
+                snprintf(name, sizeof(name), "decode_file/%s/%dx%d/surface:none",
+                         lowres_codecs[c].name, BENCH_FILE_WIDTH, BENCH_FILE_HEIGHT);
+            add(name, file_decode_setup, file_decode_run, file_decode_teardown,
+                surfaces[i][0], surfaces[i][1], lowres_codecs[c].id, NULL)->items = 1;
+        }
+    }
+    for (i = 1; i <= 4; i *= 4) {
+        snprintf(name, sizeof(name), "media_scanner/files:%d/threads:%d", BENCH_SCAN_FILES, i);
+        add(name, scan_setup, scan_run, scan_teardown, 0, 0, i, NULL)->items = BENCH_SCAN_FILES;
+    }
+    for (i = 0; i < (int) FF_ARRAY_ELEMS(sizes); i++) {
+        snprintf(name, sizeof(name), "convert/yuv420p_rgba/%dx%d", sizes[i][0], sizes[i][1]);
+        add(name, convert_setup, convert_run, convert_teardown, sizes[i][0], sizes[i][1], 0,
+            NULL);
+    }
+    /* to the s16 stereo 44.1 kHz of the device */
+    add("audio_decode_frame/s16_44100_stereo", audio_setup, audio_run, audio_teardown, 0, 0, 0,
+        "sine=sample_rate=44100,aformat=sample_fmts=s16:channel_layouts=stereo,asetnsamples=1024");
+    add("audio_decode_frame/fltp_44100_stereo", audio_setup, audio_run, audio_teardown, 0, 0, 0,
+        "sine=sample_rate=44100,aformat=sample_fmts=fltp:channel_layouts=stereo,asetnsamples=1024");
+    add("audio_decode_frame/fltp_44100_mono", audio_setup, audio_run, audio_teardown, 0, 0, 0,
+        "sine=sample_rate=44100,aformat=sample_fmts=fltp:channel_layouts=mono,asetnsamples=1024");
+    add("audio_decode_frame/fltp_48000_5.1", audio_setup, audio_run, audio_teardown, 0, 0, 0,
+        "sine=sample_rate=48000,aformat=sample_fmts=fltp:channel_layouts=5.1,asetnsamples=1024");
+    add("update_sample_display/1024", sample_display_setup, sample_display_run,
+        sample_display_teardown, 0, 0, 0,
+        "sine=sample_rate=44100,aformat=sample_fmts=s16:channel_layouts=stereo,asetnsamples=1024");
+    add("visualizer/update/2048", sample_display_setup, sample_display_run,
+        sample_display_teardown, 0, 0, 1,
+        "sine=sample_rate=44100,aformat=sample_fmts=s16:channel_layouts=stereo,asetnsamples=2048");
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-filter TEXT] [-min-time SECONDS] [-json FILE]\n", name);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL, *json = NULL;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "-filter"))
+            filter = argv[++i];
+        else if (i + 1 < argc && !strcmp(argv[i], "-min-time"))
+            min_time = atof(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-json"))
+            json = argv[++i];
+        else
+            usage(argv[0]);
+    }
+
+    ffmpeg_init();
+    avfilter_register_all();
+    av_log_set_level(AV_LOG_ERROR);
+    platform_log_set_priority(ANDROID_LOG_WARN);
+
+    add_benchmarks();
+    printf("%-40s %15s %15s %12s\n", "benchmark", "time", "cpu", "iterations");
+    for (i = 0; i < nb_benchmarks; i++) {
+        if (!filter || strstr(benchmarks[i].name, filter))
+            run_benchmark(&benchmarks[i]);
+    }
+    if (json && write_json(json, argv[0]) < 0)
+        return 1;
+    return 0;
+}
@@ -0,0 +1,279 @@
+// Plays a file through the whole player, from the demuxer to the sinks, on a
+// workstation, to profile the pipeline without a device:
+//
+//   ffplayer_cli [-fast] [-video null|hash[:FILE]|y4m:FILE] [-audio none|null|hash|wav:FILE]
+//                [-size WxH] [-rate N:D] [-players N] [-trace FILE] [-memory_budget BYTES]
+//                [-loglevel v|d|i|w|e] INPUT
+//
+// -fast plays on virtual time, which goes on as soon as the sinks took what
+// was due, so the file plays as fast as it decodes with the same sync
+// decisions as in real time. -players plays the
+// file on several players at once, the first one focused, to see how they
+// share the cores; the hashing and file sinks are only given to the first one.
+// -trace writes where the time went as Chrome trace JSON. -memory_budget caps
+// what each player holds, the peaks by subsystem are logged when it closes.
+
+#include "../FFPlayer.h"
+#include "../log.h"
+#include "HostSinks.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ffplayer;
+
+#define CLI_MAX_PLAYERS 64
+
+/* where the summary goes, stderr when a sink writes to stdout */
+static FILE *report;
+
+typedef struct CliOptions {
+    const char *input;
+    int fast;
+    const char *video;
+    const char *audio;
+    int width;
+    int height;
+    AVRational rate;
+    int nb_players;
+    const char *trace;
+    int64_t memory_budget;
+} CliOptions;
+
+/* the players still playing, each one tells when it is gone */
+typedef struct CliState {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int nb_running;
+} CliState;
+
+typedef struct CliPlayer {
+    CliState *state;
+    TimeSource *time_source;
+    SinkStats video_stats;
+    SinkStats audio_stats;
+    int64_t end_time;
+} CliPlayer;
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-fast] [-video null|hash[:FILE]|y4m:FILE] "
+            "[-audio none|null|hash|wav:FILE]\n"
+            "          [-size WxH] [-rate N:D] [-players N] [-trace FILE] "
+            "[-memory_budget BYTES]\n"
+            "          [-loglevel v|d|i|w|e] INPUT\n",
+            name);
+    exit(2);
+}
+
+static int parse_log_priority(const char *arg) {
+    switch (arg[0]) {
+        case 'v':
+            return ANDROID_LOG_VERBOSE;
+        case 'd':
+            return ANDROID_LOG_DEBUG;
+        case 'i':
+            return ANDROID_LOG_INFO;
+        case 'w':
+            return ANDROID_LOG_WARN;
+        case 'e':
+            return ANDROID_LOG_ERROR;
+        default:
+            return ANDROID_LOG_SILENT;
+    }
+}
+
+static void parse_options(CliOptions *o, int argc, char **argv) {
+    int i;
+
+    memset(o, 0, sizeof(*o));
+    o->video = "null";
+    o->audio = "null";
+    o->width = 1920;
+    o->height = 1080;
+    o->rate = av_make_q(25, 1);
+    o->nb_players = 1;
+    for (i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (!strcmp(arg, "-fast")) {
+            o->fast = 1;
+        } else if (i + 1 < argc && !strcmp(arg, "-video")) {
+            o->video = argv[++i];
+        } else if (i + 1 < argc && !strcmp(arg, "-audio")) {
+            o->audio = argv[++i];
+        } else if (i + 1 < argc && !strcmp(arg, "-size")) {
+            if (sscanf(argv[++i], "%dx%d", &o->width, &o->height) != 2
+                || o->width <= 0 || o->height <= 0)
+                usage(argv[0]);
+        } else if (i + 1 < argc && !strcmp(arg, "-rate")) {
+            if (sscanf(argv[++i], "%d:%d", &o->rate.num, &o->rate.den) != 2
+                || o->rate.num <= 0 || o->rate.den <= 0)
+                usage(argv[0]);
+        } else if (i + 1 < argc && !strcmp(arg, "-players")) {
+            o->nb_players = atoi(argv[++i]);
+            if (o->nb_players < 1 || o->nb_players > CLI_MAX_PLAYERS)
+                usage(argv[0]);
+        } else if (i + 1 < argc && !strcmp(arg, "-trace")) {
+            o->trace = argv[++i];
+        } else if (i + 1 < argc && !strcmp(arg, "-memory_budget")) {
+            o->memory_budget = strtoll(argv[++i], NULL, 10);
+            if (o->memory_budget < 0)
+                usage(argv[0]);
+        } else if (i + 1 < argc && !strcmp(arg, "-loglevel")) {
+            platform_log_set_priority(parse_log_priority(argv[++i]));
+        } else if (arg[0] == '-' && arg[1]) {
+            usage(argv[0]);
+        } else {
+            o->input = arg;
+        }
+    }
+    if (!o->input)
+        usage(argv[0]);
+}
+
+/* the file after the "kind:" of a sink, NULL if there is none */
+static FILE *open_sink_file(const char *spec, const char *mode, FILE **opened) {
+    const char *path = strchr(spec, ':');
+
+    if (!path)
+        return NULL;
+    path++;
+    if (!strcmp(path, "-")) {
+        report = stderr;
+        return stdout;
+    }
+    if (!(*opened = fopen(path, mode))) {
+        fprintf(stderr, "Could not open %s\n", path);
+        exit(1);
+    }
+    return *opened;
+}
+
+static int sink_is(const char *spec, const char *kind) {
+    size_t len = strlen(kind);
+    return !strncmp(spec, kind, len) && (spec[len] == 0 || spec[len] == ':');
+}
+
+static VideoSink *create_video_sink(const CliOptions *o, int first, SinkStats *stats,
+                                    FILE **opened) {
+    if (first && sink_is(o->video, "hash"))
+        return new HashVideoSink(o->width, o->height, open_sink_file(o->video, "w", opened),
+                                 stats);
+    if (first && sink_is(o->video, "y4m")) {
+        FILE *out = open_sink_file(o->video, "wb", opened);
+        if (!out)
+            usage("ffplayer_cli");
+        return new Y4mVideoSink(o->width, o->height, out, o->rate, stats);
+    }
+    if (!sink_is(o->video, "null") && !sink_is(o->video, "hash") && !sink_is(o->video, "y4m"))
+        usage("ffplayer_cli");
+    return new NullVideoSink(o->width, o->height, stats);
+}
+
+static AudioSink *create_audio_sink(const CliOptions *o, int first, TimeSource *time_source,
+                                    SinkStats *stats, FILE **opened) {
+    if (sink_is(o->audio, "none"))
+        return NULL;
+    if (first && sink_is(o->audio, "hash"))
+        return new HashAudioSink(time_source, stats);
+    if (first && sink_is(o->audio, "wav")) {
+        FILE *out = open_sink_file(o->audio, "wb", opened);
+        if (!out)
+            usage("ffplayer_cli");
+        return new WavAudioSink(time_source, out, stats);
+    }
+    if (!sink_is(o->audio, "null") && !sink_is(o->audio, "hash") && !sink_is(o->audio, "wav"))
+        usage("ffplayer_cli");
+    return new NullAudioSink(time_source, stats);
+}
+
+static void player_exited(void *opaque) {
+    CliPlayer *p = (CliPlayer *) opaque;
+
+    pthread_mutex_lock(&p->state->mutex);
+    p->end_time = av_gettime_relative();
+    p->state->nb_running--;
+    pthread_cond_signal(&p->state->cond);
+    pthread_mutex_unlock(&p->state->mutex);
+}
+
+int main(int argc, char **argv) {
+    static CliPlayer players[CLI_MAX_PLAYERS];
+    CliOptions o;
+    CliState state;
+    FILE *video_file = NULL, *audio_file = NULL;
+    int64_t start_time, total_frames = 0;
+    double elapsed;
+    int i;
+
+    report = stdout;
+    parse_options(&o, argc, argv);
+    pthread_mutex_init(&state.mutex, NULL);
+    pthread_cond_init(&state.cond, NULL);
+    state.nb_running = o.nb_players;
+
+    if (o.trace)
+        trace_start();
+    start_time = av_gettime_relative();
+    for (i = 0; i < o.nb_players; i++) {
+        CliPlayer *p = &players[i];
+        FFPlayer *player = new FFPlayer();
+        AudioSink *audio_sink;
+
+        p->state = &state;
+        /* one each, so that a player does not wait for the others */
+        p->time_source = o.fast ? new VirtualTimeSource() : time_source_system();
+        player->setTimeSource(p->time_source);
+        player->setDataSource(o.input);
+        player->setVideoSink(create_video_sink(&o, i == 0, &p->video_stats, &video_file));
+        if ((audio_sink = create_audio_sink(&o, i == 0, p->time_source, &p->audio_stats,
+                                            &audio_file)))
+            player->setAudioSink(audio_sink);
+        player->setFocused(i == 0);
+        player->setMemoryBudget(o.memory_budget);
+        player->setAutoExit(true);
+        player->setOnExit(player_exited, p);
+        player->prepare();
+    }
+
+    pthread_mutex_lock(&state.mutex);
+    while (state.nb_running > 0)
+        pthread_cond_wait(&state.cond, &state.mutex);
+    pthread_mutex_unlock(&state.mutex);
+
+    if (o.trace) {
+        trace_stop();
+        if (trace_write(o.trace) < 0)
+            fprintf(stderr, "Could not write the trace to %s\n", o.trace);
+    }
+
+    for (i = 0; i < o.nb_players; i++) {
+        CliPlayer *p = &players[i];
+        elapsed = (p->end_time - start_time) / 1000000.0;
+        total_frames += p->video_stats.frames;
+        fprintf(report, "player %d: %" PRId64 " pictures, %" PRId64 " sample frames in %.3f s, %.1f fps\n",
+               i, p->video_stats.frames, p->audio_stats.frames, elapsed,
+               elapsed > 0 ? p->video_stats.frames / elapsed : 0.0);
+    }
+    elapsed = (av_gettime_relative() - start_time) / 1000000.0;
+    if (o.nb_players > 1)
+        fprintf(report, "all: %" PRId64 " pictures in %.3f s, %.1f fps\n", total_frames, elapsed,
+               elapsed > 0 ? total_frames / elapsed : 0.0);
+    if (players[0].video_stats.md5[0])
+        fprintf(report, "video md5: %s\n", players[0].video_stats.md5);
+    if (players[0].audio_stats.md5[0])
+        fprintf(report, "audio md5: %s\n", players[0].audio_stats.md5);
+
+    /* the players that used them are gone */
+    if (o.fast) {
+        for (i = 0; i < o.nb_players; i++)
+            delete players[i].time_source;
+    }
+
+    if (video_file)
+        fclose(video_file);
+    if (audio_file)
+        fclose(audio_file);
+    return 0;
+}
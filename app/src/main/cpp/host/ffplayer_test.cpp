@@ -0,0 +1,323 @@
+// Checks of the player primitives on a workstation:
+//
+//   ffplayer_test [-filter TEXT]
+//
+// Built like ffplayer_bench, with FFPlayer.cpp in this file to reach its
+// static functions, on media made by the lavfi sources. Each test prints ok
+// or what failed, the exit status is 1 if any failed.
+
+#include "../FFPlayer.cpp"
+#include "LavfiMedia.h"
+
+extern "C" {
+#include "libavfilter/avfilter.h"
+}
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+/* the media written by the tests go there */
+#define TEST_DIR "/tmp"
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            return -1; \
+        } \
+    } while (0)
+
+typedef struct Test {
+    const char *name;
+    int (*run)();
+} Test;
+
+/* ---- seeking ---- */
+
+#define TEST_SEEK_FRAMES 50
+#define TEST_SEEK_GOP 12
+
+/* the window of an exact seek must hold the keyframe before the target, or
+ * step-back, leaving reverse and leaving trick-play never seek */
+static int seek_exact_run(AVFormatContext *ic, VideoState *is, double target) {
+    AVStream *st = ic->streams[0];
+    int64_t seek_min, seek_max;
+    AVPacket pkt;
+    double pts;
+    int ret;
+
+    stream_seek_exact(is, target);
+    CHECK(is->seek_req && is->seek_exact);
+    seek_bounds(is, &seek_min, &seek_max);
+    CHECK(seek_min <= is->seek_pos && is->seek_pos <= seek_max);
+    ret = avformat_seek_file(ic, -1, seek_min, is->seek_pos, seek_max, is->seek_flags);
+    is->seek_req = 0;
+    is->seek_exact = 0;
+    CHECK(ret >= 0);
+
+    CHECK(av_read_frame(ic, &pkt) >= 0);
+    pts = packet_ts(&pkt) * av_q2d(st->time_base);
+    ret = pkt.flags & AV_PKT_FLAG_KEY;
+    av_free_packet(&pkt);
+    /* the keyframe that starts the GOP of the target, no later */
+    CHECK(ret);
+    CHECK(pts <= target + FRAME_SEEK_MARGIN);
+    CHECK(pts > target - TEST_SEEK_GOP / 25.0);
+    return 0;
+}
+
+static int test_seek_exact() {
+    char path[] = TEST_DIR "/ffplayer_test_XXXXXX";
+    AVFormatContext *ic = NULL;
+    VideoState *is = (VideoState *) av_mallocz(sizeof(VideoState));
+    int fd, ret = -1;
+
+    if (!is || (fd = mkstemp(path)) < 0) {
+        av_free(is);
+        return -1;
+    }
+    close(fd);
+    is->continue_read_thread = PTHREAD_COND_INITIALIZER;
+    if (testsrc_write_file(path, AV_CODEC_ID_MPEG4, 320, 240, TEST_SEEK_FRAMES, TEST_SEEK_GOP) < 0
+        || avformat_open_input(&ic, path, NULL, NULL) < 0
+        || avformat_find_stream_info(ic, NULL) < 0)
+        goto end;
+    /* in the middle of a GOP, backwards, and at a keyframe */
+    if (seek_exact_run(ic, is, 40 / 25.0) < 0
+        || seek_exact_run(ic, is, 30 / 25.0) < 0
+        || seek_exact_run(ic, is, 2 * TEST_SEEK_GOP / 25.0) < 0)
+        goto end;
+    ret = 0;
+end:
+    avformat_close_input(&ic);
+    av_free(is);
+    unlink(path);
+    return ret;
+}
+
+/* ---- visualizer ---- */
+
+#define TEST_SINE_RATE 44100
+/* a sine at the center of a bin, off-center the window loses up to 1.4 dB */
+#define TEST_SINE_BIN 93
+
+/* a full scale stereo sine shows at 0 dB in its bin and fills the peaks */
+static int test_visualizer_sine() {
+    AudioVisualizer *v = audio_visualizer_create(2, 0);
+    int nb_frames = 2 * VISUALIZER_FFT_SIZE;
+    int16_t *samples = (int16_t *) av_malloc_array(2 * nb_frames, sizeof(*samples));
+    VisualizerFrame *frame = (VisualizerFrame *) av_mallocz(sizeof(*frame));
+    double freq = TEST_SINE_BIN * (double) TEST_SINE_RATE / VISUALIZER_FFT_SIZE;
+    float min = 0, max = 0;
+    int i, k, ret = -1;
+
+    if (!v || !samples || !frame)
+        goto end;
+    for (i = 0; i < nb_frames; i++)
+        samples[2 * i] = samples[2 * i + 1] =
+                (int16_t) lrint(32767 * sin(2 * M_PI * freq * i / TEST_SINE_RATE));
+    audio_visualizer_write(v, samples, 2 * nb_frames);
+    if (!audio_visualizer_update(v) || !audio_visualizer_read(v, frame) || frame->count != 1)
+        goto end;
+
+    if (fabsf(frame->spectrum[TEST_SINE_BIN]) > 1.0f) {
+        fprintf(stderr, "bin %d at %.2f dB\n", TEST_SINE_BIN, frame->spectrum[TEST_SINE_BIN]);
+        goto end;
+    }
+    for (k = 0; k < VISUALIZER_BINS; k++)
+        if (frame->spectrum[k] > frame->spectrum[TEST_SINE_BIN]) {
+            fprintf(stderr, "bin %d above bin %d\n", k, TEST_SINE_BIN);
+            goto end;
+        }
+    for (i = 0; i < 2 * VISUALIZER_PEAKS; i++) {
+        if (frame->peaks[i] < -1.0f || frame->peaks[i] > 1.0f) {
+            fprintf(stderr, "peak %d at %f\n", i, frame->peaks[i]);
+            goto end;
+        }
+        min = FFMIN(min, frame->peaks[i]);
+        max = FFMAX(max, frame->peaks[i]);
+    }
+    if (min > -0.99f || max < 0.99f) {
+        fprintf(stderr, "peaks from %f to %f\n", min, max);
+        goto end;
+    }
+    ret = 0;
+end:
+    if (v)
+        audio_visualizer_destroy(v);
+    av_free(samples);
+    av_free(frame);
+    return ret;
+}
+
+/* ---- stream info cache ---- */
+
+#define TEST_STREAM_INFO_FRAMES 25
+#define TEST_STREAM_INFO_GOP 12
+
+static void stream_info_cache_cleanup(const char *path, const char *dir) {
+    struct dirent *e;
+    DIR *d;
+
+    unlink(path);
+    if ((d = opendir(dir))) {
+        while ((e = readdir(d))) {
+            char *p;
+            if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+                continue;
+            if ((p = av_asprintf("%s/%s", dir, e->d_name)))
+                unlink(p);
+            av_free(p);
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+/* writes a media to path, probes it into probed and caches its stream info in dir */
+static int stream_info_cache_prepare(char *path, char *dir, AVFormatContext **probed) {
+    int fd;
+
+    if ((fd = mkstemp(path)) < 0)
+        return -1;
+    close(fd);
+    if (!mkdtemp(dir)) {
+        unlink(path);
+        return -1;
+    }
+    if (testsrc_write_file(path, AV_CODEC_ID_MPEG4, 320, 240, TEST_STREAM_INFO_FRAMES,
+                           TEST_STREAM_INFO_GOP) < 0
+        || avformat_open_input(probed, path, NULL, NULL) < 0
+        || avformat_find_stream_info(*probed, NULL) < 0
+        || stream_info_cache_save(dir, path, *probed) < 0) {
+        avformat_close_input(probed);
+        stream_info_cache_cleanup(path, dir);
+        return -1;
+    }
+    return 0;
+}
+
+/* opens path as read_thread does with a cache, 1 if its stream info was restored */
+static int stream_info_cache_open(const char *dir, const char *path, AVFormatContext **ic) {
+    if (avformat_open_input(ic, path, NULL, NULL) < 0)
+        return -1;
+    return stream_info_cache_load(dir, path, *ic);
+}
+
+/* the restored parameters are the probed ones */
+static int stream_info_compare(AVFormatContext *ic, AVFormatContext *probed) {
+    unsigned i;
+
+    CHECK(ic->nb_streams == probed->nb_streams);
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *a = ic->streams[i], *b = probed->streams[i];
+        CHECK(a->codec->codec_type == b->codec->codec_type);
+        CHECK(a->codec->codec_id == b->codec->codec_id);
+        CHECK(a->codec->pix_fmt == b->codec->pix_fmt);
+        CHECK(a->codec->width == b->codec->width && a->codec->height == b->codec->height);
+        CHECK(a->codec->has_b_frames == b->codec->has_b_frames);
+        CHECK(a->codec->profile == b->codec->profile && a->codec->level == b->codec->level);
+        CHECK(a->codec->extradata_size == b->codec->extradata_size);
+        CHECK(!b->codec->extradata_size
+              || !memcmp(a->codec->extradata, b->codec->extradata, b->codec->extradata_size));
+        CHECK(!av_cmp_q(a->time_base, b->time_base));
+        CHECK(!av_cmp_q(a->sample_aspect_ratio, b->sample_aspect_ratio));
+        CHECK(!av_cmp_q(a->r_frame_rate, b->r_frame_rate));
+        CHECK(!av_cmp_q(a->avg_frame_rate, b->avg_frame_rate));
+        CHECK(a->codec_info_nb_frames == b->codec_info_nb_frames);
+    }
+    return 0;
+}
+
+/* a plain open restores what avformat_find_stream_info found */
+static int test_stream_info_roundtrip() {
+    char path[] = TEST_DIR "/ffplayer_test_XXXXXX";
+    char dir[] = TEST_DIR "/ffplayer_test_si_XXXXXX";
+    AVFormatContext *probed = NULL, *ic = NULL;
+    int ret = -1;
+
+    if (stream_info_cache_prepare(path, dir, &probed) < 0)
+        return -1;
+    if (stream_info_cache_open(dir, path, &ic) != 1 || stream_info_compare(ic, probed) < 0)
+        goto end;
+    ret = 0;
+end:
+    avformat_close_input(&ic);
+    avformat_close_input(&probed);
+    stream_info_cache_cleanup(path, dir);
+    return ret;
+}
+
+/* a file touched since it was cached is probed again: a later mtime, then
+ * its own mtime with another size */
+static int test_stream_info_invalidate() {
+    char path[] = TEST_DIR "/ffplayer_test_XXXXXX";
+    char dir[] = TEST_DIR "/ffplayer_test_si_XXXXXX";
+    AVFormatContext *probed = NULL, *ic = NULL;
+    struct utimbuf times;
+    struct stat st;
+    FILE *f;
+    int ret = -1;
+
+    if (stream_info_cache_prepare(path, dir, &probed) < 0)
+        return -1;
+    if (stat(path, &st) < 0)
+        goto end;
+    times.actime = st.st_atime;
+    times.modtime = st.st_mtime + 10;
+    if (utime(path, &times) < 0 || stream_info_cache_open(dir, path, &ic) != 0)
+        goto end;
+    avformat_close_input(&ic);
+
+    if (!(f = fopen(path, "ab")))
+        goto end;
+    fputc(0, f);
+    fclose(f);
+    times.modtime = st.st_mtime;
+    if (utime(path, &times) < 0 || stream_info_cache_open(dir, path, &ic) != 0)
+        goto end;
+    ret = 0;
+end:
+    avformat_close_input(&ic);
+    avformat_close_input(&probed);
+    stream_info_cache_cleanup(path, dir);
+    return ret;
+}
+
+static const Test tests[] = {
+        {"seek/exact", test_seek_exact},
+        {"visualizer/sine", test_visualizer_sine},
+        {"streaminfo/roundtrip", test_stream_info_roundtrip},
+        {"streaminfo/invalidate", test_stream_info_invalidate},
+};
+
+int main(int argc, char **argv) {
+    const char *filter = NULL;
+    int i, failed = 0;
+
+    if (argc == 3 && !strcmp(argv[1], "-filter")) {
+        filter = argv[2];
+    } else if (argc != 1) {
+        fprintf(stderr, "usage: %s [-filter TEXT]\n", argv[0]);
+        return 2;
+    }
+
+    ffmpeg_init();
+    avfilter_register_all();
+    av_log_set_level(AV_LOG_ERROR);
+    platform_log_set_priority(ANDROID_LOG_WARN);
+
+    for (i = 0; i < (int) FF_ARRAY_ELEMS(tests); i++) {
+        if (filter && !strstr(tests[i].name, filter))
+            continue;
+        if (tests[i].run() < 0) {
+            printf("FAIL %s\n", tests[i].name);
+            failed++;
+        } else {
+            printf("ok   %s\n", tests[i].name);
+        }
+    }
+    return failed ? 1 : 0;
+}
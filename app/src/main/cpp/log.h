@@ -5,12 +5,45 @@
 #ifndef MYPLAYER_LOG_H
 #define MYPLAYER_LOG_H
 
+#include <stdarg.h>
+
+#ifdef __ANDROID__
 #include <android/log.h>
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+#ifndef __ANDROID__
+/* the priorities of android/log.h, for the host build */
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+#endif
+
+/*
+ * Write a log line to logcat on Android, to stderr on a workstation.
+ */
+int platform_log_print(int prio, const char *tag, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+
+int platform_log_vprint(int prio, const char *tag, const char *fmt, va_list args);
+
+/*
+ * The lowest priority written to stderr by the host build, ANDROID_LOG_INFO
+ * by default. Android filters in logcat instead.
+ */
+void platform_log_set_priority(int prio);
+
 // ---------------------------------------------------------------------
 
 /*
@@ -236,7 +269,7 @@ extern "C" {
  */
 #ifndef LOG_PRI
 #define LOG_PRI(priority, tag, ...) \
-    __android_log_print(priority, tag, __VA_ARGS__)
+    platform_log_print(priority, tag, __VA_ARGS__)
 #endif
 
 /*
@@ -244,7 +277,7 @@ extern "C" {
  */
 #ifndef LOG_PRI_VA
 #define LOG_PRI_VA(priority, tag, fmt, args) \
-    __android_log_vprint(priority, NULL, tag, fmt, args)
+    platform_log_vprint(priority, tag, fmt, args)
 #endif
 
 /*
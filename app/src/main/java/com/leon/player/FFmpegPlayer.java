@@ -2,11 +2,84 @@ package com.leon.player;
 
 import android.view.Surface;
 
+import java.io.IOException;
+
 /**
  * Created by mayongbin on 16/5/23.
  */
 public class FFmpegPlayer {
 
+    /* indices into getStartupReport() */
+    public static final int STARTUP_PREPARE = 0;
+    public static final int STARTUP_READ_THREAD = 1;
+    public static final int STARTUP_OPEN = 2;
+    public static final int STARTUP_PROBE = 3;
+    public static final int STARTUP_CODEC_OPEN = 4;
+    public static final int STARTUP_AUDIO_DEVICE = 5;
+    public static final int STARTUP_FIRST_DECODE = 6;
+    public static final int STARTUP_FIRST_CONVERT = 7;
+    public static final int STARTUP_FIRST_DISPLAY = 8;
+    public static final int STARTUP_FIRST_AUDIO = 9;
+    public static final int STARTUP_STREAM_INFO_CACHED = 10;
+
+    /* indices into getStats(), times in microseconds */
+    public static final int STATS_MASTER_CLOCK = 0;
+    public static final int STATS_AV_DIFF = 1;
+    public static final int STATS_AUDIOQ_BYTES = 2;
+    public static final int STATS_VIDEOQ_BYTES = 3;
+    public static final int STATS_SUBTITLEQ_BYTES = 4;
+    public static final int STATS_AUDIOQ_DURATION = 5;
+    public static final int STATS_VIDEOQ_DURATION = 6;
+    public static final int STATS_PICTQ_FRAMES = 7;
+    public static final int STATS_SAMPQ_FRAMES = 8;
+    public static final int STATS_DECODE_P50 = 9;
+    public static final int STATS_DECODE_P90 = 10;
+    public static final int STATS_DECODE_P99 = 11;
+    public static final int STATS_CONVERT_P50 = 12;
+    public static final int STATS_CONVERT_P90 = 13;
+    public static final int STATS_CONVERT_P99 = 14;
+    public static final int STATS_FRAMES_DISPLAYED = 15;
+    public static final int STATS_DROPS_EARLY = 16;
+    public static final int STATS_DROPS_LATE = 17;
+    public static final int STATS_AUDIO_UNDERRUNS = 18;
+    public static final int STATS_FAULTY_DTS = 19;
+    public static final int STATS_FAULTY_PTS = 20;
+    public static final int STATS_BITRATE = 21;
+    /* 13 counts of updates by A-V drift: < -160 ms, -160, -80, -40, -20, -10,
+     * -5 to 5, 5, 10, 20, 40, 80, >= 160 ms */
+    public static final int STATS_DRIFT = 22;
+    public static final int STATS_FIELD_NB = 35;
+
+    /* what setShowMode() shows */
+    public static final int SHOW_MODE_NONE = -1;
+    public static final int SHOW_MODE_VIDEO = 0;
+    public static final int SHOW_MODE_WAVES = 1;
+    public static final int SHOW_MODE_RDFT = 2;
+
+    /* what getVisualization() fills, bin k of the spectrum is at
+     * k * sampleRate / VISUALIZER_FFT_SIZE Hz */
+    public static final int VISUALIZER_FFT_SIZE = 2048;
+    public static final int VISUALIZER_BINS = 1024;
+    public static final int VISUALIZER_PEAKS = 128;
+
+    /* what the memory of a player is for, getMemoryReport() has the live
+     * bytes of a tag at 2 * tag and its peak at 2 * tag + 1 */
+    public static final int MEMORY_PACKETS = 0;
+    public static final int MEMORY_BACK_BUFFER = 1;
+    public static final int MEMORY_PICTURES = 2;
+    public static final int MEMORY_FRAME_CACHE = 3;
+    public static final int MEMORY_DECODERS = 4;
+    public static final int MEMORY_AUDIO = 5;
+    public static final int MEMORY_SUBTITLES = 6;
+    public static final int MEMORY_PLAYER = 7;
+    public static final int MEMORY_REVERSE = 8;
+    public static final int MEMORY_SUBTITLE_INDEX = 9;
+    public static final int MEMORY_TAG_NB = 10;
+    public static final int MEMORY_REPORT_TOTAL = 20;
+    public static final int MEMORY_REPORT_TOTAL_PEAK = 21;
+    public static final int MEMORY_REPORT_BUDGET = 22;
+    public static final int MEMORY_REPORT_NB = 23;
+
     static {
         System.loadLibrary("ffmpegPlayer");
         native_init();
@@ -48,10 +121,231 @@ public class FFmpegPlayer {
         native_setSurface(surface);
     }
 
+    /**
+     * Keep up to the given amount of already played media in memory, so short
+     * backward seeks do not have to go back to the source.
+     */
+    public void setBackBuffer(int milliseconds, int bytes) {
+        native_setBackBuffer(milliseconds, bytes);
+    }
+
+    /**
+     * Memory used to keep recently decoded frames, which makes stepping
+     * backwards frame by frame cheap.
+     */
+    public void setFrameCacheSize(int bytes) {
+        native_setFrameCacheSize(bytes);
+    }
+
+    /**
+     * Pause and show the next frame.
+     */
+    public void stepForward() {
+        native_stepForward();
+    }
+
+    /**
+     * Pause and show the previous frame.
+     */
+    public void stepBackward() {
+        native_stepBackward();
+    }
+
+    /**
+     * Play backwards from the current picture at the given speed, 1.0 or 2.0
+     * typically. The audio is muted meanwhile. A speed of 0 plays forward again.
+     */
+    public void setReversePlayback(float speed) {
+        native_setReversePlayback(speed);
+    }
+
+    /**
+     * Fast forward (speed > 0) or rewind (speed < 0) showing keyframes only,
+     * e.g. at 4x to 32x, with the audio muted. A speed of 0 plays normally again.
+     */
+    public void setTrickPlay(int speed) {
+        native_setTrickPlay(speed);
+    }
+
+    /**
+     * Loop the whole file without a gap between the end and the start.
+     */
+    public void setLooping(boolean looping) {
+        native_setLooping(looping);
+    }
+
+    /**
+     * Loop between the two positions without a gap. An end not after the
+     * start clears the range.
+     */
+    public void setLoopRange(int startMilliseconds, int endMilliseconds) {
+        native_setLoopRange(startMilliseconds, endMilliseconds);
+    }
+
+    /**
+     * Tell the player the size of the surface the video is shown in, e.g. from
+     * surfaceChanged. Codecs that can decode at a lower resolution then decode
+     * at the smallest one still covering the surface.
+     */
+    public void setSurfaceSize(int width, int height) {
+        native_setSurfaceSize(width, height);
+    }
+
+    /**
+     * Switch to the next subtitle track, or off after the last one. Local files
+     * show the cue of the new track right away once their subtitles are indexed.
+     */
+    public void cycleSubtitleTrack() {
+        native_cycleSubtitleTrack();
+    }
+
+    /**
+     * Keep what probing finds about local files in this directory, e.g. under
+     * getCacheDir(), so that opening the same unchanged file again starts
+     * without probing. Null turns the cache off.
+     */
+    public void setStreamInfoCacheDir(String dir) {
+        native_setStreamInfoCacheDir(dir);
+    }
+
+    /**
+     * Preload instead of playing: when no surface is set, prepare() stops once
+     * the first frame is decoded, paused, with at most this many bytes of
+     * packets read ahead. Can be changed while preloading. See {@link PlayerPool}.
+     */
+    public void setPreloadBudget(int bytes) {
+        native_setPreloadBudget(bytes);
+    }
+
+    /**
+     * SHOW_MODE_VIDEO by default. SHOW_MODE_NONE stops drawing the pictures,
+     * the waves and the spectrum modes run the visualizer, see
+     * {@link #getVisualization}, which is freed once back to another mode.
+     */
+    public void setShowMode(int mode) {
+        native_setShowMode(mode);
+    }
+
+    /**
+     * The most memory the player should hold, 0 for no limit. To stay under
+     * it the frame cache shrinks first, then the frames decoded ahead to play
+     * backwards, down to two per chunk, then the back-buffer and the packets
+     * read ahead, which still keep about a megabyte. The subtitle index is
+     * counted but never shrunk. Can be changed while playing.
+     */
+    public void setMemoryBudget(long bytes) {
+        native_setMemoryBudget(bytes);
+    }
+
+    /**
+     * The live and peak bytes the player holds by MEMORY_ tag, then the
+     * totals and the budget. The decoders and the reverse frames are estimates, and what FFmpeg
+     * allocates for itself otherwise is not counted. The values go in report
+     * if it has room for MEMORY_REPORT_NB, otherwise in a new array.
+     */
+    public long[] getMemoryReport(long[] report) {
+        return native_getMemoryReport(report);
+    }
+
+    /**
+     * Update the spectrum and the waveform this many times a second, on a
+     * low priority thread so that the audio does not wait for them. 0, the
+     * default, only updates them 30 times a second while the waves or the
+     * spectrum are shown. Can be changed while playing.
+     */
+    public void setVisualizationRate(int rate) {
+        native_setVisualizationRate(rate);
+    }
+
+    /**
+     * The latest spectrum, VISUALIZER_BINS dB values of the last
+     * VISUALIZER_FFT_SIZE samples with 0 for a full scale sine, and their
+     * waveform, the min and the max of each of VISUALIZER_PEAKS slices.
+     * Returns the sample rate, or 0 and leaves the arrays alone when there is
+     * nothing yet or a new frame was being published. Does not allocate, it can be called on every frame drawn.
+     */
+    public int getVisualization(float[] spectrum, float[] peaks) {
+        return native_getVisualization(spectrum, peaks);
+    }
+
+    /**
+     * Show a preloaded player on the surface and start playing it from the
+     * frame it has already decoded.
+     */
+    public void promote(Surface surface) {
+        native_promote(surface);
+    }
+
+    /**
+     * Whether the player is the one the user looks at, true by default. The
+     * conversion work of focused players runs first on the thread pool shared
+     * by all the players, and the codec threads are shared out in their favour.
+     */
+    public void setFocused(boolean focused) {
+        native_setFocused(focused);
+    }
+
+    /**
+     * Open the video decoder before the audio one and create the audio player
+     * in the background, so that the first frame is shown without waiting for
+     * the audio device. Takes effect at the next prepare().
+     */
+    public void setFastStart(boolean fastStart) {
+        native_setFastStart(fastStart);
+    }
+
+    /**
+     * Where the start-up time went: for each STARTUP_ phase the milliseconds
+     * from prepare() until it was reached, -1 if it was not (yet), then 1 at
+     * STARTUP_STREAM_INFO_CACHED if the stream info came from the cache.
+     */
+    public long[] getStartupReport() {
+        return native_getStartupReport();
+    }
+
+    /**
+     * The playback statistics of the player, refreshed every 30 ms, as the
+     * STATS_ values: queue depths, decode and conversion time percentiles
+     * over the last seconds, frame drops, audio underruns, the A-V drift
+     * histogram and the bitrate read. Reading them never waits for the
+     * player. The values go in stats if it has room for STATS_FIELD_NB,
+     * so that polling does not allocate, otherwise in a new array.
+     */
+    public long[] getStats(long[] stats) {
+        return native_getStats(stats);
+    }
+
+    /**
+     * State of the video decode degradation: the current level (0 full quality,
+     * 1 no loop filter, 2 no non-reference frames, 3 lower resolution,
+     * 4 keyframes only), the number of steps down and back up, the decode load
+     * in percent of the frame duration, then the milliseconds spent at each level.
+     */
+    public int[] getDecodeMetrics() {
+        return native_getDecodeMetrics();
+    }
+
     public int getDuration() {
         return native_getDuration();
     }
 
+    /**
+     * Record where the time of demuxing, decoding, conversion, display and the
+     * audio callback goes, for all the players of the process, until
+     * {@link #stopTracing}. Starting again drops what was recorded.
+     */
+    public static void startTracing() {
+        native_startTracing();
+    }
+
+    /**
+     * Stop recording and write the capture to path as Chrome trace JSON, to
+     * open in chrome://tracing or Perfetto. Null only stops.
+     */
+    public static void stopTracing(String path) throws IOException {
+        native_stopTracing(path);
+    }
+
     @Override
     protected void finalize() throws Throwable {
         native_finalize();
@@ -75,7 +369,57 @@ public class FFmpegPlayer {
 
     private native void native_setSurface(Surface surface);
 
+    private native void native_setBackBuffer(int milliseconds, int bytes);
+
+    private native void native_setFrameCacheSize(int bytes);
+
+    private native void native_stepForward();
+
+    private native void native_stepBackward();
+
+    private native void native_setReversePlayback(float speed);
+
+    private native void native_setTrickPlay(int speed);
+
+    private native void native_setLooping(boolean looping);
+
+    private native void native_setLoopRange(int startMilliseconds, int endMilliseconds);
+
+    private native void native_setSurfaceSize(int width, int height);
+
+    private native void native_cycleSubtitleTrack();
+
+    private native void native_setStreamInfoCacheDir(String dir);
+
+    private native void native_setPreloadBudget(int bytes);
+
+    private native void native_setMemoryBudget(long bytes);
+
+    private native void native_setShowMode(int mode);
+
+    private native void native_promote(Surface surface);
+
+    private native void native_setFocused(boolean focused);
+
+    private native void native_setFastStart(boolean fastStart);
+
+    private native long[] native_getStartupReport();
+
+    private native long[] native_getStats(long[] stats);
+
+    private native long[] native_getMemoryReport(long[] report);
+
+    private native void native_setVisualizationRate(int rate);
+
+    private native int native_getVisualization(float[] spectrum, float[] peaks);
+
+    private native int[] native_getDecodeMetrics();
+
     private native int native_getDuration();
 
+    private static native void native_startTracing();
+
+    private static native void native_stopTracing(String path) throws IOException;
+
     private native void native_finalize();
 }
@@ -0,0 +1,72 @@
+package com.leon.player;
+
+import java.io.IOException;
+
+/**
+ * Metadata of many media files without preparing a player for each. A scan
+ * probes the files in parallel and stores what it finds in a small database
+ * file, which is then memory-mapped for lookups.
+ */
+public class MediaLibrary {
+
+    public static final int INFO_DURATION_MS = 0;
+    public static final int INFO_WIDTH = 1;
+    public static final int INFO_HEIGHT = 2;
+    public static final int INFO_BIT_RATE = 3;
+    public static final int INFO_VIDEO_CODEC = 4;
+    public static final int INFO_AUDIO_CODEC = 5;
+    public static final int INFO_SAMPLE_RATE = 6;
+    public static final int INFO_CHANNELS = 7;
+    public static final int INFO_POSTER_MS = 8;
+
+    static {
+        System.loadLibrary("ffmpegPlayer");
+        native_init();
+    }
+
+    private long mNativeLibrary;
+
+    /**
+     * Probe the files on the given number of threads and replace the database
+     * with the result. Files unchanged since the last scan, by modification
+     * time and size, are not probed again.
+     *
+     * @return the number of files probed
+     */
+    public static int scan(String dbPath, String[] paths, int threads) throws IOException {
+        return native_scan(dbPath, paths, threads);
+    }
+
+    public MediaLibrary(String dbPath) throws IOException {
+        native_setup(dbPath);
+    }
+
+    /**
+     * The metadata of a file, indexed by the INFO_ constants, or null if the
+     * file was not scanned, changed since, or could not be probed. Durations
+     * and the poster time are -1 when unknown; the poster time is the keyframe
+     * to show for the file, e.g. with a {@link ThumbnailExtractor}.
+     */
+    public long[] getInfo(String path) {
+        return native_getInfo(path);
+    }
+
+    public void release() {
+        native_release();
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        native_release();
+    }
+
+    private static native void native_init();
+
+    private static native int native_scan(String dbPath, String[] paths, int threads);
+
+    private native void native_setup(String dbPath);
+
+    private native long[] native_getInfo(String path);
+
+    private native void native_release();
+}
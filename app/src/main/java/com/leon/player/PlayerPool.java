@@ -0,0 +1,112 @@
+package com.leon.player;
+
+import android.view.Surface;
+
+import java.util.Iterator;
+import java.util.LinkedHashMap;
+
+/**
+ * Players for the next sources of a feed, prepared ahead up to their first
+ * decoded frame so that showing one starts at once. The preloaded players
+ * are paused, read no further than their share of the memory budget and
+ * have no audio output until promoted.
+ */
+public class PlayerPool {
+
+    private final int mCapacity;
+    private final int mMemoryBudget;
+    private int mSurfaceWidth;
+    private int mSurfaceHeight;
+    // in preload order, the oldest is evicted first
+    private final LinkedHashMap<String, FFmpegPlayer> mPlayers = new LinkedHashMap<>();
+
+    /**
+     * @param capacity     how many sources to keep preloaded
+     * @param memoryBudget bytes of read-ahead shared by the preloaded players
+     */
+    public PlayerPool(int capacity, int memoryBudget) {
+        mCapacity = capacity;
+        mMemoryBudget = memoryBudget;
+    }
+
+    /**
+     * The size of the surface the players will be shown in, so that they
+     * decode at a fitting resolution from the start.
+     */
+    public synchronized void setSurfaceSize(int width, int height) {
+        mSurfaceWidth = width;
+        mSurfaceHeight = height;
+    }
+
+    /**
+     * Start preparing the source in the background, evicting the oldest
+     * preloaded one if the pool is full.
+     */
+    public synchronized void preload(String path) {
+        if (mPlayers.containsKey(path))
+            return;
+        while (mPlayers.size() >= mCapacity && !mPlayers.isEmpty())
+            evictOldest();
+        if (mCapacity <= 0)
+            return;
+
+        FFmpegPlayer player = new FFmpegPlayer();
+        player.setDataSource(path);
+        player.setFocused(false);
+        if (mSurfaceWidth > 0 && mSurfaceHeight > 0)
+            player.setSurfaceSize(mSurfaceWidth, mSurfaceHeight);
+        player.setPreloadBudget(mMemoryBudget / (mPlayers.size() + 1));
+        player.prepare();
+        mPlayers.put(path, player);
+        rebalance();
+    }
+
+    /**
+     * Take the player of the source out of the pool, shown on the surface and
+     * playing. A source that was not preloaded is prepared now.
+     */
+    public synchronized FFmpegPlayer promote(String path, Surface surface) {
+        FFmpegPlayer player = mPlayers.remove(path);
+        if (player == null) {
+            player = new FFmpegPlayer();
+            player.setDataSource(path);
+            player.setSurface(surface);
+            player.prepare();
+            return player;
+        }
+        player.setFocused(true);
+        player.promote(surface);
+        rebalance();
+        return player;
+    }
+
+    /** Drop the preloaded player of the source, if any. */
+    public synchronized void evict(String path) {
+        FFmpegPlayer player = mPlayers.remove(path);
+        if (player != null) {
+            player.release();
+            rebalance();
+        }
+    }
+
+    public synchronized void clear() {
+        for (FFmpegPlayer player : mPlayers.values())
+            player.release();
+        mPlayers.clear();
+    }
+
+    private void evictOldest() {
+        Iterator<FFmpegPlayer> it = mPlayers.values().iterator();
+        FFmpegPlayer player = it.next();
+        it.remove();
+        player.release();
+    }
+
+    private void rebalance() {
+        if (mPlayers.isEmpty())
+            return;
+        int share = mMemoryBudget / mPlayers.size();
+        for (FFmpegPlayer player : mPlayers.values())
+            player.setPreloadBudget(share);
+    }
+}
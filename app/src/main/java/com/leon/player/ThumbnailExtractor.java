@@ -0,0 +1,68 @@
+package com.leon.player;
+
+import java.io.IOException;
+
+/**
+ * Small previews of a video for a seek bar, taken from its keyframes. It
+ * reads the file on its own, so it can be used next to a playing
+ * {@link FFmpegPlayer} of the same file without disturbing it.
+ */
+public class ThumbnailExtractor {
+
+    static {
+        System.loadLibrary("ffmpegPlayer");
+        native_init();
+    }
+
+    private long mNativeExtractor;
+
+    /**
+     * @param width      width of the thumbnails in pixels
+     * @param height     height of the thumbnails, 0 to keep the aspect ratio of the video
+     * @param bucketMs   times closer than this share a thumbnail
+     * @param cacheSize  number of thumbnails kept
+     */
+    public ThumbnailExtractor(String path, int width, int height, int bucketMs, int cacheSize)
+            throws IOException {
+        native_setup(path, width, height, bucketMs, cacheSize);
+    }
+
+    /**
+     * The RGBA pixels of the thumbnail at the given time, to be copied into an
+     * ARGB_8888 bitmap with copyPixelsFromBuffer, or null if it cannot be
+     * decoded. The thumbnails around it are decoded in the background.
+     */
+    public byte[] getThumbnail(int milliseconds) {
+        return native_getThumbnail(milliseconds);
+    }
+
+    public int getWidth() {
+        return native_getWidth();
+    }
+
+    public int getHeight() {
+        return native_getHeight();
+    }
+
+    public void release() {
+        native_release();
+    }
+
+    @Override
+    protected void finalize() throws Throwable {
+        native_release();
+    }
+
+    private static native void native_init();
+
+    private native void native_setup(String path, int width, int height, int bucketMs,
+                                     int cacheSize);
+
+    private native byte[] native_getThumbnail(int milliseconds);
+
+    private native int native_getWidth();
+
+    private native int native_getHeight();
+
+    private native void native_release();
+}